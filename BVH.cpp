@@ -0,0 +1,222 @@
+#include "includes/BVH.h"
+#include "includes/Profiler.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// number of buckets the centroids are binned into when evaluating splits
+#define SAH_BINS 16
+// cost of visiting a node
+#define SAH_TRAVERSAL_COST 1.f
+// cost of testing a triangle, leaves are tested 4 to 16 triangles at a time by
+// the SIMD kernels which favours fuller leaves
+#define SAH_INTERSECTION_COST 0.25f
+// boxes are padded so rounding in the slab test never drops a triangle hit
+#define BOX_PADDING 1e-5f
+
+namespace {
+
+struct Bounds {
+	float m_min[3], m_max[3];
+
+	Bounds() { reset(); }
+
+	void reset()
+	{
+		for (int a = 0; a < 3; ++a) {
+			m_min[a] = FLT_MAX;
+			m_max[a] = -FLT_MAX;
+		}
+	}
+
+	void grow(const float p[3])
+	{
+		for (int a = 0; a < 3; ++a) {
+			m_min[a] = std::min(m_min[a], p[a]);
+			m_max[a] = std::max(m_max[a], p[a]);
+		}
+	}
+
+	void grow(const Bounds &b)
+	{
+		for (int a = 0; a < 3; ++a) {
+			m_min[a] = std::min(m_min[a], b.m_min[a]);
+			m_max[a] = std::max(m_max[a], b.m_max[a]);
+		}
+	}
+
+	bool valid() const { return m_min[0] <= m_max[0]; }
+
+	float area() const
+	{
+		if (!valid()) return 0.f;
+		float dx = m_max[0] - m_min[0], dy = m_max[1] - m_min[1], dz = m_max[2] - m_min[2];
+		return 2.f * (dx*dy + dy*dz + dz*dx);
+	}
+};
+
+struct BuildTriangle {
+	Bounds m_bounds;
+	float m_centroid[3];
+	unsigned int m_index;
+};
+
+struct Builder {
+	std::vector<BuildTriangle> m_items;
+	std::vector<BVHNode> &m_nodes;
+	unsigned int m_depth;
+
+	Builder(std::vector<BVHNode> &nodes) : m_nodes(nodes), m_depth(0) {}
+
+	void make_leaf(BVHNode &node, unsigned int begin, unsigned int end)
+	{
+		node.m_offset = begin;
+		node.m_count = end - begin;
+	}
+
+	// builds the subtree over m_items[begin, end) rooted at m_nodes[index]
+	void build(unsigned int index, unsigned int begin, unsigned int end, unsigned int depth)
+	{
+		m_depth = std::max(m_depth, depth);
+
+		Bounds bounds, centroids;
+		for (unsigned int i = begin; i < end; ++i) {
+			bounds.grow(m_items[i].m_bounds);
+			centroids.grow(m_items[i].m_centroid);
+		}
+
+		BVHNode &node = m_nodes[index];
+		for (int a = 0; a < 3; ++a) {
+			node.m_min[a] = bounds.m_min[a];
+			node.m_max[a] = bounds.m_max[a];
+		}
+
+		unsigned int count = end - begin;
+		if (count <= 2 || depth + 2 >= BVH_MAX_DEPTH) {
+			make_leaf(node, begin, end);
+			return;
+		}
+
+		// evaluate the binned surface area heuristic along every axis
+		float best_cost = FLT_MAX;
+		int best_axis = -1, best_split = 0;
+		for (int axis = 0; axis < 3; ++axis) {
+			float lo = centroids.m_min[axis], extent = centroids.m_max[axis] - lo;
+			if (extent <= 0.f) continue;
+			float scale = SAH_BINS / extent;
+
+			Bounds bins[SAH_BINS];
+			unsigned int counts[SAH_BINS] = {0};
+			for (unsigned int i = begin; i < end; ++i) {
+				int b = std::min(SAH_BINS - 1, (int) ((m_items[i].m_centroid[axis] - lo) * scale));
+				bins[b].grow(m_items[i].m_bounds);
+				counts[b]++;
+			}
+
+			// sweep from the right to get the cost of every right hand side
+			float right_area[SAH_BINS];
+			unsigned int right_count[SAH_BINS];
+			Bounds acc;
+			unsigned int n = 0;
+			for (int b = SAH_BINS - 1; b > 0; --b) {
+				acc.grow(bins[b]);
+				n += counts[b];
+				right_area[b] = acc.area();
+				right_count[b] = n;
+			}
+
+			acc.reset();
+			n = 0;
+			for (int b = 0; b < SAH_BINS - 1; ++b) {
+				acc.grow(bins[b]);
+				n += counts[b];
+				if (n == 0 || right_count[b + 1] == 0) continue;
+				float cost = acc.area() * n + right_area[b + 1] * right_count[b + 1];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_split = b + 1;
+				}
+			}
+		}
+
+		float leaf_cost = SAH_INTERSECTION_COST * count;
+		float area = bounds.area();
+		if (best_axis >= 0 && area > 0.f)
+			best_cost = SAH_TRAVERSAL_COST + SAH_INTERSECTION_COST * best_cost / area;
+
+		unsigned int mid;
+		if (best_axis < 0) {
+			// every centroid coincides, no spatial split is possible
+			if (count <= BVH_MAX_LEAF) {
+				make_leaf(node, begin, end);
+				return;
+			}
+			mid = begin + count / 2;
+		} else {
+			if (best_cost >= leaf_cost && count <= BVH_MAX_LEAF) {
+				make_leaf(node, begin, end);
+				return;
+			}
+			float lo = centroids.m_min[best_axis];
+			float scale = SAH_BINS / (centroids.m_max[best_axis] - lo);
+			BuildTriangle *split = std::partition(&m_items[begin], &m_items[0] + end, [=](const BuildTriangle &t) {
+				return std::min(SAH_BINS - 1, (int) ((t.m_centroid[best_axis] - lo) * scale)) < best_split;
+			});
+			mid = split - &m_items[0];
+			if (mid == begin || mid == end) mid = begin + count / 2;
+		}
+
+		// the first child directly follows its parent, the second after the whole first subtree
+		unsigned int left = m_nodes.size();
+		m_nodes.push_back(BVHNode());
+		build(left, begin, mid, depth + 1);
+
+		unsigned int right = m_nodes.size();
+		m_nodes.push_back(BVHNode());
+		build(right, mid, end, depth + 1);
+
+		m_nodes[index].m_offset = right;
+		m_nodes[index].m_count = 0;
+	}
+};
+
+}
+
+void BVH::build(const std::vector<CompFab::Triangle> &triangles)
+{
+	ScopedTimer timer("build bvh");
+	m_nodes.clear();
+	m_triangles.clear();
+	m_soa.build(m_triangles);
+	m_depth = 0;
+	if (triangles.empty()) return;
+
+	Builder builder(m_nodes);
+	builder.m_items.resize(triangles.size());
+	for (unsigned int i = 0; i < triangles.size(); ++i) {
+		const CompFab::Triangle &t = triangles[i];
+		BuildTriangle &item = builder.m_items[i];
+		item.m_bounds.grow(t.m_v1.m_pos);
+		item.m_bounds.grow(t.m_v2.m_pos);
+		item.m_bounds.grow(t.m_v3.m_pos);
+		for (int a = 0; a < 3; ++a) {
+			// pad relative to the magnitude of the coordinates
+			float pad = BOX_PADDING * (1.f + std::max(fabsf(item.m_bounds.m_min[a]), fabsf(item.m_bounds.m_max[a])));
+			item.m_bounds.m_min[a] -= pad;
+			item.m_bounds.m_max[a] += pad;
+			item.m_centroid[a] = 0.5f * (item.m_bounds.m_min[a] + item.m_bounds.m_max[a]);
+		}
+		item.m_index = i;
+	}
+
+	m_nodes.reserve(2 * triangles.size());
+	m_nodes.push_back(BVHNode());
+	builder.build(0, 0, triangles.size(), 0);
+	m_depth = builder.m_depth;
+
+	m_triangles.reserve(triangles.size());
+	for (unsigned int i = 0; i < builder.m_items.size(); ++i)
+		m_triangles.push_back(triangles[builder.m_items[i].m_index]);
+	m_soa.build(m_triangles);
+}
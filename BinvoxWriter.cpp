@@ -0,0 +1,200 @@
+#include "includes/BinvoxWriter.h"
+#include "includes/ThreadPool.h"
+#include "includes/bits.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+using CompFab::Word;
+using CompFab::VOXELS_PER_WORD;
+
+// bytes collected before they are handed to the file
+#define BINVOX_BUFFER_SIZE (4 << 20)
+// 64 word blocks transposed per parallel_for task
+#define BLOCKS_PER_TASK 64
+
+// run length encodes the first n bits of a bit plane
+static void encode_segment(const Word *plane, size_t n, BinvoxWriter::Segment &segment)
+{
+	segment.m_body.clear();
+	segment.m_single = true;
+
+	unsigned char value = plane[0] & 1;
+	size_t start = 0;
+	while (start < n) {
+		// find the first bit from start on that differs from value
+		size_t k = start / VOXELS_PER_WORD;
+		Word flip = value ? ~Word(0) : Word(0);
+		Word diff = (plane[k] ^ flip) & (~Word(0) << (start % VOXELS_PER_WORD));
+		size_t blocks = (n + VOXELS_PER_WORD - 1) / VOXELS_PER_WORD;
+		while (diff == 0 && ++k < blocks)
+			diff = plane[k] ^ flip;
+		size_t end = diff ? std::min(n, k*VOXELS_PER_WORD + __builtin_ctzll(diff)) : n;
+
+		uint64_t length = end - start;
+		if (start == 0) {
+			segment.m_headValue = value;
+			segment.m_headLength = length;
+		} else {
+			if (!segment.m_single) {
+				// the previous run is complete and lies inside the segment
+				for (uint64_t left = segment.m_tailLength; left > 0; ) {
+					unsigned char count = std::min<uint64_t>(left, 255);
+					segment.m_body.push_back(segment.m_tailValue);
+					segment.m_body.push_back(count);
+					left -= count;
+				}
+			}
+			segment.m_single = false;
+		}
+		segment.m_tailValue = value;
+		segment.m_tailLength = length;
+
+		start = end;
+		value ^= 1;
+	}
+}
+
+BinvoxWriter::BinvoxWriter()
+	: m_file(NULL), m_failed(false), m_buffer(BINVOX_BUFFER_SIZE), m_buffered(0)
+{
+}
+
+BinvoxWriter::~BinvoxWriter()
+{
+	if (m_file) fclose(m_file);
+}
+
+bool BinvoxWriter::open(const char *filename, unsigned int dimX, unsigned int dimY, unsigned int dimZ,
+	const CompFab::Vec3 &translate, CompFab::precision_type scale)
+{
+	if (m_file) fclose(m_file);
+	m_file = fopen(filename, "wb");
+	if (!m_file) return false;
+
+	m_failed = false;
+	m_dimX = dimX;
+	m_dimY = dimY;
+	m_dimZ = dimZ;
+	m_nextColumn = 0;
+	m_runValue = 0;
+	m_runLength = 0;
+	m_buffered = 0;
+
+	// formatted by iostreams like the header has always been
+	std::ostringstream header;
+	header << "#binvox 1" << std::endl;
+	header << "dim " << dimX << " " << dimY << " " << dimZ << "" << std::endl;
+	header << "translate " << translate.m_x << " " << translate.m_y << " " << translate.m_z << "" << std::endl;
+	header << "scale " << scale << std::endl;
+	header << "data" << std::endl;
+	std::string text = header.str();
+	write(text.data(), text.size());
+	return true;
+}
+
+void BinvoxWriter::write_column(unsigned int w, const Word *column)
+{
+	if (!m_file || w != m_nextColumn) {
+		m_failed = true;
+		return;
+	}
+	m_nextColumn++;
+
+	size_t n = (size_t) m_dimZ*m_dimY;
+	size_t blocks = (n + VOXELS_PER_WORD - 1) / VOXELS_PER_WORD;
+	unsigned int slices = std::min<unsigned int>(VOXELS_PER_WORD, m_dimX - w*VOXELS_PER_WORD);
+	if (n == 0) return;
+
+	ThreadPool &pool = ThreadPool::global();
+
+	// plane b holds bit b of every word in the column, in traversal order
+	m_planes.resize(blocks * VOXELS_PER_WORD);
+	size_t tasks = (blocks + BLOCKS_PER_TASK - 1) / BLOCKS_PER_TASK;
+	pool.parallel_for(0, tasks, [&](size_t task) {
+		Word block[VOXELS_PER_WORD];
+		size_t k_end = std::min(blocks, (task + 1) * BLOCKS_PER_TASK);
+		for (size_t k = task * BLOCKS_PER_TASK; k < k_end; ++k) {
+			size_t first = k * VOXELS_PER_WORD;
+			size_t count = std::min<size_t>(VOXELS_PER_WORD, n - first);
+			memcpy(block, column + first, count * sizeof(Word));
+			memset(block + count, 0, (VOXELS_PER_WORD - count) * sizeof(Word));
+			transpose64(block);
+			for (unsigned int b = 0; b < slices; ++b)
+				m_planes[b * blocks + k] = block[b];
+		}
+	});
+
+	m_segments.resize(slices);
+	pool.parallel_for(0, slices, [&](size_t b) {
+		encode_segment(&m_planes[b * blocks], n, m_segments[b]);
+	});
+
+	for (unsigned int b = 0; b < slices; ++b)
+		append(m_segments[b]);
+}
+
+void BinvoxWriter::append(const Segment &segment)
+{
+	// the head continues the open run if it has the same value
+	if (m_runLength > 0 && m_runValue == segment.m_headValue) {
+		m_runLength += segment.m_headLength;
+	} else {
+		if (m_runLength > 0) emit_run(m_runValue, m_runLength);
+		m_runValue = segment.m_headValue;
+		m_runLength = segment.m_headLength;
+	}
+	if (segment.m_single) return;
+
+	emit_run(m_runValue, m_runLength);
+	if (!segment.m_body.empty()) write(&segment.m_body[0], segment.m_body.size());
+	m_runValue = segment.m_tailValue;
+	m_runLength = segment.m_tailLength;
+}
+
+void BinvoxWriter::emit_run(unsigned char value, uint64_t length)
+{
+	while (length > 0) {
+		unsigned char pair[2] = {value, (unsigned char) std::min<uint64_t>(length, 255)};
+		write(pair, 2);
+		length -= pair[1];
+	}
+}
+
+void BinvoxWriter::write(const void *data, size_t bytes)
+{
+	if (m_buffered + bytes > m_buffer.size()) flush();
+	if (bytes >= m_buffer.size()) {
+		if (fwrite(data, 1, bytes, m_file) != bytes) m_failed = true;
+		return;
+	}
+	memcpy(&m_buffer[m_buffered], data, bytes);
+	m_buffered += bytes;
+}
+
+void BinvoxWriter::flush()
+{
+	if (m_buffered > 0 && fwrite(&m_buffer[0], 1, m_buffered, m_file) != m_buffered)
+		m_failed = true;
+	m_buffered = 0;
+}
+
+bool BinvoxWriter::close()
+{
+	if (!m_file) return false;
+	if (m_nextColumn * (size_t) VOXELS_PER_WORD < m_dimX) m_failed = true;
+
+	if (m_runLength > 0) {
+		emit_run(m_runValue, m_runLength);
+	} else {
+		// an empty grid still ends in a (0, 0) pair
+		unsigned char pair[2] = {0, 0};
+		write(pair, 2);
+	}
+	flush();
+
+	if (fclose(m_file) != 0) m_failed = true;
+	m_file = NULL;
+	return !m_failed;
+}
@@ -0,0 +1,242 @@
+#include "includes/BrickMap.h"
+#include "includes/BinvoxWriter.h"
+#include "includes/RawWriter.h"
+#include "includes/ThreadPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+using CompFab::Word;
+using CompFab::VOXELS_PER_WORD;
+
+// a brick layer is one word, a brick row one byte of it
+#if BRICK_SIZE != 8
+#error "BrickMap packs a layer of a brick into one 64 bit word"
+#endif
+
+#define BRICKS_PER_WORD (VOXELS_PER_WORD / BRICK_SIZE)
+
+BrickMap::BrickMap(const CompFab::Vec3 &lowerLeft, unsigned int dimX, unsigned int dimY, unsigned int dimZ, CompFab::precision_type spacing)
+	: m_dimX(dimX), m_dimY(dimY), m_dimZ(dimZ), m_spacing(spacing), m_lowerLeft(lowerLeft), m_layers(0)
+{
+	m_wordsPerRow = (dimX + VOXELS_PER_WORD - 1) / VOXELS_PER_WORD;
+	m_bricksX = (dimX + BRICK_SIZE - 1) / BRICK_SIZE;
+	m_bricksY = (dimY + BRICK_SIZE - 1) / BRICK_SIZE;
+	m_bricksZ = (dimZ + BRICK_SIZE - 1) / BRICK_SIZE;
+	m_nodesX = (m_bricksX + BRICK_SIZE - 1) / BRICK_SIZE;
+	m_nodesY = (m_bricksY + BRICK_SIZE - 1) / BRICK_SIZE;
+	m_nodesZ = (m_bricksZ + BRICK_SIZE - 1) / BRICK_SIZE;
+	m_nodes.assign((size_t) m_nodesX*m_nodesY*m_nodesZ, EMPTY);
+}
+
+void BrickMap::insert(const CompFab::VoxelGrid &slab)
+{
+	assert(slab.m_dimX == m_dimX && slab.m_dimY == m_dimY);
+	assert(slab.m_firstZ == m_layers && slab.m_firstZ % BRICK_SIZE == 0);
+	assert(slab.m_dimZ % BRICK_SIZE == 0 || slab.m_firstZ + slab.m_dimZ == m_dimZ);
+
+	unsigned int bz0 = slab.m_firstZ / BRICK_SIZE;
+	unsigned int bz1 = (slab.m_firstZ + slab.m_dimZ + BRICK_SIZE - 1) / BRICK_SIZE;
+	std::vector<uint32_t> tags((size_t) m_bricksY*m_bricksX);
+	std::vector<std::vector<Word> > mixed(m_bricksY);
+
+	for (unsigned int bz = bz0; bz < bz1; ++bz) {
+		// classify the bricks row by row in parallel, every row collecting its mixed
+		// bricks on its own so they are numbered in order below
+		ThreadPool::global().parallel_for(0, m_bricksY, [&](size_t by) {
+			mixed[by].clear();
+			for (unsigned int bx = 0; bx < m_bricksX; ++bx) {
+				unsigned int width = std::min<unsigned int>(BRICK_SIZE, m_dimX - bx*BRICK_SIZE);
+				Word row_valid = (Word(1) << width) - 1;
+				Word layers[BRICK_SIZE];
+				bool any = false, all = true;
+				for (unsigned int z = 0; z < BRICK_SIZE; ++z) {
+					unsigned int k = bz*BRICK_SIZE + z;
+					Word layer = 0, valid = 0;
+					if (k < m_dimZ)
+						for (unsigned int y = 0; y < BRICK_SIZE && by*BRICK_SIZE + y < m_dimY; ++y) {
+							Word word = slab.row(by*BRICK_SIZE + y, k - slab.m_firstZ)[bx / BRICKS_PER_WORD];
+							layer |= ((word >> (bx % BRICKS_PER_WORD * BRICK_SIZE)) & row_valid) << (BRICK_SIZE*y);
+							valid |= row_valid << (BRICK_SIZE*y);
+						}
+					layers[z] = layer;
+					any |= layer != 0;
+					all &= layer == valid;
+				}
+				uint32_t tag = !any ? EMPTY : all ? FULL : FIRST_INDEX + mixed[by].size() / BRICK_SIZE;
+				if (tag >= FIRST_INDEX) mixed[by].insert(mixed[by].end(), layers, layers + BRICK_SIZE);
+				tags[(size_t) by*m_bricksX + bx] = tag;
+			}
+		});
+
+		for (unsigned int by = 0; by < m_bricksY; ++by) {
+			uint32_t first = m_payload.size() / BRICK_SIZE;
+			m_payload.insert(m_payload.end(), mixed[by].begin(), mixed[by].end());
+			for (unsigned int bx = 0; bx < m_bricksX; ++bx) {
+				uint32_t tag = tags[(size_t) by*m_bricksX + bx];
+				if (tag == EMPTY) continue;
+				if (tag >= FIRST_INDEX) tag += first;
+
+				uint32_t &node = m_nodes[((size_t) (bz / BRICK_SIZE)*m_nodesY + by / BRICK_SIZE)*m_nodesX + bx / BRICK_SIZE];
+				if (node < FIRST_INDEX) {
+					// the node's first brick that is not empty
+					if (m_freeTables.empty()) {
+						node = FIRST_INDEX + m_tables.size() / BRICKS_PER_NODE;
+						m_tables.resize(m_tables.size() + BRICKS_PER_NODE, EMPTY);
+					} else {
+						node = m_freeTables.back();
+						m_freeTables.pop_back();
+						std::fill(m_tables.begin() + (size_t) (node - FIRST_INDEX)*BRICKS_PER_NODE,
+							m_tables.begin() + (size_t) (node - FIRST_INDEX + 1)*BRICKS_PER_NODE, (uint32_t) EMPTY);
+					}
+				}
+				m_tables[(size_t) (node - FIRST_INDEX)*BRICKS_PER_NODE + ((bz % BRICK_SIZE)*BRICK_SIZE + by % BRICK_SIZE)*BRICK_SIZE + bx % BRICK_SIZE] = tag;
+			}
+		}
+
+		if (bz % BRICK_SIZE == BRICK_SIZE - 1 || bz == m_bricksZ - 1)
+			collapse(bz / BRICK_SIZE);
+	}
+	m_layers += slab.m_dimZ;
+}
+
+void BrickMap::collapse(unsigned int nz)
+{
+	for (unsigned int ny = 0; ny < m_nodesY; ++ny)
+		for (unsigned int nx = 0; nx < m_nodesX; ++nx) {
+			uint32_t &node = m_nodes[((size_t) nz*m_nodesY + ny)*m_nodesX + nx];
+			if (node < FIRST_INDEX) continue;
+
+			// bricks past the end of the grid stay empty, only the others count
+			uint32_t uniform = brick(nx*BRICK_SIZE, ny*BRICK_SIZE, nz*BRICK_SIZE);
+			for (unsigned int bz = nz*BRICK_SIZE; uniform < FIRST_INDEX && bz < std::min(m_bricksZ, (nz + 1)*BRICK_SIZE); ++bz)
+				for (unsigned int by = ny*BRICK_SIZE; uniform < FIRST_INDEX && by < std::min(m_bricksY, (ny + 1)*BRICK_SIZE); ++by)
+					for (unsigned int bx = nx*BRICK_SIZE; bx < std::min(m_bricksX, (nx + 1)*BRICK_SIZE); ++bx)
+						if (brick(bx, by, bz) != uniform) {
+							uniform = FIRST_INDEX;
+							break;
+						}
+			if (uniform < FIRST_INDEX) {
+				m_freeTables.push_back(node);
+				node = uniform;
+			}
+		}
+}
+
+void BrickMap::layers(unsigned int first, unsigned int depth, Word *out) const
+{
+	size_t layer_words = (size_t) m_dimY*m_wordsPerRow;
+	unsigned int bz0 = first / BRICK_SIZE, bz1 = (first + depth + BRICK_SIZE - 1) / BRICK_SIZE;
+
+	// fetches the tags of a row of bricks once for the BRICK_SIZE^2 rows of voxels through it
+	ThreadPool::global().parallel_for(0, (size_t) (bz1 - bz0)*m_bricksY, [&](size_t task) {
+		unsigned int bz = bz0 + task / m_bricksY, by = task % m_bricksY;
+		std::vector<uint32_t> tags(m_bricksX);
+		for (unsigned int bx = 0; bx < m_bricksX; ++bx) tags[bx] = brick(bx, by, bz);
+
+		unsigned int z0 = std::max(first, bz*BRICK_SIZE), z1 = std::min(first + depth, (bz + 1)*BRICK_SIZE);
+		unsigned int y1 = std::min(m_dimY, (by + 1)*BRICK_SIZE);
+		for (unsigned int k = z0; k < z1; ++k)
+			for (unsigned int j = by*BRICK_SIZE; j < y1; ++j) {
+				Word *row = out + (k - first)*layer_words + (size_t) j*m_wordsPerRow;
+				for (unsigned int w = 0; w < m_wordsPerRow; ++w) {
+					Word word = 0;
+					for (unsigned int b = 0; b < BRICKS_PER_WORD && w*BRICKS_PER_WORD + b < m_bricksX; ++b) {
+						Word layer = brick_layer(tags[w*BRICKS_PER_WORD + b], k % BRICK_SIZE);
+						word |= ((layer >> (BRICK_SIZE*(j % BRICK_SIZE))) & 0xFF) << (BRICK_SIZE*b);
+					}
+					unsigned int rest = m_dimX - w*VOXELS_PER_WORD;
+					row[w] = rest >= VOXELS_PER_WORD ? word : word & ((Word(1) << rest) - 1);
+				}
+			}
+	});
+}
+
+void BrickMap::column(unsigned int w, Word *out) const
+{
+	unsigned int rest = m_dimX - w*VOXELS_PER_WORD;
+	Word mask = rest >= VOXELS_PER_WORD ? ~Word(0) : (Word(1) << rest) - 1;
+
+	ThreadPool::global().parallel_for(0, (size_t) m_bricksZ*m_bricksY, [&](size_t task) {
+		unsigned int bz = task / m_bricksY, by = task % m_bricksY;
+		uint32_t tags[BRICKS_PER_WORD];
+		unsigned int count = std::min<unsigned int>(BRICKS_PER_WORD, m_bricksX - w*BRICKS_PER_WORD);
+		for (unsigned int b = 0; b < count; ++b) tags[b] = brick(w*BRICKS_PER_WORD + b, by, bz);
+
+		unsigned int z1 = std::min(m_dimZ, (bz + 1)*BRICK_SIZE), y1 = std::min(m_dimY, (by + 1)*BRICK_SIZE);
+		for (unsigned int k = bz*BRICK_SIZE; k < z1; ++k)
+			for (unsigned int j = by*BRICK_SIZE; j < y1; ++j) {
+				Word word = 0;
+				for (unsigned int b = 0; b < count; ++b)
+					word |= ((brick_layer(tags[b], k % BRICK_SIZE) >> (BRICK_SIZE*(j % BRICK_SIZE))) & 0xFF) << (BRICK_SIZE*b);
+				out[(size_t) k*m_dimY + j] = word & mask;
+			}
+	});
+}
+
+size_t BrickMap::count() const
+{
+	size_t filled = 0;
+	for (unsigned int bz = 0; bz < m_bricksZ; ++bz)
+		for (unsigned int by = 0; by < m_bricksY; ++by)
+			for (unsigned int bx = 0; bx < m_bricksX; ++bx) {
+				uint32_t tag = brick(bx, by, bz);
+				if (tag == FULL)
+					filled += (size_t) std::min<unsigned int>(BRICK_SIZE, m_dimX - bx*BRICK_SIZE)
+						* std::min<unsigned int>(BRICK_SIZE, m_dimY - by*BRICK_SIZE)
+						* std::min<unsigned int>(BRICK_SIZE, m_dimZ - bz*BRICK_SIZE);
+				else if (tag >= FIRST_INDEX)
+					for (unsigned int z = 0; z < BRICK_SIZE; ++z)
+						filled += __builtin_popcountll(brick_layer(tag, z));
+			}
+	return filled;
+}
+
+size_t BrickMap::full_bricks() const
+{
+	size_t full = 0;
+	for (unsigned int bz = 0; bz < m_bricksZ; ++bz)
+		for (unsigned int by = 0; by < m_bricksY; ++by)
+			for (unsigned int bx = 0; bx < m_bricksX; ++bx)
+				full += brick(bx, by, bz) == FULL;
+	return full;
+}
+
+size_t BrickMap::memory() const
+{
+	return (m_nodes.capacity() + m_tables.capacity() + m_freeTables.capacity())*sizeof(uint32_t)
+		+ m_payload.capacity()*sizeof(Word) + sizeof(*this);
+}
+
+bool BrickMap::save_binvox(const char *filename) const
+{
+	BinvoxWriter writer;
+	if (!writer.open(filename, m_dimX, m_dimY, m_dimZ, m_lowerLeft, m_spacing))
+	{
+		std::cerr << "Could not open " << filename << " for writing" << std::endl;
+		return false;
+	}
+
+	std::vector<Word> column_words((size_t) m_dimZ*m_dimY);
+	for (unsigned int w = 0; w < m_wordsPerRow; ++w) {
+		column(w, column_words.empty() ? NULL : &column_words[0]);
+		writer.write_column(w, column_words.empty() ? NULL : &column_words[0]);
+	}
+	return writer.close();
+}
+
+bool BrickMap::save_raw(const char *filename) const
+{
+	RawWriter out;
+	if (!out.open(filename)) return false;
+	out.write_header(m_dimX, m_dimY, m_dimZ, m_lowerLeft, m_spacing);
+
+	std::vector<Word> words((size_t) BRICK_SIZE*m_dimY*m_wordsPerRow);
+	for (unsigned int z = 0; z < m_dimZ; z += BRICK_SIZE) {
+		unsigned int depth = std::min<unsigned int>(BRICK_SIZE, m_dimZ - z);
+		layers(z, depth, words.empty() ? NULL : &words[0]);
+		out.write(words.empty() ? NULL : &words[0], (size_t) depth*m_dimY*m_wordsPerRow);
+	}
+	return out.close();
+}
@@ -6,12 +6,14 @@
 //
 
 #include "includes/CompFab.h"
+#include "includes/BinvoxWriter.h"
 #include <iostream>
 #include <string>
 #include <cassert>
 #include <sstream>
 #include <fstream>
 #include <vector>
+#include <algorithm>
 using namespace CompFab;
 
 
@@ -126,21 +128,24 @@ precision_type CompFab::operator*(const Vec3 &v1, const Vec3 &v2)
 
 
 //Grid structure for Voxels
-CompFab::VoxelGridStruct::VoxelGridStruct(Vec3 lowerLeft, unsigned int dimX, unsigned int dimY, unsigned int dimZ, precision_type spacing)
+CompFab::VoxelGridStruct::VoxelGridStruct(Vec3 lowerLeft, unsigned int dimX, unsigned int dimY, unsigned int dimZ, precision_type spacing, unsigned int firstZ)
 {
     m_lowerLeft = lowerLeft;
     m_dimX = dimX;
     m_dimY = dimY;
     m_dimZ = dimZ;
-    m_size = dimX*dimY*dimZ;
+    m_firstZ = firstZ;
+    m_size = (size_t) dimX*dimY*dimZ;
+    m_wordsPerRow = (dimX + VOXELS_PER_WORD - 1) / VOXELS_PER_WORD;
+    m_numWords = (size_t) m_wordsPerRow*dimY*dimZ;
     m_spacing = spacing;
 
     //Allocate Memory
-    m_insideArray = new bool[m_size];
+    m_insideArray = new Word[m_numWords];
 
-    for(unsigned int ii=0; ii<m_size; ++ii)
+    for(size_t ii=0; ii<m_numWords; ++ii)
     {
-        m_insideArray[ii] = false;
+        m_insideArray[ii] = 0;
     }
     
 }
@@ -150,55 +155,43 @@ CompFab::VoxelGridStruct::~VoxelGridStruct()
     delete[] m_insideArray;
 }
 
-// void CompFab::VoxelGridStruct::save_binvox(const char * filename)
-// {
-    
-// }
-
-
+size_t CompFab::VoxelGridStruct::count() const
+{
+    size_t filled = 0;
+    for(size_t ii=0; ii<m_numWords; ++ii)
+    {
+        filled += __builtin_popcountll(m_insideArray[ii]);
+    }
+    return filled;
+}
 
 // void write_binvox(const char * filename) 
-void CompFab::VoxelGridStruct::save_binvox(const char * filename)
+bool CompFab::VoxelGridStruct::save_binvox(const char * filename) const
 {
-    // Open file
-    std::ofstream output(filename, std::ios::out | std::ios::binary);
-    assert(output);
-    
-    // Write ASCII header
-    output << "#binvox 1" << std::endl;
-    output << "dim " << m_dimX << " " << m_dimY << " " << m_dimZ << "" << std::endl;
-    output << "translate " << m_lowerLeft.m_x << " " << m_lowerLeft.m_y << " " << m_lowerLeft.m_z << "" << std::endl;
-    output << "scale " <<  m_spacing << std::endl;
-    output << "data" << std::endl;
-
-    // Write first voxel
-    char currentvalue = char(isInside(0,0,0));
-    output.write((char*)&currentvalue, 1);
-    char current_seen = 1;
-
-    // Write BINARY Data
-    for (size_t x = 0; x < m_dimX; x++){
-        for (size_t z = 0; z < m_dimY; z++){
-            for (size_t y = 0; y < m_dimZ; y++){
-                if (x == 0 && y == 0 && z == 0){
-                    continue;
-                }
-                char nextvalue = char(isInside(x, y, z));
-                if (nextvalue != currentvalue || current_seen == (char) 255){
-                    output.write((char*)&current_seen, 1);
-                    current_seen = 1;
-                    currentvalue = nextvalue;
-                    output.write((char*)&currentvalue, 1);
-                }
-                else {
-                    current_seen++;
-                }
+    BinvoxWriter writer;
+    if (!writer.open(filename, m_dimX, m_dimY, m_dimZ, m_lowerLeft, m_spacing))
+    {
+        std::cerr << "Could not open " << filename << " for writing" << std::endl;
+        return false;
+    }
+
+    // binvox runs over x slowest, then z, then y. Every word holds 64 consecutive
+    // x values, so hand the writer the words of all (z, y) rows for one word column
+    std::vector<Word> column((size_t) m_dimZ*m_dimY);
+
+    for (unsigned int w = 0; w < m_wordsPerRow; w++){
+        for (unsigned int z = 0; z < m_dimZ; z++){
+            for (unsigned int y = 0; y < m_dimY; y++){
+                column[(size_t) z*m_dimY + y] = word(w, y, z);
             }
         }
+        writer.write_column(w, column.empty() ? NULL : &column[0]);
     }
 
-    // Write rest
-    output.write((char*)&current_seen, 1);
-    output.close();
+    if (!writer.close())
+    {
+        std::cerr << "Failed to write " << filename << std::endl;
+        return false;
+    }
+    return true;
 }
-
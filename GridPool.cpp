@@ -0,0 +1,47 @@
+#include "includes/GridPool.h"
+#include "includes/Profiler.h"
+
+#include <algorithm>
+
+GridPool::~GridPool()
+{
+	for (size_t i = 0; i < m_free.size(); ++i) delete m_free[i];
+}
+
+CompFab::VoxelGrid *GridPool::take(const CompFab::Vec3 &lowerLeft, unsigned int dimX, unsigned int dimY, unsigned int dimZ, CompFab::precision_type spacing)
+{
+	// a reused grid is cleared instead, which is timed the same
+	ScopedTimer timer("allocate grid");
+	CompFab::VoxelGrid *grid = NULL;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (std::deque<CompFab::VoxelGrid *>::iterator it = m_free.begin(); it != m_free.end(); ++it)
+			if ((*it)->m_dimX == dimX && (*it)->m_dimY == dimY && (*it)->m_dimZ == dimZ && (*it)->m_firstZ == 0) {
+				grid = *it;
+				m_free.erase(it);
+				m_freeBytes -= grid->m_numWords*sizeof(CompFab::Word);
+				++m_reused;
+				break;
+			}
+		if (!grid) ++m_allocated;
+	}
+	if (!grid) return new CompFab::VoxelGrid(lowerLeft, dimX, dimY, dimZ, spacing);
+
+	grid->m_lowerLeft = lowerLeft;
+	grid->m_spacing = spacing;
+	std::fill(grid->m_insideArray, grid->m_insideArray + grid->m_numWords, 0);
+	return grid;
+}
+
+void GridPool::give(CompFab::VoxelGrid *grid)
+{
+	if (!grid) return;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_free.push_back(grid);
+	m_freeBytes += grid->m_numWords*sizeof(CompFab::Word);
+	while (m_freeBytes > m_maxFreeBytes && !m_free.empty()) {
+		m_freeBytes -= m_free.front()->m_numWords*sizeof(CompFab::Word);
+		delete m_free.front();
+		m_free.pop_front();
+	}
+}
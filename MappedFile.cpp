@@ -0,0 +1,77 @@
+#include "includes/MappedFile.h"
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : m_data(NULL), m_size(0), m_open(false), m_mapped(false) {}
+
+MappedFile::MappedFile(const char *filename) : m_data(NULL), m_size(0), m_open(false), m_mapped(false)
+{
+	open(filename);
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char *filename)
+{
+	close();
+
+#ifndef _WIN32
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+
+	m_size = st.st_size;
+	if (m_size > 0) {
+		void *data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			::close(fd);
+			m_size = 0;
+			return false;
+		}
+		// the parsers read front to back
+		madvise(data, m_size, MADV_SEQUENTIAL);
+		m_data = (const char *) data;
+		m_mapped = true;
+	}
+	// the mapping stays valid after the descriptor is closed
+	::close(fd);
+#else
+	std::ifstream f(filename, std::ios::in | std::ios::binary);
+	if (!f.good()) return false;
+	f.seekg(0, std::ios::end);
+	m_buffer.resize((size_t) f.tellg());
+	f.seekg(0, std::ios::beg);
+	if (!m_buffer.empty()) f.read(&m_buffer[0], m_buffer.size());
+	m_size = m_buffer.size();
+	m_data = m_buffer.empty() ? NULL : &m_buffer[0];
+#endif
+
+	m_open = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+	if (m_mapped) munmap((void *) m_data, m_size);
+#endif
+	m_buffer.clear();
+	m_data = NULL;
+	m_size = 0;
+	m_open = m_mapped = false;
+}
@@ -1,5 +1,6 @@
 #include "includes/Mesh.h"
 #include "includes/CompFab.h"
+#include "includes/ObjReader.h"
 #include <fstream>
 #include <iostream>
 #include <algorithm>
@@ -217,7 +218,6 @@ void Mesh::read_obj(std::istream & f)
         tex.push_back(texcoord);
     }
   }
-  std::cout<<"Num Triangles: "<< t.size()<<"\n";
 }
 
 void Mesh::read_ply(std::istream & f)
@@ -317,7 +317,9 @@ void Mesh::load_mesh(const char * filename, bool normalize)
     read_ply(f);
     break;
   case 'j':
-    read_obj(f);
+    if(!read_obj_mapped(filename, *this)){
+      read_obj(f);
+    }
     break;
   default:
     break;
@@ -0,0 +1,148 @@
+#include "includes/MeshCache.h"
+#include "includes/MappedFile.h"
+#include "includes/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define VMESH_BYTE_ORDER 0x01020304u
+// triangles built from the indices per parallel_for task
+#define TRIANGLES_PER_TASK 65536
+
+static const char VMESH_MAGIC[8] = {'V', 'M', 'E', 'S', 'H', 0, 0, 0};
+
+static bool source_stat(const char *source, uint64_t &size, int64_t &mtime)
+{
+	struct stat st;
+	if (stat(source, &st) != 0) return false;
+	size = st.st_size;
+#ifdef __linux__
+	// nanoseconds, edits within the same second still invalidate the cache
+	mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+	mtime = st.st_mtime;
+#endif
+	return true;
+}
+
+// a temporary name no other process or thread writes to
+static std::string temp_path(const std::string &path)
+{
+	static std::atomic<unsigned int> count(0);
+	std::ostringstream temp;
+	temp << path << "." << getpid() << "." << count++ << ".tmp";
+	return temp.str();
+}
+
+std::string vmesh_path(const std::string &source)
+{
+	return source + ".vmesh";
+}
+
+bool load_vmesh(const char *source, std::vector<CompFab::Triangle> &triangles, CompFab::Vec3 &bbMin, CompFab::Vec3 &bbMax)
+{
+	uint64_t size;
+	int64_t mtime;
+	if (!source_stat(source, size, mtime)) return false;
+
+	MappedFile file;
+	if (!file.open(vmesh_path(source).c_str()) || file.size() < sizeof(VMeshHeader)) return false;
+
+	VMeshHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, VMESH_MAGIC, sizeof(VMESH_MAGIC)) != 0
+		|| header.byte_order != VMESH_BYTE_ORDER || header.version != VMESH_VERSION
+		|| header.source_size != size || header.source_mtime != mtime)
+		return false;
+
+	// the arrays must lie within the file. The counts are bounded first so the
+	// sizes cannot overflow, and the offsets are compared without adding to them
+	if (header.num_vertices > file.size() / (3 * sizeof(float)) || header.num_triangles > file.size() / (3 * sizeof(uint32_t)))
+		return false;
+	uint64_t vertex_bytes = header.num_vertices * 3 * sizeof(float);
+	uint64_t index_bytes = header.num_triangles * 3 * sizeof(uint32_t);
+	if (header.vertex_offset > file.size() - vertex_bytes || header.index_offset > file.size() - index_bytes
+		|| header.vertex_offset % sizeof(float) || header.index_offset % sizeof(uint32_t))
+		return false;
+
+	const float *vertices = (const float *) (file.data() + header.vertex_offset);
+	const uint32_t *indices = (const uint32_t *) (file.data() + header.index_offset);
+	const uint64_t num_vertices = header.num_vertices;
+
+	CompFab::Vec3 zero;
+	triangles.assign(header.num_triangles, CompFab::Triangle(zero, zero, zero));
+
+	size_t tasks = (header.num_triangles + TRIANGLES_PER_TASK - 1) / TRIANGLES_PER_TASK;
+	std::atomic<bool> valid(true);
+	ThreadPool::global().parallel_for(0, tasks, [&](size_t task) {
+		size_t end = std::min((size_t) header.num_triangles, (task + 1) * TRIANGLES_PER_TASK);
+		for (size_t tri = task * TRIANGLES_PER_TASK; tri < end; ++tri) {
+			CompFab::Vec3 *corners[3] = {&triangles[tri].m_v1, &triangles[tri].m_v2, &triangles[tri].m_v3};
+			for (int c = 0; c < 3; ++c) {
+				uint32_t index = indices[3*tri + c];
+				if (index >= num_vertices) {
+					valid = false;
+					return;
+				}
+				const float *v = vertices + 3*(size_t) index;
+				*corners[c] = CompFab::Vec3(v[0], v[1], v[2]);
+			}
+		}
+	});
+	if (!valid) {
+		triangles.clear();
+		return false;
+	}
+
+	bbMin = CompFab::Vec3(header.bbox_min[0], header.bbox_min[1], header.bbox_min[2]);
+	bbMax = CompFab::Vec3(header.bbox_max[0], header.bbox_max[1], header.bbox_max[2]);
+	return true;
+}
+
+bool save_vmesh(const char *source, const Mesh &mesh, const CompFab::Vec3 &bbMin, const CompFab::Vec3 &bbMax)
+{
+	VMeshHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, VMESH_MAGIC, sizeof(VMESH_MAGIC));
+	header.byte_order = VMESH_BYTE_ORDER;
+	header.version = VMESH_VERSION;
+	if (!source_stat(source, header.source_size, header.source_mtime)) return false;
+	header.num_vertices = mesh.v.size();
+	header.num_triangles = mesh.t.size();
+	header.vertex_offset = sizeof(VMeshHeader);
+	header.index_offset = header.vertex_offset + header.num_vertices * 3 * sizeof(float);
+	for (int a = 0; a < 3; ++a) {
+		header.bbox_min[a] = bbMin[a];
+		header.bbox_max[a] = bbMax[a];
+	}
+
+	std::vector<float> vertices(3 * mesh.v.size());
+	for (size_t i = 0; i < mesh.v.size(); ++i)
+		for (int a = 0; a < 3; ++a)
+			vertices[3*i + a] = mesh.v[i][a];
+	std::vector<uint32_t> indices(3 * mesh.t.size());
+	for (size_t i = 0; i < mesh.t.size(); ++i)
+		for (int c = 0; c < 3; ++c)
+			indices[3*i + c] = mesh.t[i][c];
+
+	// write to a temporary file and move it in place, so concurrent runs
+	// never map a half written cache
+	std::string path = vmesh_path(source);
+	std::string temp = temp_path(path);
+	FILE *f = fopen(temp.c_str(), "wb");
+	if (!f) return false;
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	if (ok && !vertices.empty()) ok = fwrite(&vertices[0], sizeof(float), vertices.size(), f) == vertices.size();
+	if (ok && !indices.empty()) ok = fwrite(&indices[0], sizeof(uint32_t), indices.size(), f) == indices.size();
+	ok = (fclose(f) == 0) && ok;
+	if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
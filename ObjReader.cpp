@@ -0,0 +1,266 @@
+#include "includes/ObjReader.h"
+#include "includes/MappedFile.h"
+#include "includes/ThreadPool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+
+// files below this size are parsed in a single chunk
+#define MIN_CHUNK_BYTES (256 * 1024)
+#define CHUNKS_PER_THREAD 4
+
+namespace {
+
+// exact powers of ten, every one of them is representable as a double
+const double POW10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+inline const char *skip_space(const char *p, const char *end)
+{
+	while (p < end && is_space(*p)) ++p;
+	return p;
+}
+
+// parses a decimal floating point number, returns NULL if there is none at p
+const char *parse_float(const char *p, const char *end, float &out)
+{
+	p = skip_space(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+	unsigned long long mantissa = 0;
+	int exponent = 0, digits = 0;
+	for (; p < end && is_digit(*p); ++p, ++digits) {
+		// digits past what the mantissa holds only shift the decimal point
+		if (mantissa < 100000000000000000ULL) mantissa = mantissa*10 + (*p - '0');
+		else exponent++;
+	}
+	if (p < end && *p == '.') {
+		for (++p; p < end && is_digit(*p); ++p, ++digits) {
+			if (mantissa < 100000000000000000ULL) {
+				mantissa = mantissa*10 + (*p - '0');
+				exponent--;
+			}
+		}
+	}
+	if (digits == 0) return NULL;
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char *q = p + 1;
+		bool negative_exp = false;
+		if (q < end && (*q == '-' || *q == '+')) negative_exp = *q++ == '-';
+		if (q < end && is_digit(*q)) {
+			int e = 0;
+			for (; q < end && is_digit(*q); ++q)
+				if (e < 10000) e = e*10 + (*q - '0');
+			exponent += negative_exp ? -e : e;
+			p = q;
+		}
+	}
+
+	double value = (double) mantissa;
+	while (exponent > 22) { value *= 1e22; exponent -= 22; }
+	while (exponent < -22) { value /= 1e22; exponent += 22; }
+	value = exponent < 0 ? value / POW10[-exponent] : value * POW10[exponent];
+
+	out = (float) (negative ? -value : value);
+	return p;
+}
+
+// parses a decimal integer, returns NULL if there is none at p
+const char *parse_int(const char *p, const char *end, int &out)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+	if (p >= end || !is_digit(*p)) return NULL;
+
+	int value = 0;
+	for (; p < end && is_digit(*p); ++p)
+		value = value*10 + (*p - '0');
+	out = negative ? -value : value;
+	return p;
+}
+
+// The part of the mesh found in one chunk of the file. Positive indices are absolute
+// and already resolved. Negative ones are relative to the vertices seen so far, which
+// is only known once the earlier chunks are counted, so those corners are recorded.
+struct ObjChunk {
+	std::vector<CompFab::Vec3> v;
+	std::vector<CompFab::Vec2f> tex;
+	std::vector<CompFab::Vec3i> t, texId;
+	// corners (3*triangle + corner) holding indices relative to the chunk start
+	std::vector<size_t> relV, relT;
+	// the chunk contains the #end marker, everything after it is ignored
+	bool ended;
+	// scratch space for the corners of the polygon being parsed
+	std::vector<int> vidx, tidx;
+	std::vector<bool> vrel, trel;
+
+	ObjChunk() : ended(false) {}
+};
+
+// resolves a one based .obj index, count is the number of elements seen so far in
+// this chunk. Returns true if the result is relative to the start of the chunk.
+inline bool resolve(int index, int count, int &out)
+{
+	if (index < 0) {
+		out = count + index;
+		return true;
+	}
+	out = index - 1;
+	return false;
+}
+
+void parse_face(const char *p, const char *end, ObjChunk &chunk)
+{
+	// vertex and texture indices of the polygon, -1 where there is no texture
+	std::vector<int> &vidx = chunk.vidx, &tidx = chunk.tidx;
+	std::vector<bool> &vrel = chunk.vrel, &trel = chunk.trel;
+	vidx.clear(); tidx.clear(); vrel.clear(); trel.clear();
+
+	while (true) {
+		p = skip_space(p, end);
+		int vi, ti = -1, index;
+		bool relative = false;
+		const char *q = parse_int(p, end, vi);
+		if (!q) break;
+		p = q;
+
+		if (p < end && *p == '/') {
+			++p;
+			// v/t, v/t/n or v//n
+			int texture;
+			if ((q = parse_int(p, end, texture))) {
+				relative = resolve(texture, chunk.tex.size(), ti);
+				p = q;
+			}
+			if (p < end && *p == '/') {
+				int normal;
+				++p;
+				if ((q = parse_int(p, end, normal))) p = q;
+			}
+		}
+		tidx.push_back(ti);
+		trel.push_back(relative);
+		vrel.push_back(resolve(vi, chunk.v.size(), index));
+		vidx.push_back(index);
+	}
+	int n = vidx.size();
+
+	// triangulate the polygon as a fan around its first vertex
+	for (int ii = 0; ii + 2 < n; ii++) {
+		CompFab::Vec3i trig, textureId;
+		int corners[3] = {0, ii + 1, ii + 2};
+		for (int jj = 0; jj < 3; jj++) {
+			int c = corners[jj];
+			trig[jj] = vidx[c];
+			textureId[jj] = tidx[c];
+			if (vrel[c]) chunk.relV.push_back(3*chunk.t.size() + jj);
+			if (trel[c]) chunk.relT.push_back(3*chunk.t.size() + jj);
+		}
+		chunk.t.push_back(trig);
+		chunk.texId.push_back(textureId);
+	}
+}
+
+void parse_chunk(const char *p, const char *end, ObjChunk &chunk)
+{
+	while (p < end) {
+		const char *eol = (const char *) memchr(p, '\n', end - p);
+		if (!eol) eol = end;
+		const char *line = p;
+		p = eol + 1;
+
+		size_t length = eol - line;
+		if (length >= 4 && strncmp(line, "#end", 4) == 0 && (length == 4 || line[4] == '\r')) {
+			chunk.ended = true;
+			return;
+		}
+		if (length < 3 || line[0] == '#') continue;
+
+		const char *q = skip_space(line, eol);
+		if (q + 1 < eol && q[0] == 'v' && is_space(q[1])) {
+			CompFab::Vec3 vec;
+			q++;
+			for (int a = 0; a < 3 && q; a++)
+				q = parse_float(q, eol, vec[a]);
+			chunk.v.push_back(vec);
+		} else if (q + 2 < eol && q[0] == 'v' && q[1] == 't' && is_space(q[2])) {
+			CompFab::Vec2f texcoord;
+			q = parse_float(q + 2, eol, texcoord[0]);
+			if (q) parse_float(q, eol, texcoord[1]);
+			chunk.tex.push_back(texcoord);
+		} else if (q + 1 < eol && q[0] == 'f' && is_space(q[1])) {
+			parse_face(q + 1, eol, chunk);
+		}
+	}
+}
+
+}
+
+void parse_obj(const char *data, size_t size, Mesh &mesh)
+{
+	const char *end = data + size;
+	ThreadPool &pool = ThreadPool::global();
+
+	// split on line boundaries
+	size_t chunks = std::max((size_t) 1, std::min((size_t) pool.size() * CHUNKS_PER_THREAD, size / MIN_CHUNK_BYTES));
+	std::vector<const char *> bounds(1, data);
+	for (size_t c = 1; c < chunks; ++c) {
+		const char *p = std::max(bounds.back(), data + size * c / chunks);
+		const char *eol = (const char *) memchr(p, '\n', end - p);
+		if (!eol) break;
+		bounds.push_back(eol + 1);
+	}
+	bounds.push_back(end);
+
+	std::vector<ObjChunk> parsed(bounds.size() - 1);
+	pool.parallel_for(0, parsed.size(), [&](size_t c) {
+		parse_chunk(bounds[c], bounds[c + 1], parsed[c]);
+	});
+
+	// offsets of every chunk in the merged arrays, up to the chunk holding #end
+	size_t used = 0;
+	std::vector<size_t> vBase(parsed.size() + 1, mesh.v.size());
+	std::vector<size_t> texBase(parsed.size() + 1, mesh.tex.size());
+	std::vector<size_t> tBase(parsed.size() + 1, mesh.t.size());
+	while (used < parsed.size()) {
+		vBase[used + 1] = vBase[used] + parsed[used].v.size();
+		texBase[used + 1] = texBase[used] + parsed[used].tex.size();
+		tBase[used + 1] = tBase[used] + parsed[used].t.size();
+		if (parsed[used++].ended) break;
+	}
+
+	mesh.v.resize(vBase[used]);
+	mesh.tex.resize(texBase[used]);
+	mesh.t.resize(tBase[used]);
+	mesh.texId.resize(tBase[used]);
+
+	pool.parallel_for(0, used, [&](size_t c) {
+		ObjChunk &chunk = parsed[c];
+		for (size_t i = 0; i < chunk.relV.size(); ++i)
+			chunk.t[chunk.relV[i] / 3][chunk.relV[i] % 3] += vBase[c];
+		for (size_t i = 0; i < chunk.relT.size(); ++i)
+			chunk.texId[chunk.relT[i] / 3][chunk.relT[i] % 3] += texBase[c];
+
+		std::copy(chunk.v.begin(), chunk.v.end(), mesh.v.begin() + vBase[c]);
+		std::copy(chunk.tex.begin(), chunk.tex.end(), mesh.tex.begin() + texBase[c]);
+		std::copy(chunk.t.begin(), chunk.t.end(), mesh.t.begin() + tBase[c]);
+		std::copy(chunk.texId.begin(), chunk.texId.end(), mesh.texId.begin() + tBase[c]);
+	});
+}
+
+bool read_obj_mapped(const char *filename, Mesh &mesh)
+{
+	MappedFile file;
+	if (!file.open(filename)) return false;
+
+	parse_obj(file.data(), file.size(), mesh);
+	return true;
+}
@@ -0,0 +1,277 @@
+#include "includes/ObjWriter.h"
+#include "includes/bits.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+using CompFab::Word;
+using CompFab::VOXELS_PER_WORD;
+
+// bytes collected before they are handed to the file
+#define OBJ_BUFFER_SIZE (4 << 20)
+
+namespace {
+
+// consumes a bit mask of rows*words words, every row holding one bit per u, and
+// calls emit(u0, u1, v0, v1) for each rectangle [u0, u1) x [v0, v1) of set bits
+// it is split into. Takes the longest run in u first, then grows it over v.
+template <typename Emit>
+void greedy_rectangles(Word *mask, unsigned int rows, unsigned int words, Emit &emit)
+{
+	for (unsigned int v0 = 0; v0 < rows; ++v0) {
+		Word *row = mask + (size_t) v0*words;
+		for (unsigned int w = 0; w < words; ++w) {
+			while (row[w]) {
+				unsigned int u0 = w*VOXELS_PER_WORD + __builtin_ctzll(row[w]);
+
+				// the run ends at the first clear bit, bits past the mask are clear
+				unsigned int u1 = words*VOXELS_PER_WORD;
+				for (unsigned int ww = w; ww < words; ++ww) {
+					Word gaps = ~row[ww] & (ww == w ? ~Word(0) << (u0 % VOXELS_PER_WORD) : ~Word(0));
+					if (gaps) {
+						u1 = ww*VOXELS_PER_WORD + __builtin_ctzll(gaps);
+						break;
+					}
+				}
+
+				unsigned int w_end = (u1 - 1) / VOXELS_PER_WORD + 1;
+				unsigned int v1 = v0 + 1;
+				for (; v1 < rows; ++v1) {
+					const Word *next = mask + (size_t) v1*words;
+					bool covered = true;
+					for (unsigned int ww = w; ww < w_end && covered; ++ww) {
+						Word bits = range_mask(ww, u0, u1);
+						covered = (next[ww] & bits) == bits;
+					}
+					if (!covered) break;
+				}
+
+				for (unsigned int v = v0; v < v1; ++v)
+					for (unsigned int ww = w; ww < w_end; ++ww)
+						mask[(size_t) v*words + ww] &= ~range_mask(ww, u0, u1);
+
+				emit(u0, u1, v0, v1);
+			}
+		}
+	}
+}
+
+// streams vertices and faces to the file, writing every lattice point the
+// first time a face uses it
+class ObjStream {
+public:
+	ObjStream(const CompFab::VoxelGrid &grid, FILE *file)
+		: m_file(file), m_failed(false), m_buffer(OBJ_BUFFER_SIZE), m_buffered(0),
+		m_dimX(grid.m_dimX + 1), m_dimY(grid.m_dimY + 1), m_spacing(grid.m_spacing), m_vertices(0)
+	{
+	}
+
+	// the rectangle [u0, u1) x [v0, v1) of lattice plane `level` along axis. Axis x
+	// spans (y, z), y spans (x, z) and z spans (x, y). Faces towards +axis if positive.
+	void quad(int axis, bool positive, unsigned int level,
+		unsigned int u0, unsigned int u1, unsigned int v0, unsigned int v1)
+	{
+		unsigned int a = corner(axis, level, u0, v0);
+		unsigned int b = corner(axis, level, u1, v0);
+		unsigned int c = corner(axis, level, u1, v1);
+		unsigned int d = corner(axis, level, u0, v1);
+
+		// (u, v) is right handed around +x and +z, but around -y
+		if (positive != (axis != 1)) {
+			std::swap(b, d);
+		}
+		face(a, b, c);
+		face(a, c, d);
+	}
+
+	bool finish()
+	{
+		write("#end\n", 5);
+		flush();
+		return !m_failed;
+	}
+
+private:
+	unsigned int corner(int axis, unsigned int level, unsigned int u, unsigned int v)
+	{
+		if (axis == 0) return vertex(level, u, v);
+		if (axis == 1) return vertex(u, level, v);
+		return vertex(u, v, level);
+	}
+
+	// obj index of a lattice point, the corner between voxels i-1 and i on each axis
+	unsigned int vertex(unsigned int i, unsigned int j, unsigned int k)
+	{
+		uint64_t key = ((uint64_t) k*m_dimY + j)*m_dimX + i;
+		std::pair<std::unordered_map<uint64_t, unsigned int>::iterator, bool> added =
+			m_indices.insert(std::make_pair(key, m_vertices + 1));
+		if (!added.second) return added.first->second;
+
+		// same placement as the per voxel cubes this exporter replaced
+		char line[96];
+		int length = snprintf(line, sizeof(line), "v %g %g %g\n",
+			position(i), position(j), position(k));
+		write(line, length);
+		return ++m_vertices;
+	}
+
+	float position(unsigned int c) const
+	{
+		return 0.5f + ((double) c - 0.5)*m_spacing;
+	}
+
+	void face(unsigned int a, unsigned int b, unsigned int c)
+	{
+		char line[48];
+		char *p = line;
+		*p++ = 'f';
+		p = append(p, a);
+		p = append(p, b);
+		p = append(p, c);
+		*p++ = '\n';
+		write(line, p - line);
+	}
+
+	static char *append(char *p, unsigned int value)
+	{
+		char digits[10];
+		int n = 0;
+		do {
+			digits[n++] = '0' + value % 10;
+			value /= 10;
+		} while (value);
+		*p++ = ' ';
+		while (n) *p++ = digits[--n];
+		return p;
+	}
+
+	void write(const char *data, size_t bytes)
+	{
+		if (m_buffered + bytes > m_buffer.size()) flush();
+		memcpy(&m_buffer[m_buffered], data, bytes);
+		m_buffered += bytes;
+	}
+
+	void flush()
+	{
+		if (m_buffered > 0 && fwrite(&m_buffer[0], 1, m_buffered, m_file) != m_buffered)
+			m_failed = true;
+		m_buffered = 0;
+	}
+
+	FILE *m_file;
+	bool m_failed;
+	std::vector<char> m_buffer;
+	size_t m_buffered;
+	// lattice points per row and per layer
+	uint64_t m_dimX, m_dimY;
+	double m_spacing;
+	unsigned int m_vertices;
+	std::unordered_map<uint64_t, unsigned int> m_indices;
+};
+
+struct EmitQuad {
+	ObjStream *stream;
+	int axis;
+	bool positive;
+	unsigned int level;
+
+	void operator()(unsigned int u0, unsigned int u1, unsigned int v0, unsigned int v1)
+	{
+		stream->quad(axis, positive, level, u0, u1, v0, v1);
+	}
+};
+
+// faces of layer k towards layer k+step, rows over y
+void z_faces(const CompFab::VoxelGrid &grid, int step, std::vector<Word> &mask, ObjStream &stream)
+{
+	unsigned int words = grid.m_wordsPerRow;
+	mask.resize((size_t) grid.m_dimY*words);
+	for (unsigned int k = 0; k < grid.m_dimZ; ++k) {
+		bool border = (step > 0) ? k + 1 == grid.m_dimZ : k == 0;
+		for (unsigned int j = 0; j < grid.m_dimY; ++j)
+			for (unsigned int w = 0; w < words; ++w)
+				mask[(size_t) j*words + w] = grid.word(w, j, k) & ~(border ? 0 : grid.word(w, j, k + step));
+
+		EmitQuad emit = {&stream, 2, step > 0, step > 0 ? k + 1 : k};
+		greedy_rectangles(&mask[0], grid.m_dimY, words, emit);
+	}
+}
+
+// faces of layer j towards layer j+step, rows over z
+void y_faces(const CompFab::VoxelGrid &grid, int step, std::vector<Word> &mask, ObjStream &stream)
+{
+	unsigned int words = grid.m_wordsPerRow;
+	mask.resize((size_t) grid.m_dimZ*words);
+	for (unsigned int j = 0; j < grid.m_dimY; ++j) {
+		bool border = (step > 0) ? j + 1 == grid.m_dimY : j == 0;
+		for (unsigned int k = 0; k < grid.m_dimZ; ++k)
+			for (unsigned int w = 0; w < words; ++w)
+				mask[(size_t) k*words + w] = grid.word(w, j, k) & ~(border ? 0 : grid.word(w, j + step, k));
+
+		EmitQuad emit = {&stream, 1, step > 0, step > 0 ? j + 1 : j};
+		greedy_rectangles(&mask[0], grid.m_dimZ, words, emit);
+	}
+}
+
+// faces towards x+step. The faces of one word column are found along the rows,
+// then transposed into one (y, z) mask per x, rows over z.
+void x_faces(const CompFab::VoxelGrid &grid, int step, std::vector<Word> &mask, ObjStream &stream)
+{
+	unsigned int words = grid.m_wordsPerRow;
+	unsigned int wordsY = (grid.m_dimY + VOXELS_PER_WORD - 1) / VOXELS_PER_WORD;
+	size_t planeWords = (size_t) grid.m_dimZ*wordsY;
+	mask.resize(planeWords*VOXELS_PER_WORD);
+
+	for (unsigned int w = 0; w < words; ++w) {
+		for (unsigned int k = 0; k < grid.m_dimZ; ++k) {
+			const Word *row = grid.row(0, k);
+			for (unsigned int jb = 0; jb < wordsY; ++jb) {
+				Word block[VOXELS_PER_WORD];
+				for (unsigned int b = 0; b < VOXELS_PER_WORD; ++b) {
+					unsigned int j = jb*VOXELS_PER_WORD + b;
+					if (j >= grid.m_dimY) {
+						block[b] = 0;
+						continue;
+					}
+					const Word *r = row + (size_t) j*words;
+					Word neighbours = (step > 0)
+						? (r[w] >> 1) | (w + 1 < words ? r[w + 1] << (VOXELS_PER_WORD - 1) : 0)
+						: (r[w] << 1) | (w > 0 ? r[w - 1] >> (VOXELS_PER_WORD - 1) : 0);
+					block[b] = r[w] & ~neighbours;
+				}
+				transpose64(block);
+				for (unsigned int b = 0; b < VOXELS_PER_WORD; ++b)
+					mask[b*planeWords + (size_t) k*wordsY + jb] = block[b];
+			}
+		}
+
+		unsigned int x_end = std::min(grid.m_dimX, (w + 1)*VOXELS_PER_WORD);
+		for (unsigned int i = w*VOXELS_PER_WORD; i < x_end; ++i) {
+			EmitQuad emit = {&stream, 0, step > 0, step > 0 ? i + 1 : i};
+			greedy_rectangles(&mask[(i % VOXELS_PER_WORD)*planeWords], grid.m_dimZ, wordsY, emit);
+		}
+	}
+}
+
+}
+
+bool save_voxels_obj(const CompFab::VoxelGrid &grid, const char *filename)
+{
+	FILE *file = fopen(filename, "w");
+	if (!file) return false;
+
+	ObjStream stream(grid, file);
+	std::vector<Word> mask;
+	for (int step = -1; step <= 1; step += 2) {
+		x_faces(grid, step, mask, stream);
+		y_faces(grid, step, mask, stream);
+		z_faces(grid, step, mask, stream);
+	}
+
+	bool ok = stream.finish();
+	return fclose(file) == 0 && ok;
+}
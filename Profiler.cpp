@@ -0,0 +1,140 @@
+#include "includes/Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <ostream>
+
+Profiler::Profiler() : m_start(std::chrono::steady_clock::now()), m_tracing(false), m_droppedEvents(0) {}
+
+Profiler &Profiler::global()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+Profiler::ThreadRecord &Profiler::thread_record()
+{
+	// the record belongs to the profiler, it outlives the thread
+	static thread_local ThreadRecord *record = NULL;
+	if (!record) record = global().add_thread();
+	return *record;
+}
+
+Profiler::ThreadRecord *Profiler::add_thread()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	ThreadRecord *record = new ThreadRecord();
+	record->tid = m_threads.size();
+	for (int c = 0; c < PROFILE_COUNTERS; ++c) record->counters[c] = 0;
+	m_threads.push_back(std::unique_ptr<ThreadRecord>(record));
+	return record;
+}
+
+void Profiler::record(const char *phase, double start_us, double end_us)
+{
+	int tid = thread_record().tid;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<std::string, size_t>::iterator found = m_phaseIndex.find(phase);
+	if (found == m_phaseIndex.end()) {
+		Phase added = {phase, 0, 0, 0};
+		found = m_phaseIndex.insert(std::make_pair(std::string(phase), m_phases.size())).first;
+		m_phases.push_back(added);
+	}
+	Phase &sum = m_phases[found->second];
+	sum.calls += 1;
+	sum.total_us += end_us - start_us;
+	sum.max_us = std::max(sum.max_us, end_us - start_us);
+
+	if (!m_tracing) return;
+	if (m_events.size() >= PROFILE_MAX_EVENTS) {
+		++m_droppedEvents;
+		return;
+	}
+	Event event = {phase, tid, start_us, end_us - start_us};
+	m_events.push_back(event);
+}
+
+uint64_t Profiler::counter(ProfileCounter counter) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	uint64_t sum = 0;
+	for (size_t t = 0; t < m_threads.size(); ++t) sum += m_threads[t]->counters[counter].load(std::memory_order_relaxed);
+	return sum;
+}
+
+const char *Profiler::counterName(ProfileCounter counter)
+{
+	static const char *names[PROFILE_COUNTERS] = { "rays cast", "triangle tests", "hits", "voxels filled" };
+	return names[counter];
+}
+
+std::vector<Profiler::Phase> Profiler::phases() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_phases;
+}
+
+void Profiler::printTable(std::ostream &out, double wall_us) const
+{
+	std::vector<Phase> sums = phases();
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+
+	out << std::left << std::setw(22) << "phase" << std::right << std::setw(8) << "calls" << std::setw(12) << "total ms"
+		<< std::setw(12) << "mean ms" << std::setw(12) << "max ms" << std::setw(8) << "wall" << std::endl;
+	out << std::fixed << std::setprecision(2);
+	for (size_t p = 0; p < sums.size(); ++p)
+		out << std::left << std::setw(22) << sums[p].name << std::right << std::setw(8) << sums[p].calls
+			<< std::setw(12) << sums[p].total_us / 1000 << std::setw(12) << sums[p].total_us / 1000 / sums[p].calls
+			<< std::setw(12) << sums[p].max_us / 1000 << std::setw(7) << std::setprecision(0) << 100 * sums[p].total_us / wall_us << "%"
+			<< std::setprecision(2) << std::endl;
+	out << std::left << std::setw(22) << "wall" << std::right << std::setw(20) << wall_us / 1000 << std::endl;
+
+	for (int c = 0; c < PROFILE_COUNTERS; ++c) {
+		out << std::left << std::setw(22) << counterName((ProfileCounter) c) << std::right << std::setw(20);
+		if (VOXELIZER_COUNTERS || c == COUNT_VOXELS_FILLED) out << counter((ProfileCounter) c) << std::endl;
+		else out << "-" << "  (cmake -DVOXELIZER_COUNTERS=ON)" << std::endl;
+	}
+	out.flags(flags);
+	out.precision(precision);
+}
+
+bool Profiler::writeTrace(const char *filename) const
+{
+	FILE *f = fopen(filename, "w");
+	if (!f) return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	fprintf(f, "{\"traceEvents\":[\n");
+	for (size_t e = 0; e < m_events.size(); ++e)
+		fprintf(f, "{\"name\":\"%s\",\"cat\":\"voxelizer\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d},\n",
+			m_events[e].phase, m_events[e].start_us, m_events[e].duration_us, m_events[e].tid);
+	for (size_t t = 0; t < m_threads.size(); ++t)
+		fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}},\n",
+			m_threads[t]->tid, m_threads[t]->tid);
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"voxelizer\"}}\n],\n");
+
+	fprintf(f, "\"displayTimeUnit\":\"ms\",\n\"otherData\":{\n\"wall_ms\":%.3f,\n\"dropped_events\":%zu,\n\"phases\":{", now() / 1000, m_droppedEvents);
+	for (size_t p = 0; p < m_phases.size(); ++p)
+		fprintf(f, "%s\n\"%s\":{\"calls\":%zu,\"total_ms\":%.3f,\"max_ms\":%.3f}", p ? "," : "",
+			m_phases[p].name.c_str(), m_phases[p].calls, m_phases[p].total_us / 1000, m_phases[p].max_us / 1000);
+	fprintf(f, "},\n\"counters_enabled\":%s,\n\"counters\":{", VOXELIZER_COUNTERS ? "true" : "false");
+	for (int c = 0; c < PROFILE_COUNTERS; ++c) {
+		uint64_t sum = 0;
+		for (size_t t = 0; t < m_threads.size(); ++t) sum += m_threads[t]->counters[c].load(std::memory_order_relaxed);
+		fprintf(f, "%s\"%s\":%llu", c ? "," : "", counterName((ProfileCounter) c), (unsigned long long) sum);
+	}
+	fprintf(f, "}\n}\n}\n");
+	return fclose(f) == 0;
+}
+
+double profile_now()
+{
+	return Profiler::global().now();
+}
+
+void profile_record(const char *phase, double start_us, double end_us)
+{
+	Profiler::global().record(phase, start_us, end_us);
+}
@@ -0,0 +1,43 @@
+#include "includes/RawWriter.h"
+
+#include <sstream>
+#include <string>
+
+RawWriter::~RawWriter()
+{
+	if (m_file) fclose(m_file);
+}
+
+bool RawWriter::open(const char *filename)
+{
+	if (m_file) fclose(m_file);
+	m_file = fopen(filename, "wb");
+	m_failed = false;
+	return m_file != NULL;
+}
+
+void RawWriter::write_header(unsigned int dimX, unsigned int dimY, unsigned int dimZ,
+	const CompFab::Vec3 &translate, CompFab::precision_type scale)
+{
+	std::ostringstream header;
+	header << "#raw 1" << std::endl;
+	header << "dim " << dimX << " " << dimY << " " << dimZ << std::endl;
+	header << "translate " << translate.m_x << " " << translate.m_y << " " << translate.m_z << std::endl;
+	header << "scale " << scale << std::endl;
+	header << "data" << std::endl;
+	std::string text = header.str();
+	if (!m_file || fwrite(text.data(), 1, text.size(), m_file) != text.size()) m_failed = true;
+}
+
+void RawWriter::write(const CompFab::Word *words, size_t count)
+{
+	if (!m_file || fwrite(words, sizeof(CompFab::Word), count, m_file) != count) m_failed = true;
+}
+
+bool RawWriter::close()
+{
+	if (!m_file) return false;
+	if (fclose(m_file) != 0) m_failed = true;
+	m_file = NULL;
+	return !m_failed;
+}
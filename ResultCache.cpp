@@ -0,0 +1,230 @@
+#include "includes/ResultCache.h"
+#include "includes/Profiler.h"
+#include "includes/RawWriter.h"
+#include "includes/hash.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+struct CacheEntry {
+	std::string name;
+	int64_t used;
+	size_t bytes;
+
+	// least recently used first
+	bool operator<(const CacheEntry &other) const { return used < other.used || (used == other.used && name < other.name); }
+};
+
+}
+
+// entries are named by the 16 hex digits of their key
+static bool is_entry(const std::string &name)
+{
+	return name.size() == 20 && name.compare(16, 4, ".raw") == 0 && name.find_first_not_of("0123456789abcdef") == 16;
+}
+
+static void list_entries(const std::string &directory, std::vector<CacheEntry> &entries)
+{
+	DIR *dir = opendir(directory.c_str());
+	if (!dir) return;
+	while (dirent *file = readdir(dir)) {
+		CacheEntry entry;
+		entry.name = file->d_name;
+		struct stat st;
+		if (!is_entry(entry.name) || stat((directory + "/" + entry.name).c_str(), &st) != 0) continue;
+#ifdef __linux__
+		entry.used = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+		entry.used = st.st_mtime;
+#endif
+		entry.bytes = st.st_size;
+		entries.push_back(entry);
+	}
+	closedir(dir);
+}
+
+// a temporary name no other process or thread writes to
+static std::string temp_path(const std::string &path)
+{
+	static std::atomic<unsigned int> count(0);
+	std::ostringstream temp;
+	temp << path << "." << getpid() << "." << count++ << ".tmp";
+	return temp.str();
+}
+
+static void read_stats(const std::string &file, size_t &hits, size_t &misses, size_t &evictions)
+{
+	hits = misses = evictions = 0;
+	FILE *f = fopen(file.c_str(), "r");
+	if (!f) return;
+	unsigned long long h, m, e;
+	if (fscanf(f, "hits %llu misses %llu evictions %llu", &h, &m, &e) == 3) {
+		hits = h;
+		misses = m;
+		evictions = e;
+	}
+	fclose(f);
+}
+
+ResultCache::ResultCache(const std::string &directory, size_t max_bytes)
+	: m_directory(directory), m_maxBytes(max_bytes), m_hits(0), m_misses(0), m_evictions(0)
+{
+	// and its parents, one at a time
+	for (size_t slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1)) {
+		mkdir(directory.substr(0, slash).c_str(), 0777);
+		if (slash == std::string::npos) break;
+	}
+}
+
+ResultCache::~ResultCache()
+{
+	if (m_hits + m_misses + m_evictions == 0) return;
+	size_t hits, misses, evictions;
+	totals(hits, misses, evictions);
+
+	// runs finishing at the same time may lose each other's counts, never the entries
+	std::string file = m_directory + "/stats", temp = temp_path(file);
+	FILE *f = fopen(temp.c_str(), "w");
+	if (!f) return;
+	bool ok = fprintf(f, "hits %llu misses %llu evictions %llu\n", (unsigned long long) hits, (unsigned long long) misses, (unsigned long long) evictions) > 0;
+	ok = (fclose(f) == 0) && ok;
+	if (!ok || rename(temp.c_str(), file.c_str()) != 0) remove(temp.c_str());
+}
+
+uint64_t ResultCache::key(const Voxelizer &voxelizer, const VoxelizeOptions &options, unsigned int dim)
+{
+	const Voxelizer::TriangleList &triangles = voxelizer.triangles();
+	uint64_t hash = content_hash(triangles.empty() ? NULL : &triangles[0], triangles.size()*sizeof(CompFab::Triangle));
+
+	// only the options the mode reads, the others must not make a miss
+	bool sampled = options.mode == ray && options.samples > 0;
+	bool shell = options.mode == surface || options.mode == flood;
+	int64_t fields[] = {
+		RESULT_CACHE_VERSION, (int64_t) sizeof(CompFab::precision_type), dim,
+		options.backend, options.mode, options.double_thick,
+		options.mode == ray && options.bricks,
+		shell ? options.separating : 0,
+		options.mode == flood ? options.close : 0,
+		sampled ? options.samples : 0,
+		sampled ? (int64_t) options.seed : 0,
+	};
+	hash = content_hash(fields, sizeof(fields), hash);
+
+	// the box comes from every vertex, also the ones no triangle uses, so the same
+	// triangles may sit in another grid
+	CompFab::Vec3 lowerLeft;
+	double spacing;
+	voxelizer.placeGrid(dim, lowerLeft, spacing);
+	double placement[] = { lowerLeft.m_x, lowerLeft.m_y, lowerLeft.m_z, spacing };
+	return content_hash(placement, sizeof(placement), hash);
+}
+
+// the header keeps 6 digits
+static bool same_placement(double stored, double placed, double spacing)
+{
+	return fabs(stored - placed) <= 1e-5 * std::max(fabs(placed), spacing);
+}
+
+std::string ResultCache::path(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.raw", (unsigned long long) key);
+	return m_directory + "/" + name;
+}
+
+bool ResultCache::load(uint64_t key, CompFab::VoxelGrid &grid)
+{
+	ScopedTimer timer("read result cache");
+	std::string file = path(key);
+	bool hit = false;
+	FILE *f = grid.m_firstZ == 0 ? fopen(file.c_str(), "rb") : NULL;
+	if (f) {
+		char line[256];
+		unsigned int x = 0, y = 0, z = 0;
+		double translate[3] = {NAN, NAN, NAN}, scale = NAN;
+		bool data = false;
+		while (!data && fgets(line, sizeof(line), f)) {
+			sscanf(line, "dim %u %u %u", &x, &y, &z);
+			sscanf(line, "translate %lf %lf %lf", &translate[0], &translate[1], &translate[2]);
+			sscanf(line, "scale %lf", &scale);
+			data = strcmp(line, "data\n") == 0;
+		}
+		double spacing = grid.m_spacing;
+		hit = data && x == grid.m_dimX && y == grid.m_dimY && z == grid.m_dimZ
+			&& same_placement(translate[0], grid.m_lowerLeft.m_x, spacing) && same_placement(translate[1], grid.m_lowerLeft.m_y, spacing)
+			&& same_placement(translate[2], grid.m_lowerLeft.m_z, spacing) && same_placement(scale, spacing, spacing)
+			&& fread(grid.m_insideArray, sizeof(CompFab::Word), grid.m_numWords, f) == grid.m_numWords;
+		fclose(f);
+	}
+	if (!hit) {
+		++m_misses;
+		return false;
+	}
+
+	// marks the entry as just used for the eviction
+	utime(file.c_str(), NULL);
+	++m_hits;
+	return true;
+}
+
+bool ResultCache::store(uint64_t key, const CompFab::VoxelGrid &grid)
+{
+	ScopedTimer timer("write result cache");
+	std::string file = path(key), temp = temp_path(file);
+	RawWriter out;
+	if (out.open(temp.c_str())) {
+		out.write_header(grid.m_dimX, grid.m_dimY, grid.m_dimZ, grid.m_lowerLeft, grid.m_spacing);
+		out.write(grid.m_insideArray, grid.m_numWords);
+	}
+	if (!out.close() || rename(temp.c_str(), file.c_str()) != 0) {
+		remove(temp.c_str());
+		return false;
+	}
+	evict();
+	return true;
+}
+
+void ResultCache::evict()
+{
+	std::vector<CacheEntry> entries;
+	list_entries(m_directory, entries);
+	size_t bytes = 0;
+	for (size_t i = 0; i < entries.size(); ++i) bytes += entries[i].bytes;
+
+	std::sort(entries.begin(), entries.end());
+	for (size_t i = 0; i < entries.size() && bytes > m_maxBytes; ++i)
+		if (remove((m_directory + "/" + entries[i].name).c_str()) == 0) {
+			bytes -= entries[i].bytes;
+			++m_evictions;
+		}
+}
+
+void ResultCache::usage(size_t &entries, size_t &bytes) const
+{
+	std::vector<CacheEntry> list;
+	list_entries(m_directory, list);
+	entries = list.size();
+	bytes = 0;
+	for (size_t i = 0; i < list.size(); ++i) bytes += list[i].bytes;
+}
+
+void ResultCache::totals(size_t &hits, size_t &misses, size_t &evictions) const
+{
+	read_stats(m_directory + "/stats", hits, misses, evictions);
+	hits += m_hits;
+	misses += m_misses;
+	evictions += m_evictions;
+}
@@ -0,0 +1,283 @@
+#include "includes/SimdIntersect.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+// This file is built without reassociation, reciprocal math and contraction (see
+// CMakeLists.txt), which keeps the scalar and vector kernels bit-identical.
+
+namespace {
+
+// EPSILONF is a double. Comparing floats against it equals comparing against
+// the nearest floats on the right side of it, which the vector kernels can use
+float largest_below_epsilon()
+{
+	float f = (float) EPSILONF;
+	return (double) f >= EPSILONF ? nextafterf(f, 0.f) : f;
+}
+
+float smallest_above_epsilon()
+{
+	float f = (float) EPSILONF;
+	return (double) f <= EPSILONF ? nextafterf(f, 1.f) : f;
+}
+
+// det is rejected within [-DET_EPSILON, DET_EPSILON], hits need t >= T_EPSILON
+const float DET_EPSILON = largest_below_epsilon();
+const float T_EPSILON = smallest_above_epsilon();
+
+// intersects() of raycast.h on the precomputed edges
+unsigned int count_scalar(const TriangleSoA &soa, size_t begin, size_t end, vec3f dir, vec3f pos)
+{
+	unsigned int hits = 0;
+	for (size_t i = begin; i < end; ++i) {
+		float e1x = soa.m_e1[0][i], e1y = soa.m_e1[1][i], e1z = soa.m_e1[2][i];
+		float e2x = soa.m_e2[0][i], e2y = soa.m_e2[1][i], e2z = soa.m_e2[2][i];
+
+		float px = dir.y*e2z - dir.z*e2y;
+		float py = dir.z*e2x - dir.x*e2z;
+		float pz = dir.x*e2y - dir.y*e2x;
+		float det = e1x*px + e1y*py + e1z*pz;
+		if (det >= -DET_EPSILON && det <= DET_EPSILON) continue;
+		float inv_det = 1.f / det;
+
+		float tx = pos.x - soa.m_v1[0][i], ty = pos.y - soa.m_v1[1][i], tz = pos.z - soa.m_v1[2][i];
+		float u = (tx*px + ty*py + tz*pz) * inv_det;
+		if (u < 0.f || u > 1.f) continue;
+
+		float qx = ty*e1z - tz*e1y;
+		float qy = tz*e1x - tx*e1z;
+		float qz = tx*e1y - ty*e1x;
+		float v = (dir.x*qx + dir.y*qy + dir.z*qz) * inv_det;
+		if (v < 0.f || u + v > 1.f) continue;
+
+		float t = (e2x*qx + e2y*qy + e2z*qz) * inv_det;
+		if (t >= T_EPSILON) hits += 1;
+	}
+	return hits;
+}
+
+#if SIMD_X86
+
+// The vector kernels keep a lane wherever the scalar kernel does not reject, so
+// the rejections are negated with unordered predicates (true for NaN)
+
+__attribute__((target("sse4.1")))
+unsigned int count_sse4(const TriangleSoA &soa, size_t begin, size_t end, vec3f dir, vec3f pos)
+{
+	const __m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+	const __m128 ox = _mm_set1_ps(pos.x), oy = _mm_set1_ps(pos.y), oz = _mm_set1_ps(pos.z);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+	const __m128 det_hi = _mm_set1_ps(DET_EPSILON), det_lo = _mm_set1_ps(-DET_EPSILON);
+	const __m128 t_lo = _mm_set1_ps(T_EPSILON);
+
+	unsigned int hits = 0;
+	for (size_t i = begin; i < end; i += 4) {
+		__m128 e1x = _mm_loadu_ps(&soa.m_e1[0][i]), e1y = _mm_loadu_ps(&soa.m_e1[1][i]), e1z = _mm_loadu_ps(&soa.m_e1[2][i]);
+		__m128 e2x = _mm_loadu_ps(&soa.m_e2[0][i]), e2y = _mm_loadu_ps(&soa.m_e2[1][i]), e2z = _mm_loadu_ps(&soa.m_e2[2][i]);
+
+		__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+		__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+		__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+		__m128 keep = _mm_or_ps(_mm_cmpnge_ps(det, det_lo), _mm_cmpnle_ps(det, det_hi));
+		__m128 inv_det = _mm_div_ps(one, det);
+
+		__m128 tx = _mm_sub_ps(ox, _mm_loadu_ps(&soa.m_v1[0][i]));
+		__m128 ty = _mm_sub_ps(oy, _mm_loadu_ps(&soa.m_v1[1][i]));
+		__m128 tz = _mm_sub_ps(oz, _mm_loadu_ps(&soa.m_v1[2][i]));
+		__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+		keep = _mm_and_ps(keep, _mm_and_ps(_mm_cmpnlt_ps(u, zero), _mm_cmpngt_ps(u, one)));
+
+		__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+		__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+		__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+		__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+		keep = _mm_and_ps(keep, _mm_and_ps(_mm_cmpnlt_ps(v, zero), _mm_cmpngt_ps(_mm_add_ps(u, v), one)));
+
+		__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+		keep = _mm_and_ps(keep, _mm_cmpge_ps(t, t_lo));
+
+		unsigned int lanes = end - i < 4 ? (1u << (end - i)) - 1 : 0xf;
+		hits += __builtin_popcount(_mm_movemask_ps(keep) & lanes);
+	}
+	return hits;
+}
+
+__attribute__((target("avx2,popcnt")))
+unsigned int count_avx2(const TriangleSoA &soa, size_t begin, size_t end, vec3f dir, vec3f pos)
+{
+	const __m256 dx = _mm256_set1_ps(dir.x), dy = _mm256_set1_ps(dir.y), dz = _mm256_set1_ps(dir.z);
+	const __m256 ox = _mm256_set1_ps(pos.x), oy = _mm256_set1_ps(pos.y), oz = _mm256_set1_ps(pos.z);
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f);
+	const __m256 det_hi = _mm256_set1_ps(DET_EPSILON), det_lo = _mm256_set1_ps(-DET_EPSILON);
+	const __m256 t_lo = _mm256_set1_ps(T_EPSILON);
+
+	unsigned int hits = 0;
+	for (size_t i = begin; i < end; i += 8) {
+		__m256 e1x = _mm256_loadu_ps(&soa.m_e1[0][i]), e1y = _mm256_loadu_ps(&soa.m_e1[1][i]), e1z = _mm256_loadu_ps(&soa.m_e1[2][i]);
+		__m256 e2x = _mm256_loadu_ps(&soa.m_e2[0][i]), e2y = _mm256_loadu_ps(&soa.m_e2[1][i]), e2z = _mm256_loadu_ps(&soa.m_e2[2][i]);
+
+		__m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+		__m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+		__m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+		__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+		__m256 keep = _mm256_or_ps(_mm256_cmp_ps(det, det_lo, _CMP_NGE_UQ), _mm256_cmp_ps(det, det_hi, _CMP_NLE_UQ));
+		__m256 inv_det = _mm256_div_ps(one, det);
+
+		__m256 tx = _mm256_sub_ps(ox, _mm256_loadu_ps(&soa.m_v1[0][i]));
+		__m256 ty = _mm256_sub_ps(oy, _mm256_loadu_ps(&soa.m_v1[1][i]));
+		__m256 tz = _mm256_sub_ps(oz, _mm256_loadu_ps(&soa.m_v1[2][i]));
+		__m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), inv_det);
+		keep = _mm256_and_ps(keep, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_NLT_UQ), _mm256_cmp_ps(u, one, _CMP_NGT_UQ)));
+
+		__m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+		__m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+		__m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+		__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inv_det);
+		keep = _mm256_and_ps(keep, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_NLT_UQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_NGT_UQ)));
+
+		__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv_det);
+		keep = _mm256_and_ps(keep, _mm256_cmp_ps(t, t_lo, _CMP_GE_OQ));
+
+		unsigned int lanes = end - i < 8 ? (1u << (end - i)) - 1 : 0xff;
+		hits += __builtin_popcount(_mm256_movemask_ps(keep) & lanes);
+	}
+	return hits;
+}
+
+__attribute__((target("avx512f,popcnt")))
+unsigned int count_avx512(const TriangleSoA &soa, size_t begin, size_t end, vec3f dir, vec3f pos)
+{
+	const __m512 dx = _mm512_set1_ps(dir.x), dy = _mm512_set1_ps(dir.y), dz = _mm512_set1_ps(dir.z);
+	const __m512 ox = _mm512_set1_ps(pos.x), oy = _mm512_set1_ps(pos.y), oz = _mm512_set1_ps(pos.z);
+	const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.f);
+	const __m512 det_hi = _mm512_set1_ps(DET_EPSILON), det_lo = _mm512_set1_ps(-DET_EPSILON);
+	const __m512 t_lo = _mm512_set1_ps(T_EPSILON);
+
+	unsigned int hits = 0;
+	for (size_t i = begin; i < end; i += 16) {
+		__mmask16 keep = end - i < 16 ? (__mmask16) ((1u << (end - i)) - 1) : (__mmask16) 0xffff;
+
+		__m512 e1x = _mm512_loadu_ps(&soa.m_e1[0][i]), e1y = _mm512_loadu_ps(&soa.m_e1[1][i]), e1z = _mm512_loadu_ps(&soa.m_e1[2][i]);
+		__m512 e2x = _mm512_loadu_ps(&soa.m_e2[0][i]), e2y = _mm512_loadu_ps(&soa.m_e2[1][i]), e2z = _mm512_loadu_ps(&soa.m_e2[2][i]);
+
+		__m512 px = _mm512_sub_ps(_mm512_mul_ps(dy, e2z), _mm512_mul_ps(dz, e2y));
+		__m512 py = _mm512_sub_ps(_mm512_mul_ps(dz, e2x), _mm512_mul_ps(dx, e2z));
+		__m512 pz = _mm512_sub_ps(_mm512_mul_ps(dx, e2y), _mm512_mul_ps(dy, e2x));
+		__m512 det = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(e1x, px), _mm512_mul_ps(e1y, py)), _mm512_mul_ps(e1z, pz));
+		keep &= _mm512_cmp_ps_mask(det, det_lo, _CMP_NGE_UQ) | _mm512_cmp_ps_mask(det, det_hi, _CMP_NLE_UQ);
+		__m512 inv_det = _mm512_div_ps(one, det);
+
+		__m512 tx = _mm512_sub_ps(ox, _mm512_loadu_ps(&soa.m_v1[0][i]));
+		__m512 ty = _mm512_sub_ps(oy, _mm512_loadu_ps(&soa.m_v1[1][i]));
+		__m512 tz = _mm512_sub_ps(oz, _mm512_loadu_ps(&soa.m_v1[2][i]));
+		__m512 u = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(tx, px), _mm512_mul_ps(ty, py)), _mm512_mul_ps(tz, pz)), inv_det);
+		keep &= _mm512_cmp_ps_mask(u, zero, _CMP_NLT_UQ) & _mm512_cmp_ps_mask(u, one, _CMP_NGT_UQ);
+
+		__m512 qx = _mm512_sub_ps(_mm512_mul_ps(ty, e1z), _mm512_mul_ps(tz, e1y));
+		__m512 qy = _mm512_sub_ps(_mm512_mul_ps(tz, e1x), _mm512_mul_ps(tx, e1z));
+		__m512 qz = _mm512_sub_ps(_mm512_mul_ps(tx, e1y), _mm512_mul_ps(ty, e1x));
+		__m512 v = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, qx), _mm512_mul_ps(dy, qy)), _mm512_mul_ps(dz, qz)), inv_det);
+		keep &= _mm512_cmp_ps_mask(v, zero, _CMP_NLT_UQ) & _mm512_cmp_ps_mask(_mm512_add_ps(u, v), one, _CMP_NGT_UQ);
+
+		__m512 t = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(e2x, qx), _mm512_mul_ps(e2y, qy)), _mm512_mul_ps(e2z, qz)), inv_det);
+		keep &= _mm512_cmp_ps_mask(t, t_lo, _CMP_GE_OQ);
+
+		hits += __builtin_popcount(keep);
+	}
+	return hits;
+}
+
+#endif
+
+}
+
+void TriangleSoA::build(const std::vector<CompFab::Triangle> &triangles)
+{
+	m_count = triangles.size();
+	// zero padding lets the kernels load whole vectors past the last triangle
+	for (int a = 0; a < 3; ++a) {
+		m_v1[a].assign(m_count + SIMD_MAX_LANES, 0.f);
+		m_e1[a].assign(m_count + SIMD_MAX_LANES, 0.f);
+		m_e2[a].assign(m_count + SIMD_MAX_LANES, 0.f);
+	}
+	for (size_t i = 0; i < m_count; ++i) {
+		const CompFab::Triangle &t = triangles[i];
+		// edges in float like intersects(), whatever precision_type is
+		for (int a = 0; a < 3; ++a) {
+			float v1 = t.m_v1[a], v2 = t.m_v2[a], v3 = t.m_v3[a];
+			m_v1[a][i] = v1;
+			m_e1[a][i] = v2 - v1;
+			m_e2[a][i] = v3 - v1;
+		}
+	}
+}
+
+void TriangleSoA::build(const TriangleSoA &from, const unsigned int *indices, size_t count)
+{
+	m_count = count;
+	for (int a = 0; a < 3; ++a) {
+		m_v1[a].resize(m_count + SIMD_MAX_LANES);
+		m_e1[a].resize(m_count + SIMD_MAX_LANES);
+		m_e2[a].resize(m_count + SIMD_MAX_LANES);
+		for (size_t i = 0; i < count; ++i) {
+			m_v1[a][i] = from.m_v1[a][indices[i]];
+			m_e1[a][i] = from.m_e1[a][indices[i]];
+			m_e2[a][i] = from.m_e2[a][indices[i]];
+		}
+		std::fill(m_v1[a].begin() + count, m_v1[a].end(), 0.f);
+		std::fill(m_e1[a].begin() + count, m_e1[a].end(), 0.f);
+		std::fill(m_e2[a].begin() + count, m_e2[a].end(), 0.f);
+	}
+}
+
+SimdLevel simd_level()
+{
+	SimdLevel level = SIMD_SCALAR;
+#if SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) level = SIMD_AVX512;
+	else if (__builtin_cpu_supports("avx2")) level = SIMD_AVX2;
+	else if (__builtin_cpu_supports("sse4.1")) level = SIMD_SSE4;
+#endif
+
+	const char *forced = getenv("VOXELIZER_SIMD");
+	if (forced) {
+		for (int l = SIMD_SCALAR; l < level; ++l)
+			if (strcmp(forced, simd_level_name((SimdLevel) l)) == 0) level = (SimdLevel) l;
+	}
+	return level;
+}
+
+const char *simd_level_name(SimdLevel level)
+{
+	switch (level) {
+		case SIMD_SSE4: return "sse4";
+		case SIMD_AVX2: return "avx2";
+		case SIMD_AVX512: return "avx512";
+		default: return "scalar";
+	}
+}
+
+CrossingKernel crossing_kernel(SimdLevel level)
+{
+#if SIMD_X86
+	switch (level) {
+		case SIMD_AVX512: return count_avx512;
+		case SIMD_AVX2: return count_avx2;
+		case SIMD_SSE4: return count_sse4;
+		default: break;
+	}
+#endif
+	return count_scalar;
+}
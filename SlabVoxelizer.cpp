@@ -0,0 +1,145 @@
+#include "includes/SlabVoxelizer.h"
+#include "includes/BinvoxWriter.h"
+#include "includes/BrickMap.h"
+#include "includes/RawWriter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+using CompFab::Word;
+using CompFab::VOXELS_PER_WORD;
+
+SlabVoxelizer::SlabVoxelizer(const CompFab::Vec3 &lowerLeft, unsigned int dimX, unsigned int dimY, unsigned int dimZ,
+	CompFab::precision_type spacing, size_t max_memory)
+	: m_lowerLeft(lowerLeft), m_dimX(dimX), m_dimY(dimY), m_dimZ(dimZ), m_spacing(spacing),
+	m_maxMemory(max_memory), m_cull(false), m_filled(0)
+{
+	m_wordsPerRow = (dimX + VOXELS_PER_WORD - 1) / VOXELS_PER_WORD;
+	size_t layer_bytes = std::max<size_t>(1, (size_t) m_wordsPerRow*dimY*sizeof(Word));
+	m_depth = std::max<size_t>(1, std::min<size_t>(dimZ, max_memory / layer_bytes));
+}
+
+size_t SlabVoxelizer::min_memory(unsigned int dimX, unsigned int dimY, unsigned int dimZ, bool binvox)
+{
+	size_t layer_bytes = (size_t) ((dimX + VOXELS_PER_WORD - 1) / VOXELS_PER_WORD)*dimY*sizeof(Word);
+	if (!binvox) return layer_bytes;
+	// the group of encode_binvox and the planes of BinvoxWriter, plus a layer read
+	return 2*(size_t) dimY*dimZ*sizeof(Word) + layer_bytes;
+}
+
+void SlabVoxelizer::run(unsigned int slab_depth, const std::vector<CompFab::Triangle> &triangles, const BVH *bvh, const VoxelizeFn &voxelize, const SlabFn &done)
+{
+	m_filled = 0;
+	std::vector<CompFab::Triangle> culled;
+	BVH slab_bvh;
+
+	for (unsigned int z0 = 0; z0 < m_dimZ; z0 += slab_depth) {
+		unsigned int depth = std::min(slab_depth, m_dimZ - z0);
+		CompFab::VoxelGrid slab(m_lowerLeft, m_dimX, m_dimY, depth, m_spacing, z0);
+
+		if (m_cull) {
+			// +X rays only cross triangles spanning their z, pad by a voxel for rounding
+			float z_lo = m_lowerLeft.m_z + m_spacing*((float) z0 - 1);
+			float z_hi = m_lowerLeft.m_z + m_spacing*((float) (z0 + depth));
+			culled.clear();
+			for (size_t i = 0; i < triangles.size(); ++i) {
+				const CompFab::Triangle &t = triangles[i];
+				float t_lo = std::min(t.m_v1.m_z, std::min(t.m_v2.m_z, t.m_v3.m_z));
+				float t_hi = std::max(t.m_v1.m_z, std::max(t.m_v2.m_z, t.m_v3.m_z));
+				if (t_hi >= z_lo && t_lo <= z_hi) culled.push_back(t);
+			}
+			slab_bvh.build(culled);
+			voxelize(&slab, culled, &slab_bvh);
+		} else {
+			voxelize(&slab, triangles, bvh);
+		}
+
+		m_filled += slab.count();
+		done(slab);
+	}
+}
+
+bool SlabVoxelizer::save_raw(const char *filename, const std::vector<CompFab::Triangle> &triangles, const BVH *bvh, const VoxelizeFn &voxelize)
+{
+	RawWriter out;
+	if (!out.open(filename)) return false;
+	out.write_header(m_dimX, m_dimY, m_dimZ, m_lowerLeft, m_spacing);
+	run(m_depth, triangles, bvh, voxelize, [&out](const CompFab::VoxelGrid &slab) {
+		out.write(slab.m_insideArray, slab.m_numWords);
+	});
+	return out.close();
+}
+
+bool SlabVoxelizer::save_binvox(const char *filename, const std::vector<CompFab::Triangle> &triangles, const BVH *bvh, const VoxelizeFn &voxelize)
+{
+	std::string spill = std::string(filename) + ".part";
+
+	RawWriter out;
+	if (!out.open(spill.c_str())) return false;
+	run(m_depth, triangles, bvh, voxelize, [&out](const CompFab::VoxelGrid &slab) {
+		out.write(slab.m_insideArray, slab.m_numWords);
+	});
+	bool ok = out.close() && encode_binvox(spill.c_str(), filename);
+
+	remove(spill.c_str());
+	return ok;
+}
+
+void SlabVoxelizer::save_bricks(BrickMap &bricks, const std::vector<CompFab::Triangle> &triangles, const BVH *bvh, const VoxelizeFn &voxelize)
+{
+	unsigned int depth = std::max<unsigned int>(BRICK_SIZE, m_depth / BRICK_SIZE * BRICK_SIZE);
+	run(depth, triangles, bvh, voxelize, [&bricks](const CompFab::VoxelGrid &slab) {
+		bricks.insert(slab);
+	});
+}
+
+// reads the spilled slabs once per group of word columns, as many columns as half
+// the budget holds next to the bit planes of the binvox writer, the other half
+// buffering the reads. At least one column and one layer, see min_memory
+bool SlabVoxelizer::encode_binvox(const char *spill, const char *filename)
+{
+	FILE *in = fopen(spill, "rb");
+	if (!in) return false;
+
+	size_t n = (size_t) m_dimZ*m_dimY;
+	size_t layer_words = (size_t) m_wordsPerRow*m_dimY;
+	size_t half = m_maxMemory / 2;
+	// one column worth of the budget goes to the bit planes
+	size_t columns = half / std::max<size_t>(1, n*sizeof(Word));
+	columns = std::min<size_t>(m_wordsPerRow, columns > 1 ? columns - 1 : 1);
+	size_t layers = std::max<size_t>(1, std::min<size_t>(m_dimZ, half / std::max<size_t>(1, layer_words*sizeof(Word))));
+
+	std::vector<Word> group(columns*n);
+	std::vector<Word> chunk(layers*layer_words);
+
+	BinvoxWriter writer;
+	bool ok = writer.open(filename, m_dimX, m_dimY, m_dimZ, m_lowerLeft, m_spacing);
+
+	for (unsigned int w0 = 0; ok && w0 < m_wordsPerRow; w0 += columns) {
+		unsigned int count = std::min<size_t>(columns, m_wordsPerRow - w0);
+
+		rewind(in);
+		for (unsigned int z0 = 0; ok && z0 < m_dimZ; z0 += layers) {
+			unsigned int depth = std::min<size_t>(layers, m_dimZ - z0);
+			size_t words = depth*layer_words;
+			if (fread(&chunk[0], sizeof(Word), words, in) != words) {
+				ok = false;
+				break;
+			}
+			for (unsigned int k = 0; k < depth; ++k)
+				for (unsigned int j = 0; j < m_dimY; ++j) {
+					const Word *row = &chunk[((size_t) k*m_dimY + j)*m_wordsPerRow];
+					size_t index = (size_t) (z0 + k)*m_dimY + j;
+					for (unsigned int g = 0; g < count; ++g)
+						group[g*n + index] = row[w0 + g];
+				}
+		}
+
+		for (unsigned int g = 0; ok && g < count; ++g)
+			writer.write_column(w0 + g, &group[g*n]);
+	}
+
+	fclose(in);
+	return writer.close() && ok;
+}
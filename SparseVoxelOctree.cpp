@@ -0,0 +1,307 @@
+#include "includes/SparseVoxelOctree.h"
+#include "includes/ThreadPool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+using CompFab::Word;
+using CompFab::VOXELS_PER_WORD;
+
+// levels below the root built serially, the subtrees under them in parallel
+#define SVO_SPLIT_LEVELS 3
+
+namespace {
+
+// the mixed children of a mask: the high bit of a two bit state is set only for MIXED
+inline unsigned int mixed_children(uint16_t mask)
+{
+	return __builtin_popcount(mask & 0xAAAA);
+}
+
+// the masks and leaves of a subtree, appended in breadth first order per level
+struct Levels {
+	std::vector<std::vector<uint16_t> > m_masks;
+	std::vector<Word> m_leaves;
+};
+
+class Builder {
+public:
+	Builder(const CompFab::VoxelGrid &grid, unsigned int levels, unsigned int split)
+		: m_grid(grid), m_levels(levels), m_split(split), m_splitStates(NULL) {}
+
+	// state of the cell at level with corner voxel (x0, y0, z0). The masks of its
+	// mixed descendants and itself go to out. With split states, the cells of the
+	// split level are not descended into but looked up
+	int cell(unsigned int level, unsigned int x0, unsigned int y0, unsigned int z0, Levels &out) const
+	{
+		if (x0 >= m_grid.m_dimX || y0 >= m_grid.m_dimY || z0 >= m_grid.m_dimZ) return SparseVoxelOctree::EMPTY;
+		if (m_splitStates && level == m_split) return (*m_splitStates)[morton(level, x0, y0, z0)];
+		if (level == m_levels) return leaf(x0, y0, z0, out);
+
+		unsigned int half = SparseVoxelOctree::LEAF_SIZE << (m_levels - level - 1);
+		uint16_t mask = 0;
+		bool empty = true, full = true;
+		for (unsigned int c = 0; c < 8; ++c) {
+			int state = cell(level + 1, x0 + (c & 1)*half, y0 + (c >> 1 & 1)*half, z0 + (c >> 2)*half, out);
+			mask |= state << (2*c);
+			empty &= state == SparseVoxelOctree::EMPTY;
+			full &= state == SparseVoxelOctree::FULL;
+		}
+		if (empty) return SparseVoxelOctree::EMPTY;
+		if (full) return SparseVoxelOctree::FULL;
+		out.m_masks[level].push_back(mask);
+		return SparseVoxelOctree::MIXED;
+	}
+
+	// corner voxel of the cell with the given breadth first index at a level
+	void corner(unsigned int level, size_t index, unsigned int &x0, unsigned int &y0, unsigned int &z0) const
+	{
+		x0 = y0 = z0 = 0;
+		for (unsigned int l = 0; l < level; ++l) {
+			unsigned int c = index >> (3*(level - 1 - l)) & 7;
+			unsigned int side = SparseVoxelOctree::LEAF_SIZE << (m_levels - l - 1);
+			x0 += (c & 1)*side;
+			y0 += (c >> 1 & 1)*side;
+			z0 += (c >> 2)*side;
+		}
+	}
+
+	void set_split_states(const std::vector<int> *states) { m_splitStates = states; }
+
+private:
+	// breadth first index of a cell among all cells of its level
+	size_t morton(unsigned int level, unsigned int x0, unsigned int y0, unsigned int z0) const
+	{
+		size_t index = 0;
+		for (unsigned int l = 0; l < level; ++l) {
+			unsigned int side = SparseVoxelOctree::LEAF_SIZE << (m_levels - l - 1);
+			index = index << 3 | (x0 / side & 1) | (y0 / side & 1) << 1 | (z0 / side & 1) << 2;
+		}
+		return index;
+	}
+
+	// a leaf is FULL when all of its voxels inside the grid are
+	int leaf(unsigned int x0, unsigned int y0, unsigned int z0, Levels &out) const
+	{
+		const unsigned int n = SparseVoxelOctree::LEAF_SIZE;
+		unsigned int width = std::min(n, m_grid.m_dimX - x0);
+		Word row_valid = (Word(1) << width) - 1;
+		Word bits = 0, valid = 0;
+		for (unsigned int z = 0; z < n && z0 + z < m_grid.m_dimZ; ++z)
+			for (unsigned int y = 0; y < n && y0 + y < m_grid.m_dimY; ++y) {
+				Word row = m_grid.word(x0 / VOXELS_PER_WORD, y0 + y, z0 + z) >> (x0 % VOXELS_PER_WORD);
+				bits |= (row & row_valid) << (n*y + n*n*z);
+				valid |= row_valid << (n*y + n*n*z);
+			}
+		if (bits == 0) return SparseVoxelOctree::EMPTY;
+		if (bits == valid) return SparseVoxelOctree::FULL;
+		out.m_leaves.push_back(bits);
+		return SparseVoxelOctree::MIXED;
+	}
+
+	const CompFab::VoxelGrid &m_grid;
+	unsigned int m_levels, m_split;
+	const std::vector<int> *m_splitStates;
+};
+
+}
+
+SparseVoxelOctree::SparseVoxelOctree()
+	: m_dimX(0), m_dimY(0), m_dimZ(0), m_levels(0), m_root(EMPTY), m_spacing(0)
+{
+}
+
+void SparseVoxelOctree::build(const CompFab::VoxelGrid &grid)
+{
+	m_dimX = grid.m_dimX;
+	m_dimY = grid.m_dimY;
+	m_dimZ = grid.m_dimZ;
+	m_spacing = grid.m_spacing;
+	m_lowerLeft = grid.m_lowerLeft;
+
+	unsigned int extent = std::max(m_dimX, std::max(m_dimY, m_dimZ));
+	m_levels = 0;
+	while (((size_t) LEAF_SIZE << m_levels) < extent) ++m_levels;
+	unsigned int split = std::min<unsigned int>(m_levels, SVO_SPLIT_LEVELS);
+
+	// the subtrees under the split level, each into levels of its own that are
+	// concatenated in breadth first order below
+	Builder builder(grid, m_levels, split);
+	size_t subtrees = (size_t) 1 << (3*split);
+	std::vector<int> states(subtrees);
+	std::vector<Levels> parts(subtrees);
+	ThreadPool::global().parallel_for(0, subtrees, [&](size_t index) {
+		unsigned int x0, y0, z0;
+		builder.corner(split, index, x0, y0, z0);
+		parts[index].m_masks.resize(m_levels);
+		states[index] = builder.cell(split, x0, y0, z0, parts[index]);
+	});
+
+	Levels top;
+	top.m_masks.resize(m_levels);
+	builder.set_split_states(&states);
+	m_root = builder.cell(0, 0, 0, 0, top);
+
+	m_masks.swap(top.m_masks);
+	m_leaves.clear();
+	for (size_t index = 0; index < subtrees; ++index) {
+		for (unsigned int level = split; level < m_levels; ++level)
+			m_masks[level].insert(m_masks[level].end(), parts[index].m_masks[level].begin(), parts[index].m_masks[level].end());
+		m_leaves.insert(m_leaves.end(), parts[index].m_leaves.begin(), parts[index].m_leaves.end());
+	}
+	link();
+}
+
+void SparseVoxelOctree::link()
+{
+	m_firstChild.resize(m_levels);
+	for (unsigned int level = 0; level < m_levels; ++level) {
+		const std::vector<uint16_t> &masks = m_masks[level];
+		m_firstChild[level].resize(masks.size());
+		uint32_t first = 0;
+		for (size_t n = 0; n < masks.size(); ++n) {
+			m_firstChild[level][n] = first;
+			first += mixed_children(masks[n]);
+		}
+	}
+}
+
+size_t SparseVoxelOctree::nodes() const
+{
+	size_t count = 0;
+	for (unsigned int level = 0; level < m_masks.size(); ++level) count += m_masks[level].size();
+	return count;
+}
+
+bool SparseVoxelOctree::isInside(unsigned int i, unsigned int j, unsigned int k) const
+{
+	if (i >= m_dimX || j >= m_dimY || k >= m_dimZ) return false;
+	if (m_root != MIXED) return m_root == FULL;
+
+	size_t index = 0;
+	for (unsigned int level = 0; level < m_levels; ++level) {
+		unsigned int side = LEAF_SIZE << (m_levels - level - 1);
+		unsigned int c = (i / side & 1) | (j / side & 1) << 1 | (k / side & 1) << 2;
+		uint16_t mask = m_masks[level][index];
+		int state = mask >> (2*c) & 3;
+		if (state != MIXED) return state == FULL;
+		index = m_firstChild[level][index] + mixed_children(mask & ((1u << (2*c)) - 1));
+	}
+	return m_leaves[index] >> (i % LEAF_SIZE + LEAF_SIZE*(j % LEAF_SIZE) + LEAF_SIZE*LEAF_SIZE*(k % LEAF_SIZE)) & 1;
+}
+
+bool SparseVoxelOctree::save(const char *filename) const
+{
+	FILE *file = fopen(filename, "wb");
+	if (!file) return false;
+
+	std::ostringstream header;
+	header << "#svo 1" << std::endl;
+	header << "dim " << m_dimX << " " << m_dimY << " " << m_dimZ << std::endl;
+	header << "translate " << m_lowerLeft.m_x << " " << m_lowerLeft.m_y << " " << m_lowerLeft.m_z << std::endl;
+	header << "scale " << m_spacing << std::endl;
+	header << "levels " << m_levels << std::endl;
+	header << "root " << m_root << std::endl;
+	header << "nodes";
+	for (unsigned int level = 0; level < m_levels; ++level) header << " " << m_masks[level].size();
+	header << std::endl;
+	header << "leaves " << m_leaves.size() << std::endl;
+	header << "data" << std::endl;
+	std::string text = header.str();
+
+	bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+	for (unsigned int level = 0; ok && level < m_levels; ++level)
+		ok = fwrite(m_masks[level].data(), sizeof(uint16_t), m_masks[level].size(), file) == m_masks[level].size();
+	ok = ok && fwrite(m_leaves.data(), sizeof(Word), m_leaves.size(), file) == m_leaves.size();
+	return fclose(file) == 0 && ok;
+}
+
+bool SparseVoxelOctree::load(const char *filename)
+{
+	FILE *file = fopen(filename, "rb");
+	if (!file) return false;
+
+	// the ascii header, a line at a time up to "data". Nothing is kept before the
+	// whole file checked out
+	unsigned int dimX = 0, dimY = 0, dimZ = 0, levels = 0;
+	int root = -1;
+	CompFab::precision_type spacing = 0;
+	CompFab::Vec3 lowerLeft;
+	std::vector<size_t> counts;
+	size_t leaves = 0;
+	bool ok = false, magic = false;
+	char line[4096];
+	while (fgets(line, sizeof(line), file)) {
+		std::istringstream in(line);
+		std::string key;
+		in >> key;
+		if (key == "#svo") magic = true;
+		else if (key == "dim") in >> dimX >> dimY >> dimZ;
+		else if (key == "translate") in >> lowerLeft.m_x >> lowerLeft.m_y >> lowerLeft.m_z;
+		else if (key == "scale") in >> spacing;
+		else if (key == "levels") in >> levels;
+		else if (key == "root") in >> root;
+		else if (key == "leaves") in >> leaves;
+		else if (key == "nodes") {
+			size_t count;
+			while (in >> count) counts.push_back(count);
+		}
+		else if (key == "data") {
+			ok = magic && counts.size() == levels;
+			break;
+		}
+	}
+
+	// the side of the cube, LEAF_SIZE << levels, must fit the unsigned queries
+	ok = ok && ((uint64_t) LEAF_SIZE << std::min(levels, 32u)) <= UINT32_MAX;
+	unsigned int side = ok ? (unsigned int) LEAF_SIZE << levels : 0;
+	ok = ok && dimX <= side && dimY <= side && dimZ <= side && root >= EMPTY && root <= MIXED;
+
+	// and the arrays must lie within the rest of the file before they are sized
+	size_t remaining = 0;
+	if (ok) {
+		long data = ftell(file);
+		ok = data >= 0 && fseek(file, 0, SEEK_END) == 0;
+		long size = ok ? ftell(file) : -1;
+		ok = ok && size >= data && fseek(file, data, SEEK_SET) == 0;
+		if (ok) remaining = size - data;
+	}
+	for (unsigned int level = 0; ok && level < levels; ++level) {
+		ok = counts[level] <= remaining / sizeof(uint16_t);
+		if (ok) remaining -= counts[level]*sizeof(uint16_t);
+	}
+	ok = ok && leaves <= remaining / sizeof(Word);
+
+	std::vector<std::vector<uint16_t> > masks(ok ? levels : 0);
+	for (unsigned int level = 0; ok && level < levels; ++level) {
+		masks[level].resize(counts[level]);
+		ok = fread(masks[level].data(), sizeof(uint16_t), counts[level], file) == counts[level];
+	}
+	std::vector<Word> words(ok ? leaves : 0);
+	ok = ok && fread(words.data(), sizeof(Word), leaves, file) == leaves;
+	fclose(file);
+	if (!ok) return false;
+
+	m_dimX = dimX;
+	m_dimY = dimY;
+	m_dimZ = dimZ;
+	m_lowerLeft = lowerLeft;
+	m_spacing = spacing;
+	m_levels = levels;
+	m_root = root;
+	m_masks.swap(masks);
+	m_leaves.swap(words);
+	link();
+
+	// every mixed child has to be in the next level, or the queries run off its end
+	if (m_levels == 0) return m_leaves.size() == (m_root == MIXED ? 1u : 0u);
+	if (m_masks[0].size() != (m_root == MIXED ? 1u : 0u)) return false;
+	for (unsigned int level = 0; level < m_levels; ++level) {
+		size_t children = m_masks[level].empty() ? 0 : m_firstChild[level].back() + mixed_children(m_masks[level].back());
+		if (children != (level + 1 < m_levels ? m_masks[level + 1].size() : m_leaves.size())) return false;
+	}
+	return true;
+}
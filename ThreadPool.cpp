@@ -0,0 +1,105 @@
+#include "includes/ThreadPool.h"
+
+#include <iostream>
+
+static unsigned int g_globalThreads = 0;
+static std::atomic<bool> g_globalCreated(false);
+
+ThreadPool::ThreadPool(unsigned int threads) : m_stop(false)
+{
+	if (threads == 0) threads = std::thread::hardware_concurrency();
+	if (threads == 0) threads = 1;
+
+	// the thread calling parallel_for is the last worker
+	for (unsigned int i = 1; i < threads; ++i)
+		m_workers.push_back(std::thread(&ThreadPool::worker, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (size_t i = 0; i < m_workers.size(); ++i)
+		m_workers[i].join();
+}
+
+ThreadPool &ThreadPool::global()
+{
+	static ThreadPool pool(g_globalThreads);
+	g_globalCreated = true;
+	return pool;
+}
+
+void ThreadPool::set_global_threads(unsigned int threads)
+{
+	if (g_globalCreated && threads != g_globalThreads)
+		std::cerr << "The thread pool is already running with " << global().size() << " threads, ignoring " << threads << " threads." << std::endl;
+	g_globalThreads = threads;
+}
+
+void ThreadPool::run(Job &job)
+{
+	size_t count = job.end - job.begin;
+	while (true) {
+		size_t i = job.next.fetch_add(1);
+		if (i >= count) return;
+		(*job.fn)(job.begin + i);
+		if (job.finished.fetch_add(1) + 1 == count) {
+			// take the lock so the notification cannot slip in before the owner waits
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_done.notify_all();
+		}
+	}
+}
+
+void ThreadPool::worker()
+{
+	while (true) {
+		std::shared_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+			if (m_stop) return;
+			job = m_jobs.front();
+			// every index has been claimed, nothing left here for other workers
+			if (job->next.load() >= job->end - job->begin) {
+				m_jobs.pop_front();
+				continue;
+			}
+		}
+		run(*job);
+	}
+}
+
+void ThreadPool::parallel_for(size_t begin, size_t end, const std::function<void(size_t)> &fn)
+{
+	if (end <= begin) return;
+
+	std::shared_ptr<Job> job = std::make_shared<Job>();
+	job->fn = &fn;
+	job->begin = begin;
+	job->end = end;
+	job->next = 0;
+	job->finished = 0;
+
+	if (!m_workers.empty() && end - begin > 1) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(job);
+		m_wake.notify_all();
+	}
+
+	run(*job);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [&job, begin, end] { return job->finished.load() == end - begin; });
+	// the job may still be queued if the caller claimed the last index itself
+	for (std::deque<std::shared_ptr<Job> >::iterator it = m_jobs.begin(); it != m_jobs.end(); ++it) {
+		if (*it == job) {
+			m_jobs.erase(it);
+			break;
+		}
+	}
+}
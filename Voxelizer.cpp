@@ -0,0 +1,170 @@
+#include "includes/Voxelizer.h"
+#include "includes/BrickMap.h"
+#include "includes/Mesh.h"
+#include "includes/MeshCache.h"
+#include "includes/Profiler.h"
+#include "includes/SlabVoxelizer.h"
+#include "includes/floodfill.h"
+#include "includes/voxelize_cpu.h"
+
+#include <algorithm>
+
+#if USE_CUDA
+extern void kernel_wrapper(int samples, int w, int h, int d, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, bool double_thick, bool bricks, unsigned int seed);
+#endif
+
+const char *modeName(VoxelizeMode mode)
+{
+	switch (mode) {
+		case scanline: return "scanline";
+		case tiled: return "tiled";
+		case parity: return "parity";
+		case surface: return "surface";
+		case flood: return "flood";
+		default: return "ray";
+	}
+}
+
+VoxelizeOptions::VoxelizeOptions()
+	: backend(cpu), mode(ray), double_thick(false), bricks(false), separating(26), close(0), samples(-1), seed(0)
+{
+}
+
+namespace {
+
+// fills grid from the given triangles, a subset of the mesh for slabs
+void voxelize_grid(const VoxelizeOptions &options, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, const BVH *bvh)
+{
+	ScopedTimer timer("voxelize");
+	int w = grid->m_dimX, h = grid->m_dimY, d = grid->m_dimZ;
+#if USE_CUDA
+	if (options.backend == cuda)
+		kernel_wrapper(options.samples, w, h, d, grid, triangles, options.double_thick, options.bricks, options.seed);
+	else
+#endif
+	if (options.mode == scanline)
+		cpu_scanline_wrapper(w, h, d, grid, triangles, options.double_thick, bvh);
+	else if (options.mode == tiled)
+		cpu_tiled_wrapper(w, h, d, grid, triangles, options.double_thick);
+	else if (options.mode == parity)
+		cpu_parity_wrapper(w, h, d, grid, triangles, options.double_thick);
+	else if (options.mode == surface)
+		cpu_surface_wrapper(w, h, d, grid, triangles, options.separating);
+	else if (options.mode == flood) {
+		cpu_surface_wrapper(w, h, d, grid, triangles, options.separating);
+		ScopedTimer fill_timer("flood fill");
+		solidify(grid, options.close);
+	}
+	else
+		cpu_kernel_wrapper(options.samples, w, h, d, grid, triangles, options.double_thick, bvh, options.bricks, options.seed);
+}
+
+}
+
+bool Voxelizer::load(const char *filename, bool use_cache)
+{
+	m_triangles.clear();
+
+	{
+		ScopedTimer timer("load mesh");
+		if (!use_cache || !load_vmesh(filename, m_triangles, m_bbMin, m_bbMax)) {
+			Mesh mesh(filename, true);
+			m_triangles.reserve(mesh.t.size());
+			for (unsigned int tri = 0; tri < mesh.t.size(); ++tri)
+				m_triangles.push_back(CompFab::Triangle(mesh.v[mesh.t[tri][0]], mesh.v[mesh.t[tri][1]], mesh.v[mesh.t[tri][2]]));
+
+			// an unreadable file leaves the mesh without vertices to take the box of
+			if (!m_triangles.empty()) {
+				BBox(mesh, m_bbMin, m_bbMax);
+				// failing to write the cache (e.g. a read only directory) only costs the next run
+				if (use_cache) {
+					ScopedTimer write_timer("write mesh cache");
+					save_vmesh(filename, mesh, m_bbMin, m_bbMax);
+				}
+			}
+		}
+	}
+
+	m_bvh.build(m_triangles);
+	return !m_triangles.empty();
+}
+
+void Voxelizer::setMesh(TriangleSpan triangles)
+{
+	m_triangles.assign(triangles.begin(), triangles.end());
+
+	m_bbMin = m_bbMax = triangles.empty() ? CompFab::Vec3(0, 0, 0) : triangles[0].m_v1;
+	for (size_t i = 0; i < triangles.size(); ++i) {
+		const CompFab::Vec3 *v[3] = { &triangles[i].m_v1, &triangles[i].m_v2, &triangles[i].m_v3 };
+		for (int c = 0; c < 3; ++c)
+			for (int a = 0; a < 3; ++a) {
+				m_bbMin[a] = std::min(m_bbMin[a], (*v[c])[a]);
+				m_bbMax[a] = std::max(m_bbMax[a], (*v[c])[a]);
+			}
+	}
+
+	m_bvh.build(m_triangles);
+}
+
+void Voxelizer::placeGrid(unsigned int dim, CompFab::Vec3 &lowerLeft, double &spacing) const
+{
+	// the longest side of the bounding box spans dim-2 voxels
+	double bbX = m_bbMax[0] - m_bbMin[0];
+	double bbY = m_bbMax[1] - m_bbMin[1];
+	double bbZ = m_bbMax[2] - m_bbMin[2];
+
+	if (bbX > bbY && bbX > bbZ) {
+		spacing = bbX/(double)(dim-2);
+	} else if (bbY > bbX && bbY > bbZ) {
+		spacing = bbY/(double)(dim-2);
+	} else {
+		spacing = bbZ/(double)(dim-2);
+	}
+
+	CompFab::Vec3 hspacing(0.5*spacing, 0.5*spacing, 0.5*spacing);
+	lowerLeft = m_bbMin - hspacing;
+}
+
+CompFab::VoxelGrid *Voxelizer::newGrid(unsigned int dim) const
+{
+	CompFab::Vec3 lowerLeft;
+	double spacing;
+	placeGrid(dim, lowerLeft, spacing);
+	return new CompFab::VoxelGrid(lowerLeft, dim, dim, dim, spacing);
+}
+
+void Voxelizer::voxelize(const VoxelizeOptions &options, CompFab::VoxelGrid &grid) const
+{
+	voxelize_grid(options, &grid, m_triangles, &m_bvh);
+}
+
+bool Voxelizer::voxelizeToFile(const VoxelizeOptions &options, unsigned int dim, size_t max_memory,
+	const char *filename, bool raw, size_t &filled) const
+{
+	CompFab::Vec3 lowerLeft;
+	double spacing;
+	placeGrid(dim, lowerLeft, spacing);
+
+	SlabVoxelizer slabs(lowerLeft, dim, dim, dim, spacing, max_memory);
+	// sampled rays leave the z layer of their voxel
+	slabs.set_culling(options.samples <= 0);
+
+	SlabVoxelizer::VoxelizeFn fn = [&options](CompFab::VoxelGrid *slab, const TriangleList &triangles, const BVH *bvh) {
+		voxelize_grid(options, slab, triangles, bvh);
+	};
+	bool saved = raw
+		? slabs.save_raw(filename, m_triangles, &m_bvh, fn)
+		: slabs.save_binvox(filename, m_triangles, &m_bvh, fn);
+	filled = slabs.filled();
+	return saved;
+}
+
+void Voxelizer::voxelizeBricks(const VoxelizeOptions &options, BrickMap &bricks, size_t max_memory) const
+{
+	SlabVoxelizer slabs(bricks.m_lowerLeft, bricks.m_dimX, bricks.m_dimY, bricks.m_dimZ, bricks.m_spacing, max_memory);
+	slabs.set_culling(options.samples <= 0);
+
+	slabs.save_bricks(bricks, m_triangles, &m_bvh, [&options](CompFab::VoxelGrid *slab, const TriangleList &triangles, const BVH *bvh) {
+		voxelize_grid(options, slab, triangles, bvh);
+	});
+}
@@ -0,0 +1,49 @@
+#include "includes/VoxelizerCache.h"
+
+VoxelizerCache::Entry VoxelizerCache::get(uint64_t key, const std::function<Entry()> &load, bool &hit)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_loaded.wait(lock, [&] { return m_loading.count(key) == 0; });
+
+	std::unordered_map<uint64_t, Order::iterator>::iterator found = m_index.find(key);
+	if (found != m_index.end()) {
+		m_order.splice(m_order.begin(), m_order, found->second);
+		++m_hits;
+		hit = true;
+		return m_order.front().second;
+	}
+
+	++m_misses;
+	hit = false;
+	m_loading.insert(key);
+	lock.unlock();
+	Entry entry;
+	try {
+		entry = load();
+	} catch (...) {
+		lock.lock();
+		m_loading.erase(key);
+		m_loaded.notify_all();
+		throw;
+	}
+	lock.lock();
+	m_loading.erase(key);
+	m_loaded.notify_all();
+	if (!entry) return entry;
+
+	m_order.push_front(std::make_pair(key, entry));
+	m_index[key] = m_order.begin();
+	while (m_order.size() > m_capacity) {
+		m_index.erase(m_order.back().first);
+		m_order.pop_back();
+	}
+	return entry;
+}
+
+void VoxelizerCache::counts(size_t &size, size_t &hits, size_t &misses)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size = m_order.size();
+	hits = m_hits;
+	misses = m_misses;
+}
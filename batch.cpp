@@ -0,0 +1,183 @@
+#include "includes/batch.h"
+#include "includes/BoundedQueue.h"
+#include "includes/GridPool.h"
+#include "includes/Profiler.h"
+#include "includes/ThreadPool.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock batch_clock;
+
+double elapsed_ms(batch_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(batch_clock::now() - start).count();
+}
+
+struct BatchJob {
+	std::string input, output;
+	int size, samples;
+	// set while the job is between the stages
+	Voxelizer *voxelizer;
+	CompFab::VoxelGrid *grid;
+	bool loaded, saved;
+	size_t triangles, filled;
+	double load_ms, voxelize_ms, write_ms;
+};
+
+bool read_manifest(const std::string &manifest, const VoxelizerArgs &args, std::vector<BatchJob> &jobs)
+{
+	std::ifstream in(manifest.c_str());
+	if (!in) return false;
+
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream fields(line);
+		BatchJob job;
+		if (!(fields >> job.input) || job.input[0] == '#') continue;
+		if (!(fields >> job.output)) return false;
+		job.size = args.size;
+		job.samples = args.samples;
+		if (fields >> job.size) fields >> job.samples;
+		job.voxelizer = NULL;
+		job.grid = NULL;
+		job.loaded = job.saved = false;
+		job.triangles = job.filled = 0;
+		job.load_ms = job.voxelize_ms = job.write_ms = 0;
+		jobs.push_back(job);
+	}
+	return true;
+}
+
+// the settings of the command line with the samples of a job, which like on the
+// command line the modes without sampling ignore or leave to the ray mode
+VoxelizeOptions job_options(const VoxelizerArgs &args, const BatchJob &job)
+{
+	VoxelizeOptions options = args;
+	options.samples = job.samples;
+	if (options.samples > 0 && (options.mode == surface || options.mode == flood)) options.samples = -1;
+	if (options.samples > 0 && options.mode != ray && options.mode != surface && options.mode != flood) options.mode = ray;
+	return options;
+}
+
+}
+
+bool runBatch(VoxelizerArgs *args, const std::string &manifest)
+{
+	std::vector<BatchJob> jobs;
+	if (!read_manifest(manifest, *args, jobs)) {
+		args->debug(0) << "Could not read the batch manifest " << manifest << "." << std::endl;
+		return false;
+	}
+	args->debug(0) << "Voxelizing " << jobs.size() << " meshes of " << manifest << " with " << ThreadPool::global().size() << " threads." << std::endl;
+
+	// a mesh is loaded into, voxelized from, and handed back from the voxelizers
+	// of the pool, which bounds the meshes in flight
+	const size_t voxelizers = BATCH_QUEUE_DEPTH + 2;
+	std::vector<Voxelizer> voxelizer_storage(voxelizers);
+	BoundedQueue<Voxelizer *> free_voxelizers(voxelizers);
+	for (size_t i = 0; i < voxelizers; ++i) free_voxelizers.push(&voxelizer_storage[i]);
+
+	BoundedQueue<BatchJob *> loaded(BATCH_QUEUE_DEPTH), voxelized(BATCH_QUEUE_DEPTH);
+	GridPool grids((size_t) BATCH_POOL_MEMORY << 20);
+	ResultCache *results = args->result_cache.empty() ? NULL : new ResultCache(args->result_cache, (size_t) args->result_cache_size << 20);
+	batch_clock::time_point start = batch_clock::now();
+
+	std::thread load_stage([&]() {
+		for (size_t i = 0; i < jobs.size(); ++i) {
+			BatchJob &job = jobs[i];
+			free_voxelizers.pop(job.voxelizer);
+			batch_clock::time_point begin = batch_clock::now();
+			job.loaded = job.voxelizer->load(job.input.c_str(), args->mesh_cache);
+			job.load_ms = elapsed_ms(begin);
+			job.triangles = job.voxelizer->triangles().size();
+			loaded.push(&job);
+		}
+		loaded.close();
+	});
+
+	std::thread write_stage([&]() {
+		args->debug(0) << std::left << std::setw(24) << "mesh" << std::right << std::setw(6) << "res"
+			<< std::setw(11) << "triangles" << std::setw(10) << "load ms" << std::setw(13) << "voxelize ms"
+			<< std::setw(11) << "write ms" << std::setw(12) << "filled" << std::endl;
+		BatchJob *job;
+		while (voxelized.pop(job)) {
+			if (job->grid) {
+				batch_clock::time_point begin = batch_clock::now();
+				job->saved = save(args, job->output, args->format, *job->grid);
+				job->write_ms = elapsed_ms(begin);
+				grids.give(job->grid);
+				job->grid = NULL;
+			}
+
+			std::string name = job->input.substr(job->input.find_last_of('/') + 1);
+			args->debug(0) << std::left << std::setw(24) << name << std::right << std::setw(6) << job->size;
+			if (!job->loaded) {
+				args->debug(0) << "  failed to load " << job->input << std::endl;
+				continue;
+			}
+			args->debug(0) << std::setw(11) << job->triangles << std::fixed << std::setprecision(1)
+				<< std::setw(10) << job->load_ms << std::setw(13) << job->voxelize_ms << std::setw(11) << job->write_ms
+				<< std::setw(12) << job->filled << (job->saved ? "" : "  failed to save " + job->output) << std::endl;
+		}
+	});
+
+	BatchJob *job;
+	while (loaded.pop(job)) {
+		if (job->loaded && job->size > 2) {
+			CompFab::Vec3 lowerLeft;
+			double spacing;
+			job->voxelizer->placeGrid(job->size, lowerLeft, spacing);
+
+			batch_clock::time_point begin = batch_clock::now();
+			job->grid = grids.take(lowerLeft, job->size, job->size, job->size, spacing);
+			VoxelizeOptions options = job_options(*args, *job);
+			uint64_t key = results ? ResultCache::key(*job->voxelizer, options, job->size) : 0;
+			if (!results || !results->load(key, *job->grid)) {
+				job->voxelizer->voxelize(options, *job->grid);
+				if (results) results->store(key, *job->grid);
+			}
+			job->filled = job->grid->count();
+			Profiler::count(COUNT_VOXELS_FILLED, job->filled);
+			job->voxelize_ms = elapsed_ms(begin);
+		} else {
+			job->loaded = false;
+		}
+		free_voxelizers.push(job->voxelizer);
+		job->voxelizer = NULL;
+		voxelized.push(job);
+	}
+	voxelized.close();
+	load_stage.join();
+	write_stage.join();
+
+	double seconds = elapsed_ms(start) / 1000;
+	size_t done = 0;
+	double voxels = 0, load_ms = 0, voxelize_ms = 0, write_ms = 0;
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		if (jobs[i].saved) {
+			++done;
+			voxels += (double) jobs[i].size*jobs[i].size*jobs[i].size;
+		}
+		load_ms += jobs[i].load_ms;
+		voxelize_ms += jobs[i].voxelize_ms;
+		write_ms += jobs[i].write_ms;
+	}
+
+	// the stages summing up to more than the wall time is the overlap of the pipeline
+	args->debug(0) << std::fixed << std::setprecision(2) << "Batch: " << done << " of " << jobs.size() << " meshes in " << seconds << " seconds, "
+		<< done / seconds << " meshes/s, " << voxels / seconds / 1e6 << " Mvoxels/s" << std::endl;
+	args->debug(0) << "Stages: load " << load_ms / 1000 << " s, voxelize " << voxelize_ms / 1000 << " s, write " << write_ms / 1000
+		<< " s, grids allocated " << grids.allocated() << ", reused " << grids.reused() << std::endl;
+	if (results) {
+		reportResultCache(args, *results);
+		delete results;
+	}
+	return done == jobs.size();
+}
@@ -0,0 +1,177 @@
+// Reports what the sparse brick map takes against the dense bit-packed grid for
+// the bundled meshes (or the files given on the command line) at high resolutions:
+// the mixed, full and empty bricks, the bytes of the map and the time to voxelize
+// into it. The dense grid is never allocated.
+//
+//   ./bin/brickmap_bench [-r 1024,2048] [-m parity|ray|scanline|tiled|surface] [-t threads]
+//                        [--max-memory MiB] [-o results.json] [file.obj ...]
+
+#include "includes/pipeline.h"
+#include "includes/ThreadPool.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef VOXELIZER_DATA_DIR
+#define VOXELIZER_DATA_DIR "data"
+#endif
+
+static const char *DEFAULT_FILES[] = {
+	"sphere/sphere.obj", "teapot/teapot.obj", "bunny/bunny.obj",
+	"head/head.obj", "dragon/dragon2.obj"
+};
+
+static std::vector<int> parse_list(const char *text)
+{
+	std::vector<int> values;
+	std::stringstream in(text);
+	std::string item;
+	while (std::getline(in, item, ','))
+		if (!item.empty()) values.push_back(atoi(item.c_str()));
+	return values;
+}
+
+static std::string mesh_name(const std::string &file)
+{
+	std::string name = file.substr(file.find_last_of('/') + 1);
+	return name.substr(0, name.find_last_of('.'));
+}
+
+struct Result {
+	std::string mesh;
+	int resolution;
+	size_t triangles, filled;
+	size_t bricks, mixed, full;
+	size_t memory, dense_memory;
+	double ms;
+};
+
+static void write_json(std::ostream &out, const VoxelizerArgs &args, const std::vector<Result> &results)
+{
+	out << std::fixed << std::setprecision(3);
+	out << "{\n";
+	out << "  \"benchmark\": \"brickmap_bench\",\n";
+	out << "  \"mode\": \"" << modeName(args.mode) << "\",\n";
+	out << "  \"threads\": " << ThreadPool::global().size() << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Result &r = results[i];
+		out << "    {\"mesh\": \"" << r.mesh << "\", \"triangles\": " << r.triangles
+			<< ", \"resolution\": " << r.resolution << ", \"filled\": " << r.filled
+			<< ", \"bricks\": " << r.bricks << ", \"mixed_bricks\": " << r.mixed << ", \"full_bricks\": " << r.full
+			<< ", \"bytes\": " << r.memory << ", \"dense_bytes\": " << r.dense_memory
+			<< ", \"voxelize_ms\": " << r.ms << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n";
+	out << "}\n";
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<int> resolutions = parse_list("1024,2048");
+	std::string json_path;
+	std::vector<std::string> files;
+
+	VoxelizerArgs args;
+	args.verbosity = 0;
+	args.format = binvox;
+	args.backend = cpu;
+	args.mode = parity;
+	args.double_thick = false;
+	args.bricks = false;
+	args.separating = 26;
+	args.close = 0;
+	args.mesh_cache = true;
+	args.samples = -1;
+	args.seed = 0;
+	args.threads = 0;
+	args.max_memory = 0;
+	args.sparse = true;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) resolutions = parse_list(argv[++i]);
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			++i;
+			args.mode = strcmp(argv[i], "scanline") == 0 ? scanline : strcmp(argv[i], "tiled") == 0 ? tiled
+				: strcmp(argv[i], "ray") == 0 ? ray : strcmp(argv[i], "surface") == 0 ? surface : parity;
+		}
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) args.threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc) args.max_memory = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) json_path = argv[++i];
+		else files.push_back(argv[i]);
+	}
+	if (files.empty())
+		for (size_t i = 0; i < sizeof(DEFAULT_FILES) / sizeof(DEFAULT_FILES[0]); ++i)
+			files.push_back(std::string(VOXELIZER_DATA_DIR) + "/" + DEFAULT_FILES[i]);
+	ThreadPool::set_global_threads(args.threads);
+
+	std::cout << "threads: " << ThreadPool::global().size() << ", mode: " << modeName(args.mode) << "\n\n";
+	std::cout << std::left << std::setw(10) << "mesh" << std::right << std::setw(6) << "res"
+		<< std::setw(11) << "mixed" << std::setw(11) << "full" << std::setw(12) << "bricks"
+		<< std::setw(11) << "map MiB" << std::setw(11) << "dense MiB" << std::setw(9) << "ratio"
+		<< std::setw(12) << "ms" << "\n";
+
+	std::streambuf *out = std::cout.rdbuf();
+	std::ofstream null_stream;
+	std::vector<Result> results;
+
+	for (size_t f = 0; f < files.size(); ++f) {
+		std::cout.rdbuf(null_stream.rdbuf());
+		Voxelizer voxelizer;
+		bool loaded = voxelizer.load(files[f].c_str(), args.mesh_cache);
+		std::cout.rdbuf(out);
+		if (!loaded) {
+			std::cout << "failed to load " << files[f] << "\n";
+			continue;
+		}
+
+		for (size_t r = 0; r < resolutions.size(); ++r) {
+			args.size = resolutions[r];
+			CompFab::Vec3 lowerLeft;
+			double spacing;
+			voxelizer.placeGrid(args.size, lowerLeft, spacing);
+
+			BrickMap bricks(lowerLeft, args.size, args.size, args.size, spacing);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			voxelizeBricks(&args, voxelizer, bricks);
+
+			Result result;
+			result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			result.mesh = mesh_name(files[f]);
+			result.resolution = args.size;
+			result.triangles = voxelizer.triangles().size();
+			result.filled = bricks.count();
+			result.bricks = (size_t) bricks.m_bricksX*bricks.m_bricksY*bricks.m_bricksZ;
+			result.mixed = bricks.mixed_bricks();
+			result.full = bricks.full_bricks();
+			result.memory = bricks.memory();
+			result.dense_memory = bricks.dense_memory();
+			results.push_back(result);
+
+			std::cout << std::left << std::setw(10) << result.mesh << std::right << std::setw(6) << result.resolution
+				<< std::setw(11) << result.mixed << std::setw(11) << result.full << std::setw(12) << result.bricks
+				<< std::fixed << std::setprecision(2)
+				<< std::setw(11) << result.memory / (1024.0*1024.0) << std::setw(11) << result.dense_memory / (1024.0*1024.0)
+				<< std::setw(9) << (double) result.dense_memory / result.memory
+				<< std::setw(12) << result.ms << std::endl;
+		}
+	}
+
+	if (!json_path.empty()) {
+		std::ofstream json(json_path.c_str());
+		write_json(json, args, results);
+		if (!json) {
+			std::cerr << "could not write " << json_path << "\n";
+			return 1;
+		}
+		std::cout << "\nwrote " << json_path << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,239 @@
+// Compares the storage layouts of GridLayout.h on neighbourhood work: for the
+// surface voxels of the bundled meshes (or the files given on the command line)
+// it times a voxel by voxel flood fill of the exterior and a 26-neighbour dilation
+// on each layout, and checks both results against the linear layout.
+//
+//   ./bin/layout_bench [-r 128,256] [-t threads] [-o results.json] [file.obj ...]
+
+#include "includes/pipeline.h"
+#include "includes/GridLayout.h"
+#include "includes/ThreadPool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef VOXELIZER_DATA_DIR
+#define VOXELIZER_DATA_DIR "data"
+#endif
+
+static const char *DEFAULT_FILES[] = {
+	"sphere/sphere.obj", "bunny/bunny.obj", "dragon/dragon2.obj"
+};
+
+static std::vector<int> parse_list(const char *text)
+{
+	std::vector<int> values;
+	std::stringstream in(text);
+	std::string item;
+	while (std::getline(in, item, ','))
+		if (!item.empty()) values.push_back(atoi(item.c_str()));
+	return values;
+}
+
+static std::string mesh_name(const std::string &file)
+{
+	std::string name = file.substr(file.find_last_of('/') + 1);
+	return name.substr(0, name.find_last_of('.'));
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Timing {
+	std::string layout;
+	double load_ms, flood_ms, dilate_ms;
+	CompFab::VoxelGrid *exterior, *dilated;
+};
+
+template <class Layout>
+static void run_layout(const CompFab::VoxelGrid &surface, Timing &timing)
+{
+	const unsigned int w = surface.m_dimX, h = surface.m_dimY, d = surface.m_dimZ;
+	LayoutGrid<Layout> in(w, h, d), exterior(w, h, d), dilated(w, h, d);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	in.load(surface);
+	timing.load_ms = elapsed_ms(start);
+
+	start = std::chrono::steady_clock::now();
+	layout_flood_fill(in, exterior);
+	timing.flood_ms = elapsed_ms(start);
+
+	start = std::chrono::steady_clock::now();
+	layout_dilate(in, dilated);
+	timing.dilate_ms = elapsed_ms(start);
+
+	exterior.store(*timing.exterior);
+	dilated.store(*timing.dilated);
+}
+
+// the pdep/pext variants, compiled for BMI2 so the encoder inlines into the kernels
+#if MORTON_X86
+__attribute__((target("bmi2"), flatten))
+static void run_tiled4_bmi2(const CompFab::VoxelGrid &surface, Timing &timing) { run_layout<TiledLayout<2, MortonBmi2> >(surface, timing); }
+__attribute__((target("bmi2"), flatten))
+static void run_tiled8_bmi2(const CompFab::VoxelGrid &surface, Timing &timing) { run_layout<TiledLayout<3, MortonBmi2> >(surface, timing); }
+__attribute__((target("bmi2"), flatten))
+static void run_morton_bmi2(const CompFab::VoxelGrid &surface, Timing &timing) { run_layout<MortonLayout<MortonBmi2> >(surface, timing); }
+#endif
+
+static bool same(const CompFab::VoxelGrid &a, const CompFab::VoxelGrid &b)
+{
+	for (size_t w = 0; w < a.m_numWords; ++w)
+		if (a.m_insideArray[w] != b.m_insideArray[w]) return false;
+	return true;
+}
+
+struct Result {
+	std::string mesh;
+	int resolution;
+	size_t surface;
+	std::vector<Timing> timings;
+	std::vector<bool> matches;
+};
+
+static void write_json(std::ostream &out, const std::vector<Result> &results)
+{
+	out << std::fixed << std::setprecision(3);
+	out << "{\n";
+	out << "  \"benchmark\": \"layout_bench\",\n";
+	out << "  \"bmi2\": " << (morton_bmi2_supported() ? "true" : "false") << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Result &r = results[i];
+		for (size_t l = 0; l < r.timings.size(); ++l) {
+			const Timing &t = r.timings[l];
+			out << "    {\"mesh\": \"" << r.mesh << "\", \"resolution\": " << r.resolution << ", \"surface\": " << r.surface
+				<< ", \"layout\": \"" << t.layout << "\", \"load_ms\": " << t.load_ms << ", \"flood_ms\": " << t.flood_ms
+				<< ", \"dilate_ms\": " << t.dilate_ms << ", \"matches\": " << (r.matches[l] ? "true" : "false") << "}"
+				<< (i + 1 < results.size() || l + 1 < r.timings.size() ? ",\n" : "\n");
+		}
+	}
+	out << "  ]\n";
+	out << "}\n";
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<int> resolutions = parse_list("128,256");
+	std::string json_path;
+	std::vector<std::string> files;
+
+	VoxelizerArgs args;
+	args.verbosity = 0;
+	args.format = binvox;
+	args.backend = cpu;
+	args.mode = surface;
+	args.double_thick = false;
+	args.bricks = false;
+	args.separating = 26;
+	args.close = 0;
+	args.mesh_cache = true;
+	args.samples = -1;
+	args.seed = 0;
+	args.threads = 0;
+	args.max_memory = 0;
+	args.sparse = false;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) resolutions = parse_list(argv[++i]);
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) args.threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) json_path = argv[++i];
+		else files.push_back(argv[i]);
+	}
+	if (files.empty())
+		for (size_t i = 0; i < sizeof(DEFAULT_FILES) / sizeof(DEFAULT_FILES[0]); ++i)
+			files.push_back(std::string(VOXELIZER_DATA_DIR) + "/" + DEFAULT_FILES[i]);
+	ThreadPool::set_global_threads(args.threads);
+
+	bool bmi2 = morton_bmi2_supported();
+	std::cout << "bmi2: " << (bmi2 ? "yes" : "no, magic numbers only") << "\n\n";
+	std::cout << std::left << std::setw(10) << "mesh" << std::right << std::setw(6) << "res"
+		<< std::setw(10) << "surface" << "  " << std::left << std::setw(14) << "layout" << std::right
+		<< std::setw(10) << "load ms" << std::setw(10) << "flood ms" << std::setw(11) << "dilate ms" << "\n";
+
+	std::streambuf *out = std::cout.rdbuf();
+	std::ofstream null_stream;
+	std::vector<Result> results;
+
+	for (size_t f = 0; f < files.size(); ++f) {
+		std::cout.rdbuf(null_stream.rdbuf());
+		Voxelizer voxelizer;
+		bool loaded = voxelizer.load(files[f].c_str(), args.mesh_cache);
+		std::cout.rdbuf(out);
+		if (!loaded) {
+			std::cout << "failed to load " << files[f] << "\n";
+			continue;
+		}
+
+		for (size_t r = 0; r < resolutions.size(); ++r) {
+			args.size = resolutions[r];
+			CompFab::VoxelGrid *voxels = voxelizer.newGrid(args.size);
+			voxelizer.voxelize(args, *voxels);
+			const CompFab::VoxelGrid &grid = *voxels;
+
+			Result result;
+			result.mesh = mesh_name(files[f]);
+			result.resolution = args.size;
+			result.surface = grid.count();
+
+			std::vector<std::string> names;
+			std::vector<void (*)(const CompFab::VoxelGrid &, Timing &)> runs;
+			names.push_back("linear");        runs.push_back(run_layout<LinearLayout>);
+			names.push_back("tiled4 magic");  runs.push_back(run_layout<TiledLayout<2, MortonMagic> >);
+			names.push_back("tiled8 magic");  runs.push_back(run_layout<TiledLayout<3, MortonMagic> >);
+			names.push_back("morton magic");  runs.push_back(run_layout<MortonLayout<MortonMagic> >);
+#if MORTON_X86
+			if (bmi2) {
+				names.push_back("tiled4 bmi2"); runs.push_back(run_tiled4_bmi2);
+				names.push_back("tiled8 bmi2"); runs.push_back(run_tiled8_bmi2);
+				names.push_back("morton bmi2"); runs.push_back(run_morton_bmi2);
+			}
+#endif
+
+			for (size_t l = 0; l < runs.size(); ++l) {
+				Timing timing;
+				timing.layout = names[l];
+				timing.exterior = new CompFab::VoxelGrid(grid.m_lowerLeft, grid.m_dimX, grid.m_dimY, grid.m_dimZ, grid.m_spacing);
+				timing.dilated = new CompFab::VoxelGrid(grid.m_lowerLeft, grid.m_dimX, grid.m_dimY, grid.m_dimZ, grid.m_spacing);
+				runs[l](grid, timing);
+
+				bool matches = l == 0 || (same(*timing.exterior, *result.timings[0].exterior) && same(*timing.dilated, *result.timings[0].dilated));
+				result.timings.push_back(timing);
+				result.matches.push_back(matches);
+
+				std::cout << std::left << std::setw(10) << result.mesh << std::right << std::setw(6) << result.resolution
+					<< std::setw(10) << result.surface << "  " << std::left << std::setw(14) << timing.layout << std::right
+					<< std::fixed << std::setprecision(1) << std::setw(10) << timing.load_ms << std::setw(10) << timing.flood_ms
+					<< std::setw(11) << timing.dilate_ms << (matches ? "" : "  differs from linear!") << std::endl;
+			}
+			for (size_t l = 0; l < result.timings.size(); ++l) {
+				delete result.timings[l].exterior;
+				delete result.timings[l].dilated;
+			}
+			results.push_back(result);
+			delete voxels;
+		}
+	}
+
+	if (!json_path.empty()) {
+		std::ofstream json(json_path.c_str());
+		write_json(json, results);
+		if (!json) {
+			std::cerr << "could not write " << json_path << "\n";
+			return 1;
+		}
+		std::cout << "\nwrote " << json_path << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,138 @@
+// Compares the memory mapped, parallel .obj reader against the std::stream based
+// Mesh::read_obj on the bundled meshes (or the files given on the command line).
+//
+//   ./bin/obj_loader_bench [-n repeats] [-t threads] [file.obj ...]
+
+#include "includes/Mesh.h"
+#include "includes/ObjReader.h"
+#include "includes/ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef VOXELIZER_DATA_DIR
+#define VOXELIZER_DATA_DIR "data"
+#endif
+
+static const char *DEFAULT_FILES[] = {
+	"sphere/sphere.obj", "teapot/teapot.obj", "head/head.obj",
+	"bunny/bunny.obj", "dragon/dragon2.obj"
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double median(std::vector<double> times)
+{
+	std::sort(times.begin(), times.end());
+	size_t n = times.size();
+	return n % 2 ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+}
+
+static bool same_vec3(const std::vector<CompFab::Vec3> &a, const std::vector<CompFab::Vec3> &b)
+{
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); ++i)
+		for (int d = 0; d < 3; ++d)
+			if (a[i][d] != b[i][d]) return false;
+	return true;
+}
+
+static bool same_vec3i(const std::vector<CompFab::Vec3i> &a, const std::vector<CompFab::Vec3i> &b)
+{
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); ++i)
+		for (int d = 0; d < 3; ++d)
+			if (a[i][d] != b[i][d]) return false;
+	return true;
+}
+
+static bool same_vec2f(const std::vector<CompFab::Vec2f> &a, const std::vector<CompFab::Vec2f> &b)
+{
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); ++i)
+		if (a[i][0] != b[i][0] || a[i][1] != b[i][1]) return false;
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	int repeats = 5;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) repeats = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) ThreadPool::set_global_threads(atoi(argv[++i]));
+		else files.push_back(argv[i]);
+	}
+	if (files.empty())
+		for (size_t i = 0; i < sizeof(DEFAULT_FILES) / sizeof(DEFAULT_FILES[0]); ++i)
+			files.push_back(std::string(VOXELIZER_DATA_DIR) + "/" + DEFAULT_FILES[i]);
+
+	std::cout << "threads: " << ThreadPool::global().size() << ", repeats: " << repeats << "\n\n";
+	std::cout << std::left << std::setw(24) << "file" << std::right
+		<< std::setw(10) << "MB" << std::setw(12) << "triangles"
+		<< std::setw(14) << "stream ms" << std::setw(14) << "mmap ms"
+		<< std::setw(10) << "speedup" << std::setw(10) << "output" << "\n";
+
+	// both readers print the triangle count, keep the table readable
+	std::streambuf *out = std::cout.rdbuf();
+	std::ofstream null_stream;
+
+	for (size_t f = 0; f < files.size(); ++f) {
+		std::vector<double> stream_ms, mapped_ms;
+		Mesh reference, mapped;
+		bool readable = true;
+
+		for (int r = 0; r < repeats && readable; ++r) {
+			Mesh a, b;
+			std::cout.rdbuf(null_stream.rdbuf());
+
+			bench_clock::time_point start = bench_clock::now();
+			std::ifstream in(files[f].c_str());
+			readable = in.good();
+			a.read_obj(in);
+			stream_ms.push_back(std::chrono::duration<double, std::milli>(bench_clock::now() - start).count());
+
+			start = bench_clock::now();
+			readable = read_obj_mapped(files[f].c_str(), b) && readable;
+			mapped_ms.push_back(std::chrono::duration<double, std::milli>(bench_clock::now() - start).count());
+
+			std::cout.rdbuf(out);
+			if (r == 0) {
+				reference = a;
+				reference.tex = a.tex;
+				reference.texId = a.texId;
+				mapped = b;
+				mapped.tex = b.tex;
+			}
+		}
+
+		std::string name = files[f].substr(files[f].find_last_of('/') + 1);
+		if (!readable) {
+			std::cout << std::left << std::setw(24) << name << "cannot open " << files[f] << "\n";
+			continue;
+		}
+
+		std::ifstream in(files[f].c_str(), std::ios::binary | std::ios::ate);
+		double mb = in.tellg() / (1024.0 * 1024.0);
+		// the stream reader mistakes the normal of v//n corners for a texture index,
+		// so only positions, triangles and texture coordinates are compared
+		bool same = same_vec3(reference.v, mapped.v) && same_vec3i(reference.t, mapped.t) && same_vec2f(reference.tex, mapped.tex);
+		double s = median(stream_ms), m = median(mapped_ms);
+
+		std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+			<< std::setw(10) << std::setprecision(2) << mb
+			<< std::setw(12) << mapped.t.size()
+			<< std::setw(14) << std::setprecision(2) << s
+			<< std::setw(14) << std::setprecision(2) << m
+			<< std::setw(9) << std::setprecision(1) << s / m << "x"
+			<< std::setw(10) << (same ? "same" : "DIFFERS") << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,204 @@
+// Compares the size of the sparse voxel octree output with binvox for the bundled
+// meshes (or the files given on the command line). Voxelizes each mesh, writes it
+// both ways, times building the octree, and reads the .svo back to check every
+// voxel against the grid.
+//
+//   ./bin/svo_bench [-r 128,256,512] [-m parity|ray|scanline|tiled|surface|flood] [-t threads]
+//                   [-o results.json] [file.obj ...]
+
+#include "includes/pipeline.h"
+#include "includes/SparseVoxelOctree.h"
+#include "includes/ThreadPool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef VOXELIZER_DATA_DIR
+#define VOXELIZER_DATA_DIR "data"
+#endif
+
+static const char *DEFAULT_FILES[] = {
+	"sphere/sphere.obj", "teapot/teapot.obj", "bunny/bunny.obj",
+	"head/head.obj", "dragon/dragon2.obj"
+};
+
+static std::vector<int> parse_list(const char *text)
+{
+	std::vector<int> values;
+	std::stringstream in(text);
+	std::string item;
+	while (std::getline(in, item, ','))
+		if (!item.empty()) values.push_back(atoi(item.c_str()));
+	return values;
+}
+
+static std::string mesh_name(const std::string &file)
+{
+	std::string name = file.substr(file.find_last_of('/') + 1);
+	return name.substr(0, name.find_last_of('.'));
+}
+
+static long file_size(const std::string &path)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file) return -1;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+struct Result {
+	std::string mesh;
+	int resolution;
+	size_t filled, nodes, leaves;
+	long binvox_bytes, svo_bytes;
+	double build_ms;
+	bool matches;
+};
+
+static void write_json(std::ostream &out, const VoxelizerArgs &args, const std::vector<Result> &results)
+{
+	out << std::fixed << std::setprecision(3);
+	out << "{\n";
+	out << "  \"benchmark\": \"svo_bench\",\n";
+	out << "  \"mode\": \"" << modeName(args.mode) << "\",\n";
+	out << "  \"threads\": " << ThreadPool::global().size() << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Result &r = results[i];
+		out << "    {\"mesh\": \"" << r.mesh << "\", \"resolution\": " << r.resolution << ", \"filled\": " << r.filled
+			<< ", \"nodes\": " << r.nodes << ", \"leaves\": " << r.leaves
+			<< ", \"binvox_bytes\": " << r.binvox_bytes << ", \"svo_bytes\": " << r.svo_bytes
+			<< ", \"ratio\": " << (double) r.binvox_bytes / r.svo_bytes << ", \"build_ms\": " << r.build_ms
+			<< ", \"matches\": " << (r.matches ? "true" : "false") << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n";
+	out << "}\n";
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<int> resolutions = parse_list("128,256,512");
+	std::string json_path;
+	std::string output = "svo_bench_output";
+	std::vector<std::string> files;
+
+	VoxelizerArgs args;
+	args.verbosity = 0;
+	args.format = binvox;
+	args.backend = cpu;
+	args.mode = parity;
+	args.double_thick = false;
+	args.bricks = false;
+	args.separating = 26;
+	args.close = 0;
+	args.mesh_cache = true;
+	args.samples = -1;
+	args.seed = 0;
+	args.threads = 0;
+	args.max_memory = 0;
+	args.sparse = false;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) resolutions = parse_list(argv[++i]);
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			++i;
+			args.mode = strcmp(argv[i], "scanline") == 0 ? scanline : strcmp(argv[i], "tiled") == 0 ? tiled
+				: strcmp(argv[i], "ray") == 0 ? ray : strcmp(argv[i], "surface") == 0 ? surface
+				: strcmp(argv[i], "flood") == 0 ? flood : parity;
+		}
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) args.threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) json_path = argv[++i];
+		else files.push_back(argv[i]);
+	}
+	if (files.empty())
+		for (size_t i = 0; i < sizeof(DEFAULT_FILES) / sizeof(DEFAULT_FILES[0]); ++i)
+			files.push_back(std::string(VOXELIZER_DATA_DIR) + "/" + DEFAULT_FILES[i]);
+	ThreadPool::set_global_threads(args.threads);
+
+	std::cout << "threads: " << ThreadPool::global().size() << ", mode: " << modeName(args.mode) << "\n\n";
+	std::cout << std::left << std::setw(10) << "mesh" << std::right << std::setw(6) << "res"
+		<< std::setw(12) << "nodes" << std::setw(12) << "leaves" << std::setw(14) << "binvox KiB"
+		<< std::setw(12) << "svo KiB" << std::setw(9) << "ratio" << std::setw(12) << "build ms" << "\n";
+
+	std::streambuf *out = std::cout.rdbuf();
+	std::ofstream null_stream;
+	std::vector<Result> results;
+
+	for (size_t f = 0; f < files.size(); ++f) {
+		std::cout.rdbuf(null_stream.rdbuf());
+		Voxelizer voxelizer;
+		bool loaded = voxelizer.load(files[f].c_str(), args.mesh_cache);
+		std::cout.rdbuf(out);
+		if (!loaded) {
+			std::cout << "failed to load " << files[f] << "\n";
+			continue;
+		}
+
+		for (size_t r = 0; r < resolutions.size(); ++r) {
+			args.size = resolutions[r];
+			CompFab::VoxelGrid *voxels = voxelizer.newGrid(args.size);
+			voxelizer.voxelize(args, *voxels);
+			voxels->save_binvox((output + ".binvox").c_str());
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			SparseVoxelOctree tree;
+			tree.build(*voxels);
+			double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			tree.save((output + ".svo").c_str());
+
+			// every voxel of the file read back has to match the grid
+			SparseVoxelOctree read;
+			bool matches = read.load((output + ".svo").c_str());
+			const CompFab::VoxelGrid &grid = *voxels;
+			for (unsigned int k = 0; matches && k < grid.m_dimZ; ++k)
+				for (unsigned int j = 0; matches && j < grid.m_dimY; ++j)
+					for (unsigned int i = 0; i < grid.m_dimX; ++i)
+						if (read.isInside(i, j, k) != grid.isInside(i, j, k)) {
+							matches = false;
+							break;
+						}
+
+			Result result;
+			result.mesh = mesh_name(files[f]);
+			result.resolution = args.size;
+			result.filled = grid.count();
+			result.nodes = tree.nodes();
+			result.leaves = tree.leaves();
+			result.binvox_bytes = file_size(output + ".binvox");
+			result.svo_bytes = file_size(output + ".svo");
+			result.build_ms = build_ms;
+			result.matches = matches;
+			results.push_back(result);
+			delete voxels;
+
+			std::cout << std::left << std::setw(10) << result.mesh << std::right << std::setw(6) << result.resolution
+				<< std::setw(12) << result.nodes << std::setw(12) << result.leaves << std::fixed << std::setprecision(1)
+				<< std::setw(14) << result.binvox_bytes / 1024.0 << std::setw(12) << result.svo_bytes / 1024.0
+				<< std::setprecision(2) << std::setw(9) << (double) result.binvox_bytes / result.svo_bytes
+				<< std::setw(12) << result.build_ms << (result.matches ? "" : "  svo differs!") << std::endl;
+		}
+	}
+	remove((output + ".binvox").c_str());
+	remove((output + ".svo").c_str());
+
+	if (!json_path.empty()) {
+		std::ofstream json(json_path.c_str());
+		write_json(json, args, results);
+		if (!json) {
+			std::cerr << "could not write " << json_path << "\n";
+			return 1;
+		}
+		std::cout << "\nwrote " << json_path << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,285 @@
+// Compares the memory behaviour of the +X parity engines on the CPU: the voxel-major
+// loop testing every triangle per ray, the voxel-major BVH walk, and the
+// triangle-major tiled sweep. Reports throughput and, where the kernel lets us
+// open hardware counters, cycles, L1 data cache and last level cache misses per ray.
+// Runs on one thread so the counters of the calling thread see all the work. All
+// engines test triangles with the same SIMD kernels, only the loop order differs.
+//
+//   ./bin/traversal_bench [-n repeats] [-r 32,48] [-m voxel,bvh,tiled] [-o results.json] [file.obj ...]
+
+#include "includes/pipeline.h"
+#include "includes/ThreadPool.h"
+#include "includes/voxelize_cpu.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef VOXELIZER_DATA_DIR
+#define VOXELIZER_DATA_DIR "data"
+#endif
+
+static const char *DEFAULT_FILES[] = {
+	"sphere/sphere.obj", "teapot/teapot.obj", "head/head.obj", "bunny/bunny.obj"
+};
+
+static const char *COUNTERS[] = {"cycles", "instructions", "l1d_misses", "llc_misses"};
+enum { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, NUM_COUNTERS };
+
+// hardware counters of the calling thread, unavailable ones read as -1
+class PerfCounters {
+public:
+	PerfCounters()
+	{
+		for (int c = 0; c < NUM_COUNTERS; ++c) m_fd[c] = -1;
+#ifdef __linux__
+		open_counter(CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		open_counter(INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		open_counter(L1D_MISSES, PERF_TYPE_HW_CACHE,
+			PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+		open_counter(LLC_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+	}
+
+	~PerfCounters()
+	{
+#ifdef __linux__
+		for (int c = 0; c < NUM_COUNTERS; ++c)
+			if (m_fd[c] >= 0) close(m_fd[c]);
+#endif
+	}
+
+	bool any() const
+	{
+		for (int c = 0; c < NUM_COUNTERS; ++c)
+			if (m_fd[c] >= 0) return true;
+		return false;
+	}
+
+	void start()
+	{
+#ifdef __linux__
+		for (int c = 0; c < NUM_COUNTERS; ++c)
+			if (m_fd[c] >= 0) {
+				ioctl(m_fd[c], PERF_EVENT_IOC_RESET, 0);
+				ioctl(m_fd[c], PERF_EVENT_IOC_ENABLE, 0);
+			}
+#endif
+	}
+
+	void stop(long long values[NUM_COUNTERS])
+	{
+		for (int c = 0; c < NUM_COUNTERS; ++c) {
+			values[c] = -1;
+#ifdef __linux__
+			if (m_fd[c] < 0) continue;
+			ioctl(m_fd[c], PERF_EVENT_IOC_DISABLE, 0);
+			long long value;
+			if (read(m_fd[c], &value, sizeof(value)) == sizeof(value)) values[c] = value;
+#endif
+		}
+	}
+
+private:
+#ifdef __linux__
+	void open_counter(int c, unsigned int type, unsigned long long config)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		m_fd[c] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+#endif
+
+	int m_fd[NUM_COUNTERS];
+};
+
+enum Engine { VOXEL_MAJOR, BVH_WALK, TILED, NUM_ENGINES };
+static const char *ENGINES[] = {"voxel", "bvh", "tiled"};
+
+static void run_engine(Engine engine, const Voxelizer &voxelizer, CompFab::VoxelGrid *grid)
+{
+	int dim = grid->m_dimX;
+	if (engine == TILED)
+		cpu_tiled_wrapper(dim, dim, dim, grid, voxelizer.triangles(), false);
+	else
+		cpu_kernel_wrapper(0, dim, dim, dim, grid, voxelizer.triangles(), false, engine == BVH_WALK ? &voxelizer.bvh() : NULL);
+}
+
+static std::vector<int> parse_list(const char *text)
+{
+	std::vector<int> values;
+	std::stringstream in(text);
+	std::string item;
+	while (std::getline(in, item, ','))
+		if (!item.empty()) values.push_back(atoi(item.c_str()));
+	return values;
+}
+
+static std::string mesh_name(const std::string &file)
+{
+	std::string name = file.substr(file.find_last_of('/') + 1);
+	return name.substr(0, name.find_last_of('.'));
+}
+
+struct Result {
+	std::string mesh;
+	int resolution;
+	Engine engine;
+	size_t triangles;
+	// median wall time and the counters of that run
+	double ms;
+	long long counters[NUM_COUNTERS];
+	bool matches;
+};
+
+static void write_json(std::ostream &out, int repeats, const std::vector<Result> &results)
+{
+	out << std::fixed << std::setprecision(3);
+	out << "{\n";
+	out << "  \"benchmark\": \"traversal_bench\",\n";
+	out << "  \"threads\": 1,\n";
+	out << "  \"repeats\": " << repeats << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Result &r = results[i];
+		double rays = (double) r.resolution * r.resolution * r.resolution;
+		out << "    {\"mesh\": \"" << r.mesh << "\", \"triangles\": " << r.triangles
+			<< ", \"resolution\": " << r.resolution << ", \"engine\": \"" << ENGINES[r.engine] << "\""
+			<< ", \"ms\": " << r.ms << ", \"mrays_per_s\": " << rays / r.ms / 1e3
+			<< ", \"matches\": " << (r.matches ? "true" : "false");
+		for (int c = 0; c < NUM_COUNTERS; ++c) {
+			out << ", \"" << COUNTERS[c] << "\": ";
+			if (r.counters[c] < 0) out << "null";
+			else out << r.counters[c];
+		}
+		out << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n";
+	out << "}\n";
+}
+
+int main(int argc, char *argv[])
+{
+	int repeats = 3;
+	std::vector<int> resolutions = parse_list("32,48");
+	std::vector<bool> engines(NUM_ENGINES, true);
+	std::string json_path;
+	std::vector<std::string> files;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) repeats = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) resolutions = parse_list(argv[++i]);
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			std::string list = std::string(",") + argv[++i] + ",";
+			for (int e = 0; e < NUM_ENGINES; ++e)
+				engines[e] = list.find(std::string(",") + ENGINES[e] + ",") != std::string::npos;
+		}
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) json_path = argv[++i];
+		else files.push_back(argv[i]);
+	}
+	if (files.empty())
+		for (size_t i = 0; i < sizeof(DEFAULT_FILES) / sizeof(DEFAULT_FILES[0]); ++i)
+			files.push_back(std::string(VOXELIZER_DATA_DIR) + "/" + DEFAULT_FILES[i]);
+	ThreadPool::set_global_threads(1);
+
+	PerfCounters perf;
+	if (!perf.any())
+		std::cout << "hardware counters unavailable (see /proc/sys/kernel/perf_event_paranoid), timing only\n";
+	std::cout << std::left << std::setw(10) << "mesh" << std::right << std::setw(6) << "res" << std::setw(8) << "engine"
+		<< std::setw(12) << "ms" << std::setw(10) << "Mrays/s" << std::setw(14) << "cycles/ray"
+		<< std::setw(14) << "L1D miss/ray" << std::setw(14) << "LLC miss/ray" << "\n";
+
+	std::streambuf *out = std::cout.rdbuf();
+	std::ofstream null_stream;
+	std::vector<Result> results;
+
+	for (size_t f = 0; f < files.size(); ++f) {
+		std::cout.rdbuf(null_stream.rdbuf());
+		Voxelizer voxelizer;
+		bool loaded = voxelizer.load(files[f].c_str());
+		std::cout.rdbuf(out);
+		if (!loaded) {
+			std::cout << "failed to load " << files[f] << "\n";
+			continue;
+		}
+
+		for (size_t r = 0; r < resolutions.size(); ++r) {
+			int dim = resolutions[r];
+			CompFab::VoxelGrid *grid = voxelizer.newGrid(dim);
+			std::vector<CompFab::Word> reference;
+
+			for (int e = 0; e < NUM_ENGINES; ++e) {
+				if (!engines[e]) continue;
+				std::vector<std::pair<double, std::vector<long long> > > runs;
+				for (int i = 0; i < repeats; ++i) {
+					long long counters[NUM_COUNTERS];
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					perf.start();
+					run_engine((Engine) e, voxelizer, grid);
+					perf.stop(counters);
+					double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+					runs.push_back(std::make_pair(ms, std::vector<long long>(counters, counters + NUM_COUNTERS)));
+				}
+				std::sort(runs.begin(), runs.end());
+
+				Result result;
+				result.mesh = mesh_name(files[f]);
+				result.resolution = dim;
+				result.engine = (Engine) e;
+				result.triangles = voxelizer.triangles().size();
+				result.ms = runs[runs.size() / 2].first;
+				std::copy(runs[runs.size() / 2].second.begin(), runs[runs.size() / 2].second.end(), result.counters);
+
+				// every engine has to produce the same grid as the first one
+				std::vector<CompFab::Word> words(grid->m_insideArray, grid->m_insideArray + grid->m_numWords);
+				if (reference.empty()) reference = words;
+				result.matches = words == reference;
+
+				double rays = (double) dim * dim * dim;
+				std::cout << std::left << std::setw(10) << result.mesh << std::right << std::setw(6) << dim
+					<< std::setw(8) << ENGINES[e] << std::fixed << std::setprecision(2)
+					<< std::setw(12) << result.ms << std::setw(10) << rays / result.ms / 1e3;
+				for (int c = 0; c < NUM_COUNTERS; ++c) {
+					if (c == INSTRUCTIONS) continue;
+					if (result.counters[c] < 0) std::cout << std::setw(14) << "n/a";
+					else std::cout << std::setw(14) << result.counters[c] / rays;
+				}
+				std::cout << (result.matches ? "" : "  grid differs!") << std::endl;
+				results.push_back(result);
+			}
+			delete grid;
+		}
+	}
+
+	if (!json_path.empty()) {
+		std::ofstream json(json_path.c_str());
+		write_json(json, repeats, results);
+		if (!json) {
+			std::cerr << "could not write " << json_path << "\n";
+			return 1;
+		}
+		std::cout << "\nwrote " << json_path << "\n";
+	}
+	return 0;
+}
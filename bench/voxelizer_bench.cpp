@@ -0,0 +1,269 @@
+// Times the phases of a voxelizer run (load, setup, voxelize, save) on the bundled
+// meshes (or the files given on the command line) for every combination of
+// resolution and sample count, and writes the wall time statistics to JSON.
+//
+//   ./bin/voxelizer_bench [-n repeats] [-w warmups] [-r 32,64,128] [-s 0,3]
+//                         [-m ray|scanline|tiled|parity|surface|flood] [-b cpu|cuda] [-f binvox|obj|raw|svo]
+//                         [-t threads] [--no-mesh-cache] [--bricks] [-o results.json] [file.obj ...]
+
+#include "includes/pipeline.h"
+#include "includes/ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef VOXELIZER_DATA_DIR
+#define VOXELIZER_DATA_DIR "data"
+#endif
+
+static const char *DEFAULT_FILES[] = {
+	"sphere/sphere.obj", "teapot/teapot.obj", "bunny/bunny.obj",
+	"head/head.obj", "dragon/dragon2.obj"
+};
+
+static const char *PHASES[] = {"load", "setup", "voxelize", "save", "total"};
+enum { LOAD, SETUP, VOXELIZE, SAVE, TOTAL, NUM_PHASES };
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ms(bench_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+// linearly interpolated percentile of sorted values, p in [0, 100]
+static double percentile(const std::vector<double> &sorted, double p)
+{
+	if (sorted.empty()) return 0;
+	double rank = p / 100 * (sorted.size() - 1);
+	size_t lo = (size_t) rank;
+	size_t hi = std::min(lo + 1, sorted.size() - 1);
+	return sorted[lo] + (rank - lo) * (sorted[hi] - sorted[lo]);
+}
+
+static std::vector<int> parse_list(const char *text)
+{
+	std::vector<int> values;
+	std::stringstream in(text);
+	std::string item;
+	while (std::getline(in, item, ','))
+		if (!item.empty()) values.push_back(atoi(item.c_str()));
+	return values;
+}
+
+static std::string mesh_name(const std::string &file)
+{
+	std::string name = file.substr(file.find_last_of('/') + 1);
+	return name.substr(0, name.find_last_of('.'));
+}
+
+static std::string json_string(const std::string &text)
+{
+	std::string out = "\"";
+	for (size_t i = 0; i < text.size(); ++i) {
+		if (text[i] == '"' || text[i] == '\\') out += '\\';
+		out += text[i];
+	}
+	return out + "\"";
+}
+
+struct Result {
+	std::string file;
+	int resolution, samples;
+	size_t triangles, filled;
+	std::vector<double> times[NUM_PHASES];
+};
+
+// one run of the pipeline, the times of its phases are appended to result
+static bool run(VoxelizerArgs &args, Result &result)
+{
+	bench_clock::time_point start = bench_clock::now(), phase = start;
+	Voxelizer voxelizer;
+	if (!voxelizer.load(args.input.c_str(), args.mesh_cache)) return false;
+	result.times[LOAD].push_back(elapsed_ms(phase));
+
+	phase = bench_clock::now();
+	CompFab::VoxelGrid *grid = voxelizer.newGrid(args.size);
+	result.times[SETUP].push_back(elapsed_ms(phase));
+
+	phase = bench_clock::now();
+	voxelizer.voxelize(args, *grid);
+	result.times[VOXELIZE].push_back(elapsed_ms(phase));
+
+	phase = bench_clock::now();
+	bool saved = save(&args, *grid);
+	result.times[SAVE].push_back(elapsed_ms(phase));
+	result.times[TOTAL].push_back(elapsed_ms(start));
+
+	result.triangles = voxelizer.triangles().size();
+	result.filled = grid->count();
+	delete grid;
+	return saved;
+}
+
+static void write_json(std::ostream &out, const VoxelizerArgs &args, int repeats, const std::vector<Result> &results)
+{
+	out << std::fixed << std::setprecision(3);
+	out << "{\n";
+	out << "  \"benchmark\": \"voxelizer_bench\",\n";
+	out << "  \"threads\": " << ThreadPool::global().size() << ",\n";
+	out << "  \"repeats\": " << repeats << ",\n";
+	out << "  \"backend\": \"" << (args.backend == cuda ? "cuda" : "cpu") << "\",\n";
+	out << "  \"mode\": \"" << modeName(args.mode) << "\",\n";
+	out << "  \"format\": \"" << (args.format == obj ? "obj" : args.format == raw ? "raw" : args.format == svo ? "svo" : "binvox") << "\",\n";
+	out << "  \"bricks\": " << (args.bricks ? "true" : "false") << ",\n";
+	out << "  \"mesh_cache\": " << (args.mesh_cache ? "true" : "false") << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Result &r = results[i];
+		out << "    {\n";
+		out << "      \"mesh\": " << json_string(mesh_name(r.file)) << ",\n";
+		out << "      \"file\": " << json_string(r.file) << ",\n";
+		out << "      \"triangles\": " << r.triangles << ",\n";
+		out << "      \"resolution\": " << r.resolution << ",\n";
+		out << "      \"samples\": " << r.samples << ",\n";
+		out << "      \"filled\": " << r.filled << ",\n";
+		out << "      \"phases_ms\": {\n";
+		for (int p = 0; p < NUM_PHASES; ++p) {
+			std::vector<double> sorted = r.times[p];
+			std::sort(sorted.begin(), sorted.end());
+			out << "        \"" << PHASES[p] << "\": {"
+				<< "\"min\": " << percentile(sorted, 0)
+				<< ", \"p10\": " << percentile(sorted, 10)
+				<< ", \"median\": " << percentile(sorted, 50)
+				<< ", \"p90\": " << percentile(sorted, 90)
+				<< ", \"max\": " << percentile(sorted, 100) << "}"
+				<< (p + 1 < NUM_PHASES ? ",\n" : "\n");
+		}
+		out << "      }\n";
+		out << "    }" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n";
+	out << "}\n";
+}
+
+int main(int argc, char *argv[])
+{
+	int repeats = 5, warmups = 1;
+	std::vector<int> resolutions = parse_list("32,64,128");
+	std::vector<int> sample_counts = parse_list("0,3");
+	std::string json_path = "voxelizer_bench.json";
+	std::vector<std::string> files;
+
+	VoxelizerArgs args;
+	args.verbosity = 0;
+	args.output = "voxelizer_bench_output";
+	args.format = binvox;
+	args.backend = cpu;
+	args.mode = ray;
+	args.double_thick = false;
+	args.bricks = false;
+	args.separating = 26;
+	args.close = 0;
+	args.mesh_cache = true;
+	args.seed = 0;
+	args.threads = 0;
+	args.max_memory = 0;
+	args.sparse = false;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) repeats = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) warmups = std::max(0, atoi(argv[++i]));
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) resolutions = parse_list(argv[++i]);
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) sample_counts = parse_list(argv[++i]);
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			++i;
+			args.mode = strcmp(argv[i], "scanline") == 0 ? scanline : strcmp(argv[i], "tiled") == 0 ? tiled
+				: strcmp(argv[i], "parity") == 0 ? parity : strcmp(argv[i], "surface") == 0 ? surface
+				: strcmp(argv[i], "flood") == 0 ? flood : ray;
+		}
+		else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) args.backend = (strcmp(argv[++i], "cuda") == 0 && USE_CUDA) ? cuda : cpu;
+		else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			char f = argv[++i][0];
+			args.format = f == 'o' ? obj : f == 'r' ? raw : f == 's' ? svo : binvox;
+		}
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) args.threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) json_path = argv[++i];
+		else if (strcmp(argv[i], "--no-mesh-cache") == 0) args.mesh_cache = false;
+		else if (strcmp(argv[i], "--bricks") == 0) args.bricks = true;
+		else files.push_back(argv[i]);
+	}
+	if (files.empty())
+		for (size_t i = 0; i < sizeof(DEFAULT_FILES) / sizeof(DEFAULT_FILES[0]); ++i)
+			files.push_back(std::string(VOXELIZER_DATA_DIR) + "/" + DEFAULT_FILES[i]);
+	ThreadPool::set_global_threads(args.threads);
+
+	std::cout << "threads: " << ThreadPool::global().size() << ", repeats: " << repeats
+		<< ", warmups: " << warmups << ", mode: " << modeName(args.mode) << "\n\n";
+	std::cout << std::left << std::setw(12) << "mesh" << std::right
+		<< std::setw(6) << "res" << std::setw(8) << "samples";
+	for (int p = 0; p < NUM_PHASES; ++p) std::cout << std::setw(12) << (std::string(PHASES[p]) + " ms");
+	std::cout << "\n";
+
+	// the mesh loaders print the triangle count, keep the table readable
+	std::streambuf *out = std::cout.rdbuf();
+	std::ofstream null_stream;
+
+	std::vector<Result> results;
+	for (size_t f = 0; f < files.size(); ++f)
+		for (size_t r = 0; r < resolutions.size(); ++r)
+			for (size_t s = 0; s < sample_counts.size(); ++s) {
+				Result result;
+				result.file = files[f];
+				result.resolution = resolutions[r];
+				result.samples = sample_counts[s];
+
+				args.input = files[f];
+				args.size = resolutions[r];
+				args.samples = sample_counts[s];
+				// only the ray mode takes samples
+				if (args.samples > 0 && args.mode != ray) continue;
+
+				bool ok = true;
+				std::cout.rdbuf(null_stream.rdbuf());
+				for (int i = 0; i < warmups && ok; ++i) {
+					Result warmup;
+					ok = run(args, warmup);
+				}
+				for (int i = 0; i < repeats && ok; ++i)
+					ok = run(args, result);
+				std::cout.rdbuf(out);
+
+				if (!ok) {
+					std::cout << std::left << std::setw(12) << mesh_name(files[f]) << "failed on " << files[f] << "\n";
+					continue;
+				}
+
+				std::cout << std::left << std::setw(12) << mesh_name(files[f]) << std::right
+					<< std::setw(6) << result.resolution << std::setw(8) << result.samples
+					<< std::fixed << std::setprecision(2);
+				for (int p = 0; p < NUM_PHASES; ++p) {
+					std::vector<double> sorted = result.times[p];
+					std::sort(sorted.begin(), sorted.end());
+					std::cout << std::setw(12) << percentile(sorted, 50);
+				}
+				std::cout << "\n";
+				results.push_back(result);
+			}
+
+	const char *extensions[] = {".obj", ".binvox", ".raw", ".svo"};
+	remove((args.output + extensions[args.format]).c_str());
+
+	std::ofstream json(json_path.c_str());
+	write_json(json, args, repeats, results);
+	if (!json) {
+		std::cerr << "could not write " << json_path << "\n";
+		return 1;
+	}
+	std::cout << "\nwrote " << json_path << "\n";
+	return 0;
+}
@@ -0,0 +1,84 @@
+#include "includes/bricks.h"
+#include "includes/raycast.h"
+#include "includes/tribox.h"
+
+#include <algorithm>
+#include <cmath>
+
+// the brick boxes are grown so rounding never hides a triangle touching them
+#define BRICK_PADDING 1e-5f
+
+namespace {
+
+// the voxels [first, last] along an axis whose coordinate origin + spacing*index
+// lies within [lo, hi], clamped to [0, n). Empty when first > last.
+void overlapped_voxels(float lo, float hi, float origin, float spacing, int n, int &first, int &last)
+{
+	float pad = BRICK_PADDING * (1.f + std::max(fabsf(lo), fabsf(hi)));
+	first = std::max(0, (int) floorf((lo - pad - origin) / spacing));
+	last = std::min(n - 1, (int) ceilf((hi + pad - origin) / spacing));
+}
+
+}
+
+void SurfaceBricks::build(const CompFab::VoxelGrid &grid, const std::vector<CompFab::Triangle> &triangles)
+{
+	const int dims[3] = {(int) grid.m_dimX, (int) grid.m_dimY, (int) grid.m_dimZ};
+	const float spacing = grid.m_spacing;
+	// coordinates of voxel 0 of the grid, positions are origin + spacing*index
+	// exactly as the rays compute them
+	const float origin[3] = {
+		(float) grid.m_lowerLeft.m_x, (float) grid.m_lowerLeft.m_y,
+		(float) grid.m_lowerLeft.m_z + spacing*grid.m_firstZ
+	};
+
+	m_bricksX = (dims[0] + BRICK_SIZE - 1) / BRICK_SIZE;
+	m_bricksY = (dims[1] + BRICK_SIZE - 1) / BRICK_SIZE;
+	m_bricksZ = (dims[2] + BRICK_SIZE - 1) / BRICK_SIZE;
+	m_surface.assign((size_t) m_bricksX*m_bricksY*m_bricksZ, 0);
+	if (m_surface.empty()) return;
+
+	for (size_t i = 0; i < triangles.size(); ++i) {
+		const CompFab::Triangle &t = triangles[i];
+		vec3f a = make_vec3f(t.m_v1), b = make_vec3f(t.m_v2), c = make_vec3f(t.m_v3);
+
+		int first[3], last[3];
+		bool outside = false;
+		for (int axis = 0; axis < 3; ++axis) {
+			float lo = std::min(t.m_v1[axis], std::min(t.m_v2[axis], t.m_v3[axis]));
+			float hi = std::max(t.m_v1[axis], std::max(t.m_v2[axis], t.m_v3[axis]));
+			overlapped_voxels(lo, hi, origin[axis], spacing, dims[axis], first[axis], last[axis]);
+			outside |= first[axis] > last[axis];
+			first[axis] /= BRICK_SIZE;
+			last[axis] /= BRICK_SIZE;
+		}
+		if (outside) continue;
+
+		for (int bz = first[2]; bz <= last[2]; ++bz)
+			for (int by = first[1]; by <= last[1]; ++by)
+				for (int bx = first[0]; bx <= last[0]; ++bx) {
+					unsigned char &mark = m_surface[index(bx, by, bz)];
+					if (mark) continue;
+
+					// box spanned by the positions of the brick's voxels
+					int brick[3] = {bx, by, bz};
+					float lo[3], hi[3];
+					for (int axis = 0; axis < 3; ++axis) {
+						int v0 = brick[axis]*BRICK_SIZE, v1 = std::min(dims[axis], v0 + BRICK_SIZE) - 1;
+						lo[axis] = origin[axis] + spacing*v0;
+						hi[axis] = origin[axis] + spacing*v1;
+						float pad = BRICK_PADDING * (1.f + std::max(fabsf(lo[axis]), fabsf(hi[axis])));
+						lo[axis] -= pad;
+						hi[axis] += pad;
+					}
+					vec3f center = make_vec3f(0.5f*(lo[0] + hi[0]), 0.5f*(lo[1] + hi[1]), 0.5f*(lo[2] + hi[2]));
+					vec3f half = make_vec3f(0.5f*(hi[0] - lo[0]), 0.5f*(hi[1] - lo[1]), 0.5f*(hi[2] - lo[2]));
+					if (triangle_box_overlap(center, half, a, b, c)) mark = 1;
+				}
+	}
+}
+
+size_t SurfaceBricks::count() const
+{
+	return std::count(m_surface.begin(), m_surface.end(), 1);
+}
@@ -0,0 +1,506 @@
+#include "includes/daemon.h"
+#include "includes/BoundedQueue.h"
+#include "includes/GridPool.h"
+#include "includes/MappedFile.h"
+#include "includes/Profiler.h"
+#include "includes/ResultCache.h"
+#include "includes/ThreadPool.h"
+#include "includes/VoxelizerCache.h"
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <iomanip>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// longest request line, and most triangles a request may send inline
+const size_t max_line = 1 << 16;
+const long max_inline_triangles = 1L << 25;
+// how often the accept loop looks for a stop
+const int stop_poll_ms = 200;
+
+volatile sig_atomic_t stop_signal = 0;
+
+void on_stop_signal(int)
+{
+	stop_signal = 1;
+}
+
+// a client socket, read by lines and by blocks
+class Connection {
+public:
+	explicit Connection(int fd) : m_fd(fd), m_begin(0), m_end(0) {}
+
+	// false at the end of the stream or for a line too long
+	bool readLine(std::string &line)
+	{
+		line.clear();
+		for (;;) {
+			if (m_begin == m_end && !fill()) return false;
+			const char *newline = (const char *) memchr(m_buffer + m_begin, '\n', m_end - m_begin);
+			size_t n = (newline ? newline - m_buffer : m_end) - m_begin;
+			line.append(m_buffer + m_begin, n);
+			m_begin += n;
+			if (newline) {
+				++m_begin;
+				if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+				return true;
+			}
+			if (line.size() > max_line) return false;
+		}
+	}
+
+	bool read(void *data, size_t size)
+	{
+		char *out = (char *) data;
+		while (size > 0) {
+			if (m_begin == m_end && !fill()) return false;
+			size_t n = std::min(size, m_end - m_begin);
+			memcpy(out, m_buffer + m_begin, n);
+			m_begin += n;
+			out += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	// reads and drops size bytes
+	bool skip(size_t size)
+	{
+		while (size > 0) {
+			if (m_begin == m_end && !fill()) return false;
+			size_t n = std::min(size, m_end - m_begin);
+			m_begin += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	bool writeLine(const std::string &line)
+	{
+		std::string data = line + "\n";
+		size_t sent = 0;
+		while (sent < data.size()) {
+			ssize_t n = send(m_fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			sent += n;
+		}
+		return true;
+	}
+
+private:
+	bool fill()
+	{
+		for (;;) {
+			ssize_t n = recv(m_fd, m_buffer, sizeof(m_buffer), 0);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			m_begin = 0;
+			m_end = n;
+			return true;
+		}
+	}
+
+	int m_fd;
+	char m_buffer[1 << 16];
+	size_t m_begin, m_end;
+};
+
+struct DaemonJob {
+	// a mesh file, or the vertices of triangles sent inline, 9 per triangle
+	std::string mesh;
+	std::vector<float> vertices;
+	// a path without the extension, or "shm"
+	std::string output;
+	VoxelizeOptions options;
+	int size;
+	FileFormat format;
+	std::promise<std::string> reply;
+};
+
+struct Daemon {
+	Daemon(VoxelizerArgs *args)
+		: args(args), meshes(args->cached_meshes), grids((size_t) DAEMON_POOL_MEMORY << 20),
+		results_cache(args->result_cache.empty() ? NULL : new ResultCache(args->result_cache, (size_t) args->result_cache_size << 20)),
+		jobs(DAEMON_QUEUE_DEPTH), done(0), failed(0), results(0), stopping(false) {}
+
+	VoxelizerArgs *args;
+	VoxelizerCache meshes;
+	GridPool grids;
+	// grids of earlier runs and jobs on disk, NULL without --result-cache
+	std::unique_ptr<ResultCache> results_cache;
+	BoundedQueue<DaemonJob *> jobs;
+	std::atomic<size_t> done, failed, results;
+	std::atomic<bool> stopping;
+};
+
+struct Client {
+	Client(int fd) : fd(fd), finished(false) {}
+
+	int fd;
+	std::thread thread;
+	std::atomic<bool> finished;
+};
+
+bool parse_number(const std::string &value, long &number)
+{
+	char *end = NULL;
+	errno = 0;
+	number = strtol(value.c_str(), &end, 10);
+	return !value.empty() && *end == '\0' && errno == 0;
+}
+
+bool parse_mode(const std::string &value, VoxelizeMode &mode)
+{
+	for (int m = ray; m <= flood; ++m)
+		if (value == modeName((VoxelizeMode) m)) {
+			mode = (VoxelizeMode) m;
+			return true;
+		}
+	return false;
+}
+
+bool parse_format(const std::string &value, FileFormat &format)
+{
+	for (int f = obj; f <= svo; ++f)
+		if (value == formatExtension((FileFormat) f)) {
+			format = (FileFormat) f;
+			return true;
+		}
+	return false;
+}
+
+// the fields of a voxelize request over the settings of the command line. Returns
+// the error of the first invalid field, after reading all of them for the count
+// of triangles that follow
+std::string parse_job(const VoxelizerArgs &args, std::istringstream &fields, DaemonJob &job, size_t &triangles)
+{
+	job.options = args;
+	job.size = args.size;
+	job.format = args.format;
+	triangles = 0;
+
+	std::string field, error;
+	while (fields >> field) {
+		size_t equals = field.find('=');
+		std::string key = field.substr(0, equals), value = equals == std::string::npos ? "" : field.substr(equals + 1);
+		long number = 0;
+		bool numeric = parse_number(value, number);
+		bool valid = true;
+		if (key == "mesh" && !value.empty()) job.mesh = value;
+		else if (key == "output" && !value.empty()) job.output = value;
+		else if (key == "triangles" && numeric && number > 0 && number <= max_inline_triangles) triangles = number;
+		else if (key == "resolution" && numeric && number > 2 && number <= DAEMON_MAX_RESOLUTION) job.size = number;
+		else if (key == "samples" && numeric && number >= INT_MIN && number <= INT_MAX) job.options.samples = number;
+		else if (key == "seed" && numeric && number >= 0 && number <= UINT_MAX) job.options.seed = number;
+		else if (key == "double" && numeric) job.options.double_thick = number != 0;
+		else if (key == "bricks" && numeric) job.options.bricks = number != 0;
+		else if (key == "separating" && numeric && (number == 6 || number == 26)) job.options.separating = number;
+		else if (key == "close" && numeric && number >= 0 && number <= DAEMON_MAX_RESOLUTION) job.options.close = number;
+		else if (key == "mode") valid = parse_mode(value, job.options.mode);
+		else if (key == "format") valid = parse_format(value, job.format);
+		else valid = false;
+		if (!valid && error.empty()) error = "invalid field " + field;
+	}
+	if (!error.empty()) return error;
+	if (job.mesh.empty() == (triangles == 0)) return "expected either mesh= or triangles=";
+	if (job.output.empty()) return "expected output=";
+
+	// what the command line falls back to for the combinations a mode does not support
+	VoxelizeOptions &options = job.options;
+	if (options.mode == surface || options.mode == flood) {
+		if (options.samples > 0) options.samples = -1;
+		options.backend = cpu;
+	} else if (options.mode != ray) {
+		if (options.samples > 0) options.mode = ray;
+		else options.backend = cpu;
+	}
+	if (options.mode != flood) options.close = 0;
+	if (options.mode != ray) options.bricks = false;
+	return "";
+}
+
+// copies the grid into a new shared memory object in the layout of the raw format
+bool write_shm(const std::string &name, const CompFab::VoxelGrid &grid)
+{
+	size_t bytes = grid.m_numWords*sizeof(CompFab::Word);
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0) return false;
+	bool ok = ftruncate(fd, bytes) == 0;
+	void *data = ok ? mmap(NULL, bytes, PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if (data != MAP_FAILED) {
+		memcpy(data, grid.m_insideArray, bytes);
+		munmap(data, bytes);
+	} else {
+		ok = false;
+	}
+	close(fd);
+	if (!ok) shm_unlink(name.c_str());
+	return ok;
+}
+
+VoxelizerCache::Entry find_mesh(Daemon &daemon, const DaemonJob &job, bool &cached)
+{
+	if (!job.vertices.empty()) {
+		uint64_t key = content_hash(&job.vertices[0], job.vertices.size()*sizeof(float), content_hash("inline", 6));
+		return daemon.meshes.get(key, [&]() -> VoxelizerCache::Entry {
+			std::vector<CompFab::Triangle> triangles;
+			triangles.reserve(job.vertices.size() / 9);
+			for (size_t i = 0; i < job.vertices.size(); i += 9) {
+				const float *v = &job.vertices[i];
+				CompFab::Vec3 v1(v[0], v[1], v[2]), v2(v[3], v[4], v[5]), v3(v[6], v[7], v[8]);
+				triangles.push_back(CompFab::Triangle(v1, v2, v3));
+			}
+			std::shared_ptr<Voxelizer> voxelizer(new Voxelizer());
+			voxelizer->setMesh(triangles);
+			return voxelizer;
+		}, cached);
+	}
+
+	MappedFile file;
+	if (!file.open(job.mesh.c_str())) return VoxelizerCache::Entry();
+	// the reader follows the extension, so the same bytes under another one are another mesh
+	std::string extension = job.mesh.substr(job.mesh.find_last_of('.') + 1);
+	uint64_t key = content_hash(file.data(), file.size(), content_hash(extension.data(), extension.size()));
+	file.close();
+	return daemon.meshes.get(key, [&]() -> VoxelizerCache::Entry {
+		std::shared_ptr<Voxelizer> voxelizer(new Voxelizer());
+		if (!voxelizer->load(job.mesh.c_str(), daemon.args->mesh_cache)) return VoxelizerCache::Entry();
+		return voxelizer;
+	}, cached);
+}
+
+std::string run_job(Daemon &daemon, DaemonJob &job)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool cached = false;
+	VoxelizerCache::Entry voxelizer = find_mesh(daemon, job, cached);
+	if (!voxelizer) return "error no triangles read from " + job.mesh;
+
+	CompFab::Vec3 lowerLeft;
+	double spacing;
+	voxelizer->placeGrid(job.size, lowerLeft, spacing);
+	CompFab::VoxelGrid *grid = daemon.grids.take(lowerLeft, job.size, job.size, job.size, spacing);
+	ResultCache *results = daemon.results_cache.get();
+	uint64_t key = results ? ResultCache::key(*voxelizer, job.options, job.size) : 0;
+	bool stored = results && results->load(key, *grid);
+	if (!stored) {
+		voxelizer->voxelize(job.options, *grid);
+		if (results) results->store(key, *grid);
+	}
+	size_t filled = grid->count();
+	Profiler::count(COUNT_VOXELS_FILLED, filled);
+
+	std::ostringstream reply;
+	reply << std::setprecision(9);
+	if (job.output == "shm") {
+		std::ostringstream name;
+		name << "/voxelizerd." << getpid() << "." << ++daemon.results;
+		if (write_shm(name.str(), *grid))
+			reply << "ok shm=" << name.str() << " bytes=" << grid->m_numWords*sizeof(CompFab::Word)
+				<< " dim=" << grid->m_dimX << "," << grid->m_dimY << "," << grid->m_dimZ
+				<< " translate=" << lowerLeft[0] << "," << lowerLeft[1] << "," << lowerLeft[2] << " scale=" << spacing;
+		else
+			reply << "error cannot create the shared memory " << name.str() << ": " << strerror(errno);
+	} else if (save(daemon.args, job.output, job.format, *grid)) {
+		reply << "ok file=" << job.output << "." << formatExtension(job.format);
+	} else {
+		reply << "error cannot write " << job.output << "." << formatExtension(job.format);
+	}
+	daemon.grids.give(grid);
+
+	if (reply.str().compare(0, 3, "ok ") != 0) return reply.str();
+	reply << " filled=" << filled << " ms=" << std::setprecision(4)
+		<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " cached=" << cached << " stored=" << stored;
+	return reply.str();
+}
+
+void job_worker(Daemon &daemon)
+{
+	DaemonJob *job;
+	while (daemon.jobs.pop(job)) {
+		std::string reply;
+		try {
+			reply = run_job(daemon, *job);
+		} catch (std::bad_alloc &) {
+			reply = "error out of memory";
+		}
+		if (reply.compare(0, 3, "ok ") == 0) ++daemon.done;
+		else ++daemon.failed;
+
+		std::ostringstream log;
+		if (job->mesh.empty()) log << job->vertices.size() / 9 << " inline triangles";
+		else log << job->mesh;
+		log << " @ " << job->size << " " << modeName(job->options.mode) << ": " << reply << "\n";
+		daemon.args->debug(1) << log.str() << std::flush;
+		job->reply.set_value(reply);
+	}
+}
+
+void serve(Daemon &daemon, int fd)
+{
+	Connection connection(fd);
+	std::string line;
+	while (!daemon.stopping && connection.readLine(line)) {
+		std::istringstream fields(line);
+		std::string request;
+		if (!(fields >> request)) continue;
+
+		std::string reply;
+		if (request == "voxelize") {
+			DaemonJob job;
+			size_t triangles = 0;
+			reply = parse_job(*daemon.args, fields, job, triangles);
+			// the vertices follow the line even when a field is invalid
+			if (triangles > 0) {
+				size_t bytes = triangles * 9 * sizeof(float);
+				try {
+					job.vertices.resize(triangles * 9);
+				} catch (std::bad_alloc &) {
+					// the job fails, the connection goes on after the vertices
+					if (reply.empty()) reply = "out of memory for the inline triangles";
+					if (!connection.skip(bytes)) break;
+					triangles = 0;
+				}
+				if (triangles > 0 && !connection.read(&job.vertices[0], bytes)) break;
+			}
+			if (reply.empty()) {
+				std::future<std::string> answer = job.reply.get_future();
+				reply = daemon.jobs.push(&job) ? answer.get() : "error shutting down";
+			} else {
+				reply = "error " + reply;
+				++daemon.failed;
+			}
+		} else if (request == "stats") {
+			size_t meshes, hits, misses;
+			daemon.meshes.counts(meshes, hits, misses);
+			std::ostringstream stats;
+			stats << "ok jobs=" << daemon.done << " failed=" << daemon.failed << " meshes=" << meshes << " hits=" << hits
+				<< " misses=" << misses << " grids=" << daemon.grids.allocated() << " reused=" << daemon.grids.reused();
+			if (daemon.results_cache)
+				stats << " stored_hits=" << daemon.results_cache->hits() << " stored_misses=" << daemon.results_cache->misses()
+					<< " stored_evicted=" << daemon.results_cache->evictions();
+			reply = stats.str();
+		} else if (request == "shutdown") {
+			daemon.stopping = true;
+			reply = "ok";
+		} else {
+			reply = "error unknown request " + request;
+		}
+		if (!connection.writeLine(reply)) break;
+	}
+}
+
+}
+
+bool runDaemon(VoxelizerArgs *args)
+{
+	const std::string &path = args->daemon;
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		args->debug(0) << "The socket path " << path << " is too long." << std::endl;
+		return false;
+	}
+	strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		args->debug(0) << "Could not create a socket: " << strerror(errno) << std::endl;
+		return false;
+	}
+	// a socket file nobody answers on is left from a daemon that did not shut down
+	if (connect(listen_fd, (sockaddr *) &address, sizeof(address)) == 0) {
+		args->debug(0) << "A daemon already listens on " << path << "." << std::endl;
+		close(listen_fd);
+		return false;
+	}
+	close(listen_fd);
+	unlink(path.c_str());
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0 || bind(listen_fd, (sockaddr *) &address, sizeof(address)) != 0 || listen(listen_fd, 64) != 0) {
+		args->debug(0) << "Could not listen on " << path << ": " << strerror(errno) << std::endl;
+		if (listen_fd >= 0) close(listen_fd);
+		return false;
+	}
+
+	struct sigaction action, previous_int, previous_term;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_stop_signal;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	stop_signal = 0;
+	sigaction(SIGINT, &action, &previous_int);
+	sigaction(SIGTERM, &action, &previous_term);
+
+	Daemon daemon(args);
+	std::vector<std::thread> workers;
+	for (int i = 0; i < DAEMON_JOBS; ++i) workers.push_back(std::thread(job_worker, std::ref(daemon)));
+	args->debug(0) << "Listening on " << path << " with " << ThreadPool::global().size() << " threads, keeping "
+		<< args->cached_meshes << " meshes." << std::endl;
+
+	std::list<std::unique_ptr<Client> > clients;
+	while (!stop_signal && !daemon.stopping) {
+		pollfd listening = { listen_fd, POLLIN, 0 };
+		int ready = poll(&listening, 1, stop_poll_ms);
+		for (std::list<std::unique_ptr<Client> >::iterator it = clients.begin(); it != clients.end();) {
+			if (!(*it)->finished) {
+				++it;
+				continue;
+			}
+			(*it)->thread.join();
+			close((*it)->fd);
+			it = clients.erase(it);
+		}
+		if (ready <= 0) continue;
+
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) continue;
+		Client *client = new Client(fd);
+		clients.push_back(std::unique_ptr<Client>(client));
+		client->thread = std::thread([&daemon, client]() {
+			serve(daemon, client->fd);
+			client->finished = true;
+		});
+	}
+
+	// stop taking connections, let the running jobs answer and wake the idle clients
+	daemon.stopping = true;
+	close(listen_fd);
+	unlink(path.c_str());
+	for (std::list<std::unique_ptr<Client> >::iterator it = clients.begin(); it != clients.end(); ++it)
+		shutdown((*it)->fd, SHUT_RD);
+	for (std::list<std::unique_ptr<Client> >::iterator it = clients.begin(); it != clients.end(); ++it) {
+		(*it)->thread.join();
+		close((*it)->fd);
+	}
+	daemon.jobs.close();
+	for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+
+	sigaction(SIGINT, &previous_int, NULL);
+	sigaction(SIGTERM, &previous_term, NULL);
+	args->debug(0) << "Served " << daemon.done << " jobs, " << daemon.failed << " failed." << std::endl;
+	if (daemon.results_cache) reportResultCache(args, *daemon.results_cache);
+	return true;
+}
@@ -0,0 +1,218 @@
+#include "includes/floodfill.h"
+#include "includes/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+using CompFab::Word;
+
+namespace {
+
+const unsigned int BITS = CompFab::VOXELS_PER_WORD;
+
+// rows of one task of the sweeps and dilations along z
+const unsigned int COLUMN_ROWS = 16;
+
+inline size_t row_offset(const CompFab::VoxelGrid &grid, unsigned int y, unsigned int z)
+{
+	return ((size_t) z*grid.m_dimY + y)*grid.m_wordsPerRow;
+}
+
+// the bits of open reachable from the bits of seed without leaving open, within
+// one word. A Kogge-Stone occluded fill towards both ends of the word.
+inline Word fill_word(Word seed, Word open)
+{
+	Word up = seed & open, down = up, up_open = open, down_open = open;
+	for (unsigned int s = 1; s < BITS; s <<= 1) {
+		up |= up_open & (up << s);
+		up_open &= up_open << s;
+		down |= down_open & (down >> s);
+		down_open &= down_open >> s;
+	}
+	return up | down;
+}
+
+// spreads the exterior bits of a row along x through the voxels off the surface
+void fill_row(const CompFab::VoxelGrid &grid, const Word *surface, Word *exterior)
+{
+	unsigned int words = grid.m_wordsPerRow;
+	Word carry = 0;
+	for (unsigned int w = 0; w < words; ++w) {
+		exterior[w] = fill_word(exterior[w] | carry, ~surface[w] & grid.rowMask(w));
+		carry = exterior[w] >> (BITS - 1);
+	}
+	carry = 0;
+	for (unsigned int w = words; w-- > 0;) {
+		exterior[w] = fill_word(exterior[w] | carry << (BITS - 1), ~surface[w] & grid.rowMask(w));
+		carry = exterior[w] & 1;
+	}
+}
+
+// moves the exterior of a neighbouring row into the voxels of a row off the
+// surface and fills the row along x. Returns whether the row grew
+bool spread(const CompFab::VoxelGrid &grid, const Word *from, const Word *surface, Word *exterior)
+{
+	bool grew = false;
+	for (unsigned int w = 0; w < grid.m_wordsPerRow; ++w) {
+		Word reached = from[w] & ~surface[w] & ~exterior[w];
+		exterior[w] |= reached;
+		grew |= reached != 0;
+	}
+	if (grew) fill_row(grid, surface, exterior);
+	return grew;
+}
+
+// row |= src shifted by s voxels towards both ends
+void or_shifted(Word *row, const Word *src, unsigned int words, unsigned int s)
+{
+	unsigned int q = s / BITS, b = s % BITS;
+	for (unsigned int w = 0; w < words; ++w) {
+		Word up = 0, down = 0;
+		if (w >= q) {
+			up = src[w - q] << b;
+			if (b && w >= q + 1) up |= src[w - q - 1] >> (BITS - b);
+		}
+		if (w + q < words) {
+			down = src[w + q] >> b;
+			if (b && w + q + 1 < words) down |= src[w + q + 1] << (BITS - b);
+		}
+		row[w] |= up | down;
+	}
+}
+
+// the shifts that grow a set by radius along an axis: each doubles the reach so
+// far, or closes the rest of it
+std::vector<unsigned int> dilation_steps(int radius)
+{
+	std::vector<unsigned int> steps;
+	for (int reach = 0; reach < radius; ) {
+		int s = std::min(reach + 1, radius - reach);
+		steps.push_back(s);
+		reach += s;
+	}
+	return steps;
+}
+
+// dilates bits, laid out like the words of grid, by radius along x, y and z
+void dilate_bits(const CompFab::VoxelGrid &grid, Word *bits, int radius)
+{
+	const unsigned int w = grid.m_dimX, h = grid.m_dimY, d = grid.m_dimZ, words = grid.m_wordsPerRow;
+	const std::vector<unsigned int> steps = dilation_steps(radius);
+	if (steps.empty() || grid.m_numWords == 0) return;
+
+	// along x and y within each layer
+	ThreadPool::global().parallel_for(0, d, [&](size_t z) {
+		std::vector<Word> layer((size_t) h*words);
+		Word *rows = bits + row_offset(grid, 0, z);
+		for (unsigned int y = 0; y < h; ++y) {
+			Word *row = rows + (size_t) y*words;
+			for (size_t i = 0; i < steps.size(); ++i) {
+				if (steps[i] >= w) break;
+				std::copy(row, row + words, layer.begin());
+				or_shifted(row, &layer[0], words, steps[i]);
+			}
+			row[words - 1] &= grid.rowMask(words - 1);
+		}
+		for (size_t i = 0; i < steps.size(); ++i) {
+			std::copy(rows, rows + layer.size(), layer.begin());
+			for (unsigned int y = 0; y < h; ++y)
+				for (unsigned int k = 0; k < words; ++k) {
+					Word grown = 0;
+					if (y >= steps[i]) grown |= layer[(size_t) (y - steps[i])*words + k];
+					if (y + steps[i] < h) grown |= layer[(size_t) (y + steps[i])*words + k];
+					rows[(size_t) y*words + k] |= grown;
+				}
+		}
+	});
+
+	// along z for blocks of rows
+	ThreadPool::global().parallel_for(0, (h + COLUMN_ROWS - 1) / COLUMN_ROWS, [&](size_t block) {
+		unsigned int y0 = block*COLUMN_ROWS, y1 = std::min(h, y0 + COLUMN_ROWS);
+		size_t span = (size_t) (y1 - y0)*words;
+		std::vector<Word> column((size_t) d*span);
+		for (size_t i = 0; i < steps.size(); ++i) {
+			for (unsigned int z = 0; z < d; ++z)
+				std::copy(bits + row_offset(grid, y0, z), bits + row_offset(grid, y0, z) + span, column.begin() + z*span);
+			for (unsigned int z = 0; z < d; ++z) {
+				Word *rows = bits + row_offset(grid, y0, z);
+				for (size_t k = 0; k < span; ++k) {
+					Word grown = 0;
+					if (z >= steps[i]) grown |= column[(z - steps[i])*span + k];
+					if (z + steps[i] < d) grown |= column[(z + steps[i])*span + k];
+					rows[k] |= grown;
+				}
+			}
+		}
+	});
+}
+
+}
+
+void dilate(CompFab::VoxelGrid *grid, int radius)
+{
+	dilate_bits(*grid, grid->m_insideArray, radius);
+}
+
+void solidify(CompFab::VoxelGrid *grid, int close_radius)
+{
+	const unsigned int w = grid->m_dimX, h = grid->m_dimY, d = grid->m_dimZ, words = grid->m_wordsPerRow;
+	if (grid->m_numWords == 0) return;
+	dilate(grid, close_radius);
+
+	const Word *surface = grid->m_insideArray;
+	std::vector<Word> exterior_words(grid->m_numWords, 0);
+	Word *exterior = &exterior_words[0];
+
+	// seeds: every voxel off the surface on the border of the grid
+	ThreadPool::global().parallel_for(0, d, [&](size_t z) {
+		for (unsigned int y = 0; y < h; ++y) {
+			size_t offset = row_offset(*grid, y, z);
+			if (y == 0 || y == h - 1 || z == 0 || z == d - 1) {
+				for (unsigned int k = 0; k < words; ++k)
+					exterior[offset + k] = ~surface[offset + k] & grid->rowMask(k);
+			} else {
+				exterior[offset] |= 1;
+				exterior[offset + (w - 1) / BITS] |= Word(1) << ((w - 1) % BITS);
+				fill_row(*grid, surface + offset, exterior + offset);
+			}
+		}
+	});
+
+	// sweeps the exterior forth and back along y, then along z, until it stops
+	// growing. Each sweep carries it around as many bends of a path as it likes
+	// within its layer or column of rows, so a few rounds are enough.
+	std::atomic<bool> grew(true);
+	while (grew) {
+		grew = false;
+		ThreadPool::global().parallel_for(0, d, [&](size_t z) {
+			bool changed = false;
+			for (unsigned int y = 1; y < h; ++y)
+				changed |= spread(*grid, exterior + row_offset(*grid, y - 1, z), surface + row_offset(*grid, y, z), exterior + row_offset(*grid, y, z));
+			for (unsigned int y = h - 1; y-- > 0;)
+				changed |= spread(*grid, exterior + row_offset(*grid, y + 1, z), surface + row_offset(*grid, y, z), exterior + row_offset(*grid, y, z));
+			if (changed) grew = true;
+		});
+		ThreadPool::global().parallel_for(0, (h + COLUMN_ROWS - 1) / COLUMN_ROWS, [&](size_t block) {
+			unsigned int y0 = block*COLUMN_ROWS, y1 = std::min(h, y0 + COLUMN_ROWS);
+			bool changed = false;
+			for (unsigned int z = 1; z < d; ++z)
+				for (unsigned int y = y0; y < y1; ++y)
+					changed |= spread(*grid, exterior + row_offset(*grid, y, z - 1), surface + row_offset(*grid, y, z), exterior + row_offset(*grid, y, z));
+			for (unsigned int z = d - 1; z-- > 0;)
+				for (unsigned int y = y0; y < y1; ++y)
+					changed |= spread(*grid, exterior + row_offset(*grid, y, z + 1), surface + row_offset(*grid, y, z), exterior + row_offset(*grid, y, z));
+			if (changed) grew = true;
+		});
+	}
+
+	// everything the exterior, shrunk back from the dilated surface, leaves out
+	dilate_bits(*grid, exterior, close_radius);
+	ThreadPool::global().parallel_for(0, d, [&](size_t z) {
+		for (unsigned int y = 0; y < h; ++y) {
+			size_t offset = row_offset(*grid, y, z);
+			for (unsigned int k = 0; k < words; ++k)
+				grid->m_insideArray[offset + k] = ~exterior[offset + k] & grid->rowMask(k);
+		}
+	});
+}
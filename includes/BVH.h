@@ -0,0 +1,142 @@
+#ifndef voxelizer_BVH_h
+#define voxelizer_BVH_h
+
+// Bounding volume hierarchy over the triangle list, built with a binned surface
+// area heuristic. The tree is stored flattened in depth first order so it can be
+// copied to another address space as two plain arrays.
+
+#include "includes/CompFab.h"
+#include "includes/raycast.h"
+#include "includes/SimdIntersect.h"
+#include "includes/Profiler.h"
+
+#include <vector>
+
+// deepest tree the traversal stack can handle
+#define BVH_MAX_DEPTH 64
+// leaves never hold more triangles than this
+#define BVH_MAX_LEAF 8
+
+struct BVHNode {
+	float m_min[3], m_max[3];
+	// leaves: index of the first triangle, inner nodes: index of the second child.
+	// The first child of an inner node always directly follows it.
+	unsigned int m_offset;
+	// number of triangles in a leaf, 0 for inner nodes
+	unsigned int m_count;
+};
+
+// inverse of a ray direction that stays finite for axis aligned rays, since
+// -ffast-math does not let us rely on infinities in the slab test
+HOST_DEVICE inline vec3f safe_inverse(vec3f dir)
+{
+	return make_vec3f(
+		fabsf(dir.x) > 1e-20f ? 1.f / dir.x : 1e30f,
+		fabsf(dir.y) > 1e-20f ? 1.f / dir.y : 1e30f,
+		fabsf(dir.z) > 1e-20f ? 1.f / dir.z : 1e30f);
+}
+
+// does the ray starting at pos hit the node's box in front of its origin
+HOST_DEVICE inline bool intersects(const BVHNode &node, vec3f pos, vec3f inv_dir)
+{
+	float t0 = (node.m_min[0] - pos.x) * inv_dir.x, t1 = (node.m_max[0] - pos.x) * inv_dir.x;
+	float tmin = fminf(t0, t1), tmax = fmaxf(t0, t1);
+	t0 = (node.m_min[1] - pos.y) * inv_dir.y; t1 = (node.m_max[1] - pos.y) * inv_dir.y;
+	tmin = fmaxf(tmin, fminf(t0, t1)); tmax = fminf(tmax, fmaxf(t0, t1));
+	t0 = (node.m_min[2] - pos.z) * inv_dir.z; t1 = (node.m_max[2] - pos.z) * inv_dir.z;
+	tmin = fmaxf(tmin, fminf(t0, t1)); tmax = fminf(tmax, fmaxf(t0, t1));
+	return tmax >= 0.f && tmin <= tmax;
+}
+
+// calls visit(offset, count) for the triangle range of every leaf whose box the
+// ray hits in front of its origin
+template <typename LeafVisitor>
+HOST_DEVICE inline void traverse_leaves(const BVHNode *nodes, vec3f dir, vec3f pos, LeafVisitor &visit)
+{
+	vec3f inv_dir = safe_inverse(dir);
+	unsigned int stack[BVH_MAX_DEPTH];
+	unsigned int top = 0;
+
+	stack[top++] = 0;
+	while (top > 0) {
+		const BVHNode &node = nodes[stack[--top]];
+		if (!intersects(node, pos, inv_dir)) continue;
+
+		if (node.m_count > 0) {
+			visit(node.m_offset, node.m_count);
+		} else {
+			stack[top++] = node.m_offset;
+			stack[top++] = &node - nodes + 1;
+		}
+	}
+}
+
+template <typename Visitor>
+struct VisitLeafTriangles {
+	Visitor &m_visit;
+
+	HOST_DEVICE void operator()(unsigned int offset, unsigned int count)
+	{
+		for (unsigned int i = offset; i < offset + count; ++i)
+			m_visit(i);
+	}
+};
+
+// calls visit(i) for every triangle i whose leaf box the ray hits in front of its
+// origin. A superset of the triangles the ray crosses, callers run the exact test.
+template <typename Visitor>
+HOST_DEVICE inline void traverse(const BVHNode *nodes, vec3f dir, vec3f pos, Visitor &visit)
+{
+	VisitLeafTriangles<Visitor> leaves = {visit};
+	traverse_leaves(nodes, dir, pos, leaves);
+}
+
+class BVH {
+public:
+	BVH() {}
+	BVH(const std::vector<CompFab::Triangle> &triangles) { build(triangles); }
+
+	void build(const std::vector<CompFab::Triangle> &triangles);
+
+	// counts every crossing of the ray with the mesh. Visits exactly the triangles a
+	// brute force loop would report as hits, testing whole leaves with the SIMD kernels
+	unsigned int count_intersections(vec3f dir, vec3f pos) const
+	{
+		if (m_nodes.empty()) return 0;
+		CountLeafCrossings count = {&m_soa, dir, pos, 0};
+		::traverse_leaves(&m_nodes[0], dir, pos, count);
+		return count.m_count;
+	}
+
+	template <typename Visitor>
+	void traverse(vec3f dir, vec3f pos, Visitor &visit) const
+	{
+		if (!m_nodes.empty()) ::traverse(&m_nodes[0], dir, pos, visit);
+	}
+
+	bool empty() const { return m_nodes.empty(); }
+	unsigned int depth() const { return m_depth; }
+
+	std::vector<BVHNode> m_nodes;
+	// copy of the input triangles, reordered so every leaf is a contiguous range
+	std::vector<CompFab::Triangle> m_triangles;
+	// m_triangles in the layout of the SIMD kernels
+	TriangleSoA m_soa;
+
+private:
+	struct CountLeafCrossings {
+		const TriangleSoA *m_soa;
+		vec3f m_dir, m_pos;
+		unsigned int m_count;
+
+		void operator()(unsigned int offset, unsigned int count)
+		{
+			PROFILE_COUNT(COUNT_TRIANGLE_TESTS, count);
+			m_count += count_crossings(*m_soa, offset, offset + count, m_dir, m_pos);
+		}
+	};
+
+	unsigned int m_depth;
+};
+
+#endif
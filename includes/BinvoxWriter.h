@@ -0,0 +1,68 @@
+#ifndef voxelizer_BinvoxWriter_h
+#define voxelizer_BinvoxWriter_h
+
+// Streaming .binvox writer. The run length encoded data walks x slowest, then z,
+// then y, so the grid is fed one word column at a time: word w of every (y, z) row
+// holds the 64 x slices w*64 .. w*64+63. Each slice is encoded in parallel into its
+// own segment and the segments are stitched in order, so the output is exactly
+// what a voxel by voxel encoder produces.
+
+#include "includes/CompFab.h"
+
+#include <cstdio>
+#include <vector>
+#include <stdint.h>
+
+class BinvoxWriter {
+public:
+	BinvoxWriter();
+	~BinvoxWriter();
+
+	// creates the file and writes the ascii header
+	bool open(const char *filename, unsigned int dimX, unsigned int dimY, unsigned int dimZ,
+		const CompFab::Vec3 &translate, CompFab::precision_type scale);
+
+	// appends word column w, column[z*dimY + y] being word w of row (y, z).
+	// Columns must be written in order, starting at 0.
+	void write_column(unsigned int w, const CompFab::Word *column);
+
+	// writes the last run and closes the file, false if any write failed
+	bool close();
+
+	bool is_open() const { return m_file != NULL; }
+
+	// the RLE of one contiguous stretch of the traversal. Its first and last run
+	// are kept apart with their full length since they may continue in the
+	// neighbouring segments.
+	struct Segment {
+		unsigned char m_headValue, m_tailValue;
+		uint64_t m_headLength, m_tailLength;
+		// (value, count) pairs of the runs in between
+		std::vector<unsigned char> m_body;
+		// a single run, head and tail are the same
+		bool m_single;
+	};
+
+private:
+	void append(const Segment &segment);
+	// emits a run, split into pairs of at most 255 voxels
+	void emit_run(unsigned char value, uint64_t length);
+	void write(const void *data, size_t bytes);
+	void flush();
+
+	FILE *m_file;
+	bool m_failed;
+	unsigned int m_dimX, m_dimY, m_dimZ, m_nextColumn;
+
+	// run left open by the previous segment
+	unsigned char m_runValue;
+	uint64_t m_runLength;
+
+	std::vector<char> m_buffer;
+	size_t m_buffered;
+	// bit planes of the current column and their encoded segments
+	std::vector<CompFab::Word> m_planes;
+	std::vector<Segment> m_segments;
+};
+
+#endif
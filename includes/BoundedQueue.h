@@ -0,0 +1,57 @@
+#ifndef voxelizer_BoundedQueue_h
+#define voxelizer_BoundedQueue_h
+
+// Blocking queue of at most a fixed number of items between the stages of a
+// pipeline. A full queue stalls its producer, so a fast stage cannot run ahead
+// of a slow one by more than the capacity.
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+template <class T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) : m_capacity(capacity < 1 ? 1 : capacity), m_closed(false) {}
+
+	// waits for room, false if the queue was closed
+	bool push(const T &item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+		if (m_closed) return false;
+		m_items.push_back(item);
+		m_notEmpty.notify_one();
+		return true;
+	}
+
+	// waits for an item, false once the queue is closed and drained
+	bool pop(T &item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+		if (m_items.empty()) return false;
+		item = m_items.front();
+		m_items.pop_front();
+		m_notFull.notify_one();
+		return true;
+	}
+
+	// no more pushes, pop hands out what is left
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+		m_notFull.notify_all();
+		m_notEmpty.notify_all();
+	}
+
+private:
+	size_t m_capacity;
+	bool m_closed;
+	std::deque<T> m_items;
+	std::mutex m_mutex;
+	std::condition_variable m_notFull, m_notEmpty;
+};
+
+#endif
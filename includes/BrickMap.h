@@ -0,0 +1,90 @@
+#ifndef voxelizer_BrickMap_h
+#define voxelizer_BrickMap_h
+
+// Sparse storage for grids too large to keep dense, even bit-packed. The grid is
+// cut into bricks of BRICK_SIZE^3 voxels and the bricks into nodes of
+// BRICK_SIZE^3 bricks. A brick or node all of whose voxels are empty or all full
+// is only a tag, so the memory follows the surface of the mesh and not its volume.
+//
+// A node tag is EMPTY, FULL or points to a table of the tags of its bricks, and a
+// brick tag is EMPTY, FULL or points to the payload of a mixed brick: one word per
+// z layer of the brick, voxel (x, y) being bit x + 8*y. The grid is filled a slab
+// of z layers at a time, see SlabVoxelizer::save_bricks.
+
+#include "includes/CompFab.h"
+#include "includes/bricks.h"
+
+#include <vector>
+#include <stdint.h>
+
+class BrickMap {
+public:
+	enum { EMPTY = 0, FULL = 1, FIRST_INDEX = 2 };
+
+	BrickMap(const CompFab::Vec3 &lowerLeft, unsigned int dimX, unsigned int dimY, unsigned int dimZ, CompFab::precision_type spacing);
+
+	// stores the voxels of a slab of the grid. Slabs come in order of their first
+	// layer, which is a multiple of BRICK_SIZE, as is their depth unless they end the grid
+	void insert(const CompFab::VoxelGrid &slab);
+
+	inline bool isInside(unsigned int i, unsigned int j, unsigned int k) const
+	{
+		uint32_t tag = brick(i / BRICK_SIZE, j / BRICK_SIZE, k / BRICK_SIZE);
+		if (tag < FIRST_INDEX) return tag == FULL;
+		return (m_payload[(size_t) (tag - FIRST_INDEX)*BRICK_SIZE + k % BRICK_SIZE] >> (i % BRICK_SIZE + BRICK_SIZE*(j % BRICK_SIZE))) & 1;
+	}
+
+	// tag of brick (bx, by, bz)
+	inline uint32_t brick(unsigned int bx, unsigned int by, unsigned int bz) const
+	{
+		uint32_t tag = m_nodes[((size_t) (bz / BRICK_SIZE)*m_nodesY + by / BRICK_SIZE)*m_nodesX + bx / BRICK_SIZE];
+		if (tag < FIRST_INDEX) return tag;
+		return m_tables[(size_t) (tag - FIRST_INDEX)*BRICKS_PER_NODE + ((bz % BRICK_SIZE)*BRICK_SIZE + by % BRICK_SIZE)*BRICK_SIZE + bx % BRICK_SIZE];
+	}
+
+	// the words of layers [first, first + depth) in the order of a VoxelGrid's m_insideArray
+	void layers(unsigned int first, unsigned int depth, CompFab::Word *out) const;
+	// word w of every row, out[z*dimY + y] being word w of row (y, z), as BinvoxWriter takes them
+	void column(unsigned int w, CompFab::Word *out) const;
+
+	// number of filled voxels
+	size_t count() const;
+	// bytes of the node tags, brick tables and payload
+	size_t memory() const;
+	// bytes the grid takes bit-packed and dense
+	size_t dense_memory() const { return (size_t) m_wordsPerRow*m_dimY*m_dimZ*sizeof(CompFab::Word); }
+
+	size_t mixed_bricks() const { return m_payload.size() / BRICK_SIZE; }
+	size_t full_bricks() const;
+
+	bool save_binvox(const char *filename) const;
+	bool save_raw(const char *filename) const;
+
+	unsigned int m_dimX, m_dimY, m_dimZ, m_wordsPerRow;
+	unsigned int m_bricksX, m_bricksY, m_bricksZ;
+	unsigned int m_nodesX, m_nodesY, m_nodesZ;
+	CompFab::precision_type m_spacing;
+	CompFab::Vec3 m_lowerLeft;
+
+private:
+	enum { BRICKS_PER_NODE = BRICK_SIZE*BRICK_SIZE*BRICK_SIZE };
+
+	// the brick's word for layer z (0 .. BRICK_SIZE-1) from its tag
+	inline CompFab::Word brick_layer(uint32_t tag, unsigned int z) const
+	{
+		if (tag < FIRST_INDEX) return tag == FULL ? ~CompFab::Word(0) : 0;
+		return m_payload[(size_t) (tag - FIRST_INDEX)*BRICK_SIZE + z];
+	}
+
+	// folds the tables of the nodes of node layer nz that came out uniform into tags
+	void collapse(unsigned int nz);
+
+	std::vector<uint32_t> m_nodes;
+	std::vector<uint32_t> m_tables;
+	// tables of collapsed nodes, reused before the vector grows
+	std::vector<uint32_t> m_freeTables;
+	std::vector<CompFab::Word> m_payload;
+	unsigned int m_layers;
+};
+
+#endif
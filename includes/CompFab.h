@@ -12,6 +12,8 @@
 #define USE_DOUBLE false
 
 #include <cmath>
+#include <cstddef>
+#include <stdint.h>
 
 namespace CompFab
 {
@@ -117,22 +119,63 @@ namespace CompFab
     
     
     //Grid structure for Voxels
+    //Occupancy is bit-packed: each row of voxels along x is stored in 64 bit words,
+    //voxel i of a row being bit i%64 of word i/64. Bits past m_dimX are always zero.
+    typedef uint64_t Word;
+    enum { VOXELS_PER_WORD = 64 };
+
     typedef struct VoxelGridStruct
     {
         //Square voxels only
-        VoxelGridStruct(Vec3 lowerLeft, unsigned int dimX, unsigned int dimY, unsigned int dimZ, precision_type spacing);
+        //A grid may be a slab of z layers of a larger one: its layer k is layer firstZ+k
+        //of the grid that starts at lowerLeft
+        VoxelGridStruct(Vec3 lowerLeft, unsigned int dimX, unsigned int dimY, unsigned int dimZ, precision_type spacing, unsigned int firstZ = 0);
         ~VoxelGridStruct();
 
-        void save_binvox(const char * filename);
+        //false if the file could not be written
+        bool save_binvox(const char * filename) const;
+
+        //number of filled voxels
+        size_t count() const;
 
-        inline bool & isInside(unsigned int i, unsigned int j, unsigned int k)
+        inline bool isInside(unsigned int i, unsigned int j, unsigned int k) const
         {
-            
-            return m_insideArray[k*(m_dimX*m_dimY)+j*m_dimY + i];
+            return (word(i / VOXELS_PER_WORD, j, k) >> (i % VOXELS_PER_WORD)) & 1;
         }
-        
-        bool *m_insideArray;
-        unsigned int m_dimX, m_dimY, m_dimZ, m_size;
+
+        inline void setInside(unsigned int i, unsigned int j, unsigned int k, bool inside)
+        {
+            Word bit = Word(1) << (i % VOXELS_PER_WORD);
+            Word &w = word(i / VOXELS_PER_WORD, j, k);
+            w = inside ? (w | bit) : (w & ~bit);
+        }
+
+        //the m_wordsPerRow words holding row (j, k)
+        inline Word * row(unsigned int j, unsigned int k)
+        {
+            return m_insideArray + ((size_t) k*m_dimY + j)*m_wordsPerRow;
+        }
+
+        inline const Word * row(unsigned int j, unsigned int k) const
+        {
+            return m_insideArray + ((size_t) k*m_dimY + j)*m_wordsPerRow;
+        }
+
+        inline Word & word(unsigned int w, unsigned int j, unsigned int k) { return row(j, k)[w]; }
+        inline const Word & word(unsigned int w, unsigned int j, unsigned int k) const { return row(j, k)[w]; }
+
+        //bits of word w that hold voxels of the grid
+        inline Word rowMask(unsigned int w) const
+        {
+            unsigned int rest = m_dimX - w*VOXELS_PER_WORD;
+            return rest >= VOXELS_PER_WORD ? ~Word(0) : (Word(1) << rest) - 1;
+        }
+
+        Word *m_insideArray;
+        unsigned int m_dimX, m_dimY, m_dimZ, m_wordsPerRow;
+        unsigned int m_firstZ;
+        //number of voxels and number of words in m_insideArray
+        size_t m_size, m_numWords;
         precision_type m_spacing;
         Vec3 m_lowerLeft;
         
@@ -0,0 +1,200 @@
+#ifndef voxelizer_GridLayout_h
+#define voxelizer_GridLayout_h
+
+// Bit-packed voxel grids templated on the order their bits are stored in. The
+// VoxelGrid keeps rows along x contiguous, which the +X ray engines and the word
+// parallel flood fill want. Neighbourhood work touching y and z neighbours, like
+// dilation or a voxel by voxel flood fill, finds them pages apart there. The tiled
+// and Morton layouts keep small cubes of voxels together instead.
+//
+// A layout maps voxel (i, j, k) to a bit index and back:
+//   LinearLayout         rows of whole words, as in VoxelGrid
+//   TiledLayout<B, M>    tiles of (2^B)^3 voxels in linear order, Z-order inside
+//   MortonLayout<M>      Z-order over the power of two cube around the grid
+// M is MortonMagic or MortonBmi2, see morton.h.
+
+#include "includes/CompFab.h"
+#include "includes/morton.h"
+
+#include <algorithm>
+#include <vector>
+
+struct LinearLayout {
+	LinearLayout(unsigned int dimX, unsigned int dimY, unsigned int dimZ)
+		: m_dimY(dimY), m_dimZ(dimZ), m_rowBits((dimX + CompFab::VOXELS_PER_WORD - 1) / CompFab::VOXELS_PER_WORD * CompFab::VOXELS_PER_WORD) {}
+
+	static const char *name() { return "linear"; }
+
+	inline size_t index(uint32_t i, uint32_t j, uint32_t k) const { return ((size_t) k*m_dimY + j)*m_rowBits + i; }
+
+	inline void coords(size_t index, uint32_t &i, uint32_t &j, uint32_t &k) const
+	{
+		size_t row = index / m_rowBits;
+		i = index % m_rowBits;
+		j = row % m_dimY;
+		k = row / m_dimY;
+	}
+
+	size_t bits() const { return (size_t) m_rowBits*m_dimY*m_dimZ; }
+
+	unsigned int m_dimY, m_dimZ, m_rowBits;
+};
+
+template <unsigned int TILE_BITS, class Morton>
+struct TiledLayout {
+	enum { TILE = 1 << TILE_BITS, TILE_MASK = TILE - 1, TILE_VOXELS_BITS = 3*TILE_BITS };
+
+	TiledLayout(unsigned int dimX, unsigned int dimY, unsigned int dimZ)
+		: m_tilesX((dimX + TILE_MASK) >> TILE_BITS), m_tilesY((dimY + TILE_MASK) >> TILE_BITS), m_tilesZ((dimZ + TILE_MASK) >> TILE_BITS) {}
+
+	static const char *name() { return TILE_BITS == 2 ? "tiled4" : TILE_BITS == 3 ? "tiled8" : "tiled"; }
+
+	inline size_t index(uint32_t i, uint32_t j, uint32_t k) const
+	{
+		size_t tile = ((size_t) (k >> TILE_BITS)*m_tilesY + (j >> TILE_BITS))*m_tilesX + (i >> TILE_BITS);
+		return tile << TILE_VOXELS_BITS | morton_encode<Morton>(i & TILE_MASK, j & TILE_MASK, k & TILE_MASK);
+	}
+
+	inline void coords(size_t index, uint32_t &i, uint32_t &j, uint32_t &k) const
+	{
+		size_t tile = index >> TILE_VOXELS_BITS;
+		morton_decode<Morton>(index & ((1u << TILE_VOXELS_BITS) - 1), i, j, k);
+		i |= (tile % m_tilesX) << TILE_BITS;
+		j |= (tile / m_tilesX % m_tilesY) << TILE_BITS;
+		k |= (tile / m_tilesX / m_tilesY) << TILE_BITS;
+	}
+
+	size_t bits() const { return (size_t) m_tilesX*m_tilesY*m_tilesZ << TILE_VOXELS_BITS; }
+
+	unsigned int m_tilesX, m_tilesY, m_tilesZ;
+};
+
+template <class Morton>
+struct MortonLayout {
+	MortonLayout(unsigned int dimX, unsigned int dimY, unsigned int dimZ) : m_sideBits(0)
+	{
+		while ((1u << m_sideBits) < std::max(dimX, std::max(dimY, dimZ))) ++m_sideBits;
+	}
+
+	static const char *name() { return "morton"; }
+
+	inline size_t index(uint32_t i, uint32_t j, uint32_t k) const { return morton_encode<Morton>(i, j, k); }
+	inline void coords(size_t index, uint32_t &i, uint32_t &j, uint32_t &k) const { morton_decode<Morton>(index, i, j, k); }
+
+	size_t bits() const { return (size_t) 1 << (3*m_sideBits); }
+
+	unsigned int m_sideBits;
+};
+
+template <class Layout>
+class LayoutGrid {
+public:
+	typedef CompFab::Word Word;
+
+	LayoutGrid(unsigned int dimX, unsigned int dimY, unsigned int dimZ)
+		: m_layout(dimX, dimY, dimZ), m_dimX(dimX), m_dimY(dimY), m_dimZ(dimZ),
+		m_words((m_layout.bits() + CompFab::VOXELS_PER_WORD - 1) / CompFab::VOXELS_PER_WORD, 0) {}
+
+	inline bool isInside(uint32_t i, uint32_t j, uint32_t k) const
+	{
+		size_t bit = m_layout.index(i, j, k);
+		return m_words[bit / CompFab::VOXELS_PER_WORD] >> (bit % CompFab::VOXELS_PER_WORD) & 1;
+	}
+
+	inline void setInside(uint32_t i, uint32_t j, uint32_t k)
+	{
+		size_t bit = m_layout.index(i, j, k);
+		m_words[bit / CompFab::VOXELS_PER_WORD] |= Word(1) << (bit % CompFab::VOXELS_PER_WORD);
+	}
+
+	// calls fn(i, j, k) for every voxel of the grid in storage order
+	template <class Fn>
+	void for_each(Fn fn) const
+	{
+		size_t bits = m_layout.bits();
+		for (size_t bit = 0; bit < bits; ++bit) {
+			uint32_t i, j, k;
+			m_layout.coords(bit, i, j, k);
+			if (i < m_dimX && j < m_dimY && k < m_dimZ) fn(i, j, k);
+		}
+	}
+
+	// copies a VoxelGrid of the same dimensions, writing the words in storage order
+	void load(const CompFab::VoxelGrid &grid)
+	{
+		std::fill(m_words.begin(), m_words.end(), 0);
+		for (size_t w = 0; w < m_words.size(); ++w) {
+			Word word = 0;
+			for (unsigned int b = 0; b < CompFab::VOXELS_PER_WORD; ++b) {
+				uint32_t i, j, k;
+				m_layout.coords(w*CompFab::VOXELS_PER_WORD + b, i, j, k);
+				if (i < m_dimX && j < m_dimY && k < m_dimZ && grid.isInside(i, j, k)) word |= Word(1) << b;
+			}
+			m_words[w] = word;
+		}
+	}
+
+	void store(CompFab::VoxelGrid &grid) const
+	{
+		for (unsigned int k = 0; k < m_dimZ; ++k)
+			for (unsigned int j = 0; j < m_dimY; ++j)
+				for (unsigned int i = 0; i < m_dimX; ++i)
+					grid.setInside(i, j, k, isInside(i, j, k));
+	}
+
+	Layout m_layout;
+	unsigned int m_dimX, m_dimY, m_dimZ;
+	std::vector<Word> m_words;
+};
+
+// marks in exterior every voxel a 6-connected path from outside the grid reaches
+// without crossing the surface, one voxel at a time
+template <class Layout>
+void layout_flood_fill(const LayoutGrid<Layout> &surface, LayoutGrid<Layout> &exterior)
+{
+	const uint32_t w = surface.m_dimX, h = surface.m_dimY, d = surface.m_dimZ;
+	std::vector<uint64_t> stack;
+	// coordinates packed 21 bits each
+	auto push = [&](uint32_t i, uint32_t j, uint32_t k) {
+		if (surface.isInside(i, j, k) || exterior.isInside(i, j, k)) return;
+		exterior.setInside(i, j, k);
+		stack.push_back((uint64_t) i | (uint64_t) j << 21 | (uint64_t) k << 42);
+	};
+
+	surface.for_each([&](uint32_t i, uint32_t j, uint32_t k) {
+		if (i == 0 || j == 0 || k == 0 || i == w - 1 || j == h - 1 || k == d - 1) push(i, j, k);
+	});
+	while (!stack.empty()) {
+		uint64_t v = stack.back();
+		stack.pop_back();
+		uint32_t i = v & 0x1FFFFF, j = v >> 21 & 0x1FFFFF, k = v >> 42;
+		if (i > 0) push(i - 1, j, k);
+		if (i + 1 < w) push(i + 1, j, k);
+		if (j > 0) push(i, j - 1, k);
+		if (j + 1 < h) push(i, j + 1, k);
+		if (k > 0) push(i, j, k - 1);
+		if (k + 1 < d) push(i, j, k + 1);
+	}
+}
+
+// sets in out every voxel with a voxel of in among its 26 neighbours or itself,
+// visiting out in storage order
+template <class Layout>
+void layout_dilate(const LayoutGrid<Layout> &in, LayoutGrid<Layout> &out)
+{
+	const uint32_t w = in.m_dimX, h = in.m_dimY, d = in.m_dimZ;
+	in.for_each([&](uint32_t i, uint32_t j, uint32_t k) {
+		uint32_t i0 = i > 0 ? i - 1 : 0, i1 = std::min(i + 1, w - 1);
+		uint32_t j0 = j > 0 ? j - 1 : 0, j1 = std::min(j + 1, h - 1);
+		uint32_t k0 = k > 0 ? k - 1 : 0, k1 = std::min(k + 1, d - 1);
+		for (uint32_t z = k0; z <= k1; ++z)
+			for (uint32_t y = j0; y <= j1; ++y)
+				for (uint32_t x = i0; x <= i1; ++x)
+					if (in.isInside(x, y, z)) {
+						out.setInside(i, j, k);
+						return;
+					}
+	});
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef voxelizer_GridPool_h
+#define voxelizer_GridPool_h
+
+// Recycles voxel grids between jobs. Allocating a large grid costs a page fault
+// per 4 KiB as it is first written, so a grid of the dimensions asked for is
+// taken from the returned ones and cleared instead when there is one. Returned
+// grids beyond the byte budget are freed, the oldest first.
+
+#include "includes/CompFab.h"
+
+#include <deque>
+#include <mutex>
+
+class GridPool {
+public:
+	explicit GridPool(size_t max_free_bytes) : m_maxFreeBytes(max_free_bytes), m_freeBytes(0), m_allocated(0), m_reused(0) {}
+	~GridPool();
+
+	// an empty grid with the given placement, the caller gives it back when done
+	CompFab::VoxelGrid *take(const CompFab::Vec3 &lowerLeft, unsigned int dimX, unsigned int dimY, unsigned int dimZ, CompFab::precision_type spacing);
+	void give(CompFab::VoxelGrid *grid);
+
+	// grids allocated and handed out again so far
+	size_t allocated() const { return m_allocated; }
+	size_t reused() const { return m_reused; }
+
+private:
+	size_t m_maxFreeBytes, m_freeBytes;
+	size_t m_allocated, m_reused;
+	std::deque<CompFab::VoxelGrid *> m_free;
+	std::mutex m_mutex;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef voxelizer_MappedFile_h
+#define voxelizer_MappedFile_h
+
+#include <cstddef>
+#include <vector>
+
+// Read only view of a whole file. Memory mapped where the platform supports it,
+// read into a buffer otherwise.
+class MappedFile {
+public:
+	MappedFile();
+	explicit MappedFile(const char *filename);
+	~MappedFile();
+
+	// maps the file, returns false if it cannot be opened
+	bool open(const char *filename);
+	void close();
+
+	bool is_open() const { return m_open; }
+	const char *data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	const char *m_data;
+	size_t m_size;
+	bool m_open, m_mapped;
+	std::vector<char> m_buffer;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef voxelizer_MeshCache_h
+#define voxelizer_MeshCache_h
+
+// Binary .vmesh cache of a parsed and normalized mesh, written next to its source
+// file. Holds the rescaled vertex positions, the triangle indices and the bounding
+// box, and is only trusted while the source keeps the size and mtime it was
+// written for.
+//
+// Layout (native byte order):
+//   VMeshHeader
+//   float    vertices[num_vertices][3]   at vertex_offset
+//   uint32_t indices[num_triangles][3]   at index_offset
+
+#include "includes/CompFab.h"
+#include "includes/Mesh.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define VMESH_VERSION 1
+
+struct VMeshHeader {
+	char magic[8];
+	// detects caches written on a machine with a different byte order
+	uint32_t byte_order;
+	uint32_t version;
+	uint64_t source_size;
+	// nanoseconds where the platform reports them, seconds otherwise
+	int64_t source_mtime;
+	uint64_t num_vertices, num_triangles;
+	uint64_t vertex_offset, index_offset;
+	float bbox_min[3], bbox_max[3];
+};
+
+// path of the cache belonging to a mesh file
+std::string vmesh_path(const std::string &source);
+
+// fills triangles and the bounding box from the cache of source.
+// Returns false if there is no cache or it is stale or malformed.
+bool load_vmesh(const char *source, std::vector<CompFab::Triangle> &triangles, CompFab::Vec3 &bbMin, CompFab::Vec3 &bbMax);
+
+// writes the cache of source for the already normalized mesh
+bool save_vmesh(const char *source, const Mesh &mesh, const CompFab::Vec3 &bbMin, const CompFab::Vec3 &bbMax);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef voxelizer_ObjReader_h
+#define voxelizer_ObjReader_h
+
+#include "includes/Mesh.h"
+
+// Memory mapped .obj reader. The file is split into chunks on line boundaries which
+// are parsed in parallel on the global thread pool and stitched back together.
+// Fills mesh.v, mesh.tex, mesh.t and mesh.texId like Mesh::read_obj, including the
+// fan triangulation of polygons. Returns false if the file cannot be mapped.
+bool read_obj_mapped(const char *filename, Mesh &mesh);
+
+// parses an in-memory .obj file, same as read_obj_mapped
+void parse_obj(const char *data, size_t size, Mesh &mesh);
+
+#endif
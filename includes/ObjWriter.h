@@ -0,0 +1,13 @@
+#ifndef voxelizer_ObjWriter_h
+#define voxelizer_ObjWriter_h
+
+#include "includes/CompFab.h"
+
+// Writes the surface of the filled voxels as an .obj mesh. Only faces between a
+// filled and an empty voxel are emitted, coplanar faces are merged into maximal
+// rectangles (greedy meshing) and faces share their corner vertices. The mesh is
+// streamed to the file, so time and size grow with the surface, not the volume.
+// Returns false if the file could not be written.
+bool save_voxels_obj(const CompFab::VoxelGrid &grid, const char *filename);
+
+#endif
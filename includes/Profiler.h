@@ -0,0 +1,118 @@
+#ifndef voxelizer_Profiler_h
+#define voxelizer_Profiler_h
+
+// Wall clock timers of the phases of a run and counters of the ray engines.
+// A ScopedTimer adds the time until it goes out of scope to its phase, so a
+// phase may run many times and on several threads. Profiler::global() sums the
+// phases for the table of -v, and with tracing on also keeps every timed scope
+// for a trace-event file chrome://tracing and Perfetto open.
+//
+// The rays cast, triangles tested and crossings found are counted per thread by
+// PROFILE_COUNT, which compiles to nothing unless the build sets
+// VOXELIZER_COUNTERS (cmake -DVOXELIZER_COUNTERS=ON), as the counts cost time in
+// the innermost loops.
+
+#include <atomic>
+#include <chrono>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#ifndef VOXELIZER_COUNTERS
+#define VOXELIZER_COUNTERS 0
+#endif
+
+// timed scopes kept for a trace at most, the phases still sum the later ones
+#define PROFILE_MAX_EVENTS (1 << 20)
+
+enum ProfileCounter { COUNT_RAYS, COUNT_TRIANGLE_TESTS, COUNT_HITS, COUNT_VOXELS_FILLED, PROFILE_COUNTERS };
+
+#if VOXELIZER_COUNTERS
+#define PROFILE_COUNT(counter, n) Profiler::count(counter, n)
+#else
+#define PROFILE_COUNT(counter, n) ((void) 0)
+#endif
+
+class Profiler {
+public:
+	struct Phase {
+		std::string name;
+		size_t calls;
+		double total_us, max_us;
+	};
+
+	Profiler();
+
+	static Profiler &global();
+
+	// microseconds since the profiler was created
+	double now() const { return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_start).count(); }
+
+	// keep the timed scopes for writeTrace
+	void setTracing(bool tracing) { m_tracing = tracing; }
+	void record(const char *phase, double start_us, double end_us);
+
+	// adds to a counter of the calling thread. Cheap enough for the inner loops,
+	// which still only call it through PROFILE_COUNT
+	static void count(ProfileCounter counter, uint64_t n)
+	{
+		std::atomic<uint64_t> &value = thread_record().counters[counter];
+		value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+	// the sum over all threads
+	uint64_t counter(ProfileCounter counter) const;
+	static const char *counterName(ProfileCounter counter);
+
+	// in the order they first ran
+	std::vector<Phase> phases() const;
+
+	// the phases and counters as a table, wall_us the time of the whole run
+	void printTable(std::ostream &out, double wall_us) const;
+	// the timed scopes as complete events and the phases and counters as
+	// otherData of a JSON trace-event file
+	bool writeTrace(const char *filename) const;
+
+private:
+	struct ThreadRecord {
+		int tid;
+		std::atomic<uint64_t> counters[PROFILE_COUNTERS];
+	};
+	struct Event {
+		const char *phase;
+		int tid;
+		double start_us, duration_us;
+	};
+
+	static ThreadRecord &thread_record();
+	ThreadRecord *add_thread();
+
+	std::chrono::steady_clock::time_point m_start;
+	bool m_tracing;
+	mutable std::mutex m_mutex;
+	std::vector<std::unique_ptr<ThreadRecord> > m_threads;
+	std::map<std::string, size_t> m_phaseIndex;
+	std::vector<Phase> m_phases;
+	std::vector<Event> m_events;
+	size_t m_droppedEvents;
+};
+
+// adds the time from construction to destruction to a phase of the global profiler
+class ScopedTimer {
+public:
+	// phase must outlive the profiler, like a string literal
+	explicit ScopedTimer(const char *phase) : m_phase(phase), m_start(Profiler::global().now()) {}
+	~ScopedTimer() { Profiler::global().record(m_phase, m_start, Profiler::global().now()); }
+
+private:
+	ScopedTimer(const ScopedTimer &);
+	ScopedTimer &operator=(const ScopedTimer &);
+
+	const char *m_phase;
+	double m_start;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef voxelizer_RawWriter_h
+#define voxelizer_RawWriter_h
+
+// Raw dump of the bit-packed grid: an ascii header in the style of binvox followed
+// by the words of the grid in memory order, z slowest, then y, then the words of a
+// row, in native byte order. Voxel x of a row is bit x%64 of word x/64.
+//
+//   #raw 1
+//   dim <x> <y> <z>
+//   translate <x> <y> <z>
+//   scale <spacing>
+//   data
+//   uint64_t words[z][y][(x + 63) / 64]
+
+#include "includes/CompFab.h"
+
+#include <cstdio>
+
+class RawWriter {
+public:
+	RawWriter() : m_file(NULL), m_failed(false) {}
+	~RawWriter();
+
+	bool open(const char *filename);
+	void write_header(unsigned int dimX, unsigned int dimY, unsigned int dimZ,
+		const CompFab::Vec3 &translate, CompFab::precision_type scale);
+	void write(const CompFab::Word *words, size_t count);
+	// false if any write failed
+	bool close();
+
+private:
+	FILE *m_file;
+	bool m_failed;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef voxelizer_ResultCache_h
+#define voxelizer_ResultCache_h
+
+// On-disk cache of voxelized grids, so a mesh voxelized again with the same
+// settings is read back instead of voxelized. An entry is named by a hash of the
+// triangles and every option that changes the voxels, and holds the grid in the
+// raw format. Each use of an entry sets its mtime, and storing a grid removes
+// the entries used longest ago until the directory fits its byte budget.
+//
+// Several processes may share a directory: entries are written to a temporary
+// file and renamed into place. The hit, miss and eviction counts of all runs are
+// summed in the stats file of the directory. One ResultCache may be used by
+// several threads at once.
+
+#include "includes/Voxelizer.h"
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+// bump when a change to the voxelization changes the voxels of a grid
+#define RESULT_CACHE_VERSION 1
+
+class ResultCache {
+public:
+	// creates the directory if it does not exist
+	ResultCache(const std::string &directory, size_t max_bytes);
+	// adds the counts of this run to the stats file
+	~ResultCache();
+
+	// names the dim^3 grid the voxelizer fills with these options, placed by placeGrid
+	static uint64_t key(const Voxelizer &voxelizer, const VoxelizeOptions &options, unsigned int dim);
+
+	// fills the grid, placed by placeGrid, from the entry of key. False on a miss,
+	// also when the entry sits elsewhere than the grid
+	bool load(uint64_t key, CompFab::VoxelGrid &grid);
+	// adds the grid as the entry of key and evicts beyond the budget
+	bool store(uint64_t key, const CompFab::VoxelGrid &grid);
+
+	// entries and bytes in the directory
+	void usage(size_t &entries, size_t &bytes) const;
+	const std::string &directory() const { return m_directory; }
+	size_t maxBytes() const { return m_maxBytes; }
+
+	// counts of this run, and of all runs including this one
+	size_t hits() const { return m_hits; }
+	size_t misses() const { return m_misses; }
+	size_t evictions() const { return m_evictions; }
+	void totals(size_t &hits, size_t &misses, size_t &evictions) const;
+
+private:
+	ResultCache(const ResultCache &);
+	ResultCache &operator=(const ResultCache &);
+
+	std::string path(uint64_t key) const;
+	void evict();
+
+	std::string m_directory;
+	size_t m_maxBytes;
+	std::atomic<size_t> m_hits, m_misses, m_evictions;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef voxelizer_SimdIntersect_h
+#define voxelizer_SimdIntersect_h
+
+// Möller–Trumbore crossing counts for the CPU backend, testing one ray against 4,
+// 8 or 16 triangles at once. The triangles are kept in structure of arrays layout
+// with the first vertex and both edges precomputed. The kernel is picked at run
+// time from SSE4, AVX2 and AVX-512 by what the cpu supports. Every kernel,
+// including the scalar fallback, does the same float operations in the same order
+// without fused multiply-adds, so they all report exactly the same crossings.
+
+#include "includes/CompFab.h"
+#include "includes/raycast.h"
+
+#include <vector>
+
+// lanes of the widest kernel, the arrays are padded by this many triangles
+#define SIMD_MAX_LANES 16
+
+struct TriangleSoA {
+	TriangleSoA() : m_count(0) {}
+
+	void build(const std::vector<CompFab::Triangle> &triangles);
+	// copies the triangles at the given indices of another SoA
+	void build(const TriangleSoA &from, const unsigned int *indices, size_t count);
+
+	// x, y and z of the first vertex and of the edges v2-v1 and v3-v1
+	std::vector<float> m_v1[3], m_e1[3], m_e2[3];
+	size_t m_count;
+};
+
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE4, SIMD_AVX2, SIMD_AVX512 };
+
+// counts the triangles in [begin, end) the ray crosses in front of its origin
+typedef unsigned int (*CrossingKernel)(const TriangleSoA &soa, size_t begin, size_t end, vec3f dir, vec3f pos);
+
+// the widest level the cpu supports, lowered by setting VOXELIZER_SIMD to
+// scalar, sse4 or avx2
+SimdLevel simd_level();
+const char *simd_level_name(SimdLevel level);
+// the kernel of a level, falls back to narrower ones the build does not have
+CrossingKernel crossing_kernel(SimdLevel level);
+
+inline unsigned int count_crossings(const TriangleSoA &soa, size_t begin, size_t end, vec3f dir, vec3f pos)
+{
+	static const CrossingKernel kernel = crossing_kernel(simd_level());
+	return kernel(soa, begin, end, dir, pos);
+}
+
+#endif
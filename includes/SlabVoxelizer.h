@@ -0,0 +1,67 @@
+#ifndef voxelizer_SlabVoxelizer_h
+#define voxelizer_SlabVoxelizer_h
+
+// Out-of-core voxelization for grids that do not fit in memory. The grid is
+// voxelized a range of z layers at a time into a slab grid of its own (see
+// VoxelGrid::m_firstZ), and every finished slab is written out and freed before
+// the next one is allocated. Peak memory is set by the budget, not the resolution.
+
+#include "includes/CompFab.h"
+#include "includes/BVH.h"
+
+#include <functional>
+#include <vector>
+
+class BrickMap;
+
+class SlabVoxelizer {
+public:
+	// fills a slab from the triangles that can reach it and a BVH over them
+	typedef std::function<void(CompFab::VoxelGrid *slab, const std::vector<CompFab::Triangle> &triangles, const BVH *bvh)> VoxelizeFn;
+
+	// max_memory is the number of bytes the grid buffers may take at once
+	SlabVoxelizer(const CompFab::Vec3 &lowerLeft, unsigned int dimX, unsigned int dimY, unsigned int dimZ,
+		CompFab::precision_type spacing, size_t max_memory);
+
+	// hand every slab only the triangles overlapping its layers. Only correct if
+	// all rays stay in the z layer of their voxel, i.e. for the fixed +X direction
+	void set_culling(bool cull) { m_cull = cull; }
+
+	// bytes the buffers take at least whatever the budget: a slab of one z layer,
+	// and for binvox one word column next to the bit planes of the writer
+	static size_t min_memory(unsigned int dimX, unsigned int dimY, unsigned int dimZ, bool binvox);
+
+	// z layers per slab
+	unsigned int depth() const { return m_depth; }
+	// filled voxels of the last run
+	size_t filled() const { return m_filled; }
+
+	// voxelizes the grid into a raw file, see RawWriter.h. bvh is the BVH over all
+	// triangles, used as is when triangles are not culled
+	bool save_raw(const char *filename, const std::vector<CompFab::Triangle> &triangles, const BVH *bvh, const VoxelizeFn &voxelize);
+
+	// binvox runs over x slowest, so the slabs are spilled to a raw file next to
+	// the output first, which is then encoded a group of word columns at a time
+	bool save_binvox(const char *filename, const std::vector<CompFab::Triangle> &triangles, const BVH *bvh, const VoxelizeFn &voxelize);
+
+	// voxelizes the grid into a sparse brick map of the same dimensions, in slabs
+	// of whole bricks
+	void save_bricks(BrickMap &bricks, const std::vector<CompFab::Triangle> &triangles, const BVH *bvh, const VoxelizeFn &voxelize);
+
+private:
+	typedef std::function<void(const CompFab::VoxelGrid &slab)> SlabFn;
+
+	// voxelizes all slabs of the given depth in order and hands them to done
+	void run(unsigned int depth, const std::vector<CompFab::Triangle> &triangles, const BVH *bvh, const VoxelizeFn &voxelize, const SlabFn &done);
+	bool encode_binvox(const char *spill, const char *filename);
+
+	CompFab::Vec3 m_lowerLeft;
+	unsigned int m_dimX, m_dimY, m_dimZ, m_wordsPerRow;
+	CompFab::precision_type m_spacing;
+	size_t m_maxMemory;
+	unsigned int m_depth;
+	bool m_cull;
+	size_t m_filled;
+};
+
+#endif
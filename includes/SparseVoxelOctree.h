@@ -0,0 +1,70 @@
+#ifndef voxelizer_SparseVoxelOctree_h
+#define voxelizer_SparseVoxelOctree_h
+
+// Sparse voxel octree over a power of two cube enclosing the grid, for shipping
+// high resolution grids to viewers and collision queries. A node whose voxels are
+// all empty or all full is only a state in its parent, so a tree holds the mixed
+// nodes along the surface, down to leaves of LEAF_SIZE^3 voxels packed in a word.
+//
+// The file stores the tree pointerless and breadth first: a 16 bit mask per mixed
+// node, two bits per child, and the children of the mixed nodes of one level, in
+// the order of their parents, make up the next level. Children are numbered
+// x + 2y + 4z, voxel (x, y, z) of a leaf is bit x + 4y + 16z. Native byte order.
+//
+//   #svo 1
+//   dim <x> <y> <z>
+//   translate <x> <y> <z>
+//   scale <spacing>
+//   levels <L>                 side of the cube: LEAF_SIZE << L
+//   root <0|1|2>               empty, full or mixed
+//   nodes <n_0> ... <n_L-1>    mixed nodes per level
+//   leaves <m>
+//   data
+//   uint16_t masks[n_0 + ... + n_L-1]
+//   uint64_t leaves[m]
+
+#include "includes/CompFab.h"
+
+#include <vector>
+#include <stdint.h>
+
+class SparseVoxelOctree {
+public:
+	enum { EMPTY = 0, FULL = 1, MIXED = 2 };
+	enum { LEAF_SIZE = 4 };
+
+	SparseVoxelOctree();
+
+	// builds the tree of a complete grid bottom up, the subtrees in parallel
+	void build(const CompFab::VoxelGrid &grid);
+
+	// false if the file could not be written or read, a file that does not check
+	// out leaves the tree as it was
+	bool save(const char *filename) const;
+	bool load(const char *filename);
+
+	bool isInside(unsigned int i, unsigned int j, unsigned int k) const;
+
+	// mixed nodes of all levels
+	size_t nodes() const;
+	size_t leaves() const { return m_leaves.size(); }
+
+	unsigned int m_dimX, m_dimY, m_dimZ;
+	unsigned int m_levels;
+	int m_root;
+	CompFab::precision_type m_spacing;
+	CompFab::Vec3 m_lowerLeft;
+
+private:
+	// finds the first child of every mixed node for the queries
+	void link();
+
+	// child masks of the mixed nodes per level
+	std::vector<std::vector<uint16_t> > m_masks;
+	// per level, the index in the next level (the leaves below the last) of the
+	// first mixed child of each node
+	std::vector<std::vector<uint32_t> > m_firstChild;
+	std::vector<CompFab::Word> m_leaves;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef voxelizer_ThreadPool_h
+#define voxelizer_ThreadPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that cooperatively execute parallel_for jobs.
+// The calling thread participates in its own job, so nested or concurrent
+// parallel_for calls from several threads make progress without deadlocking.
+class ThreadPool {
+public:
+	// threads == 0 uses every hardware thread
+	explicit ThreadPool(unsigned int threads = 0);
+	~ThreadPool();
+
+	// calls fn(i) for every i in [begin, end) and blocks until all calls returned
+	void parallel_for(size_t begin, size_t end, const std::function<void(size_t)> &fn);
+
+	// number of threads executing work, including the caller
+	unsigned int size() const { return m_workers.size() + 1; }
+
+	// process wide pool used by the voxelization backends
+	static ThreadPool &global();
+	// resize the global pool, must be called before it is first used. Later calls
+	// only warn
+	static void set_global_threads(unsigned int threads);
+
+private:
+	struct Job {
+		const std::function<void(size_t)> *fn;
+		size_t begin, end;
+		std::atomic<size_t> next;
+		std::atomic<size_t> finished;
+	};
+
+	void worker();
+	// runs indices of the given job until none are left to claim
+	void run(Job &job);
+
+	std::vector<std::thread> m_workers;
+	std::deque<std::shared_ptr<Job> > m_jobs;
+	std::mutex m_mutex;
+	std::condition_variable m_wake, m_done;
+	bool m_stop;
+};
+
+#endif
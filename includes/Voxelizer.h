@@ -0,0 +1,104 @@
+#ifndef voxelizer_Voxelizer_h
+#define voxelizer_Voxelizer_h
+
+// The voxelizer as a library (libvoxelizer). A Voxelizer owns a mesh, the BVH
+// over it and the placement of grids around it, and fills grids its caller owns.
+// There is no global state besides the worker threads of ThreadPool::global(), so
+// a process may keep a Voxelizer per mesh and reuse it for any number of grids.
+// The const members may be called from several threads at once.
+//
+//   Voxelizer voxelizer;
+//   voxelizer.setMesh(TriangleSpan(triangles, count));
+//   CompFab::VoxelGrid *grid = voxelizer.newGrid(256);
+//   voxelizer.voxelize(VoxelizeOptions(), *grid);
+
+#include "includes/CompFab.h"
+#include "includes/BVH.h"
+
+#include <vector>
+
+class BrickMap;
+
+enum Backend { cpu, cuda };
+enum VoxelizeMode { ray, scanline, tiled, parity, surface, flood };
+
+// name of a mode on the command line
+const char *modeName(VoxelizeMode mode);
+
+// triangles the caller keeps alive, like std::span<const CompFab::Triangle>
+struct TriangleSpan {
+	TriangleSpan() : m_data(NULL), m_size(0) {}
+	TriangleSpan(const CompFab::Triangle *data, size_t size) : m_data(data), m_size(size) {}
+	TriangleSpan(const std::vector<CompFab::Triangle> &triangles) : m_data(triangles.empty() ? NULL : &triangles[0]), m_size(triangles.size()) {}
+
+	const CompFab::Triangle *begin() const { return m_data; }
+	const CompFab::Triangle *end() const { return m_data + m_size; }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	const CompFab::Triangle &operator[](size_t i) const { return m_data[i]; }
+
+	const CompFab::Triangle *m_data;
+	size_t m_size;
+};
+
+// how a grid is voxelized, the defaults are those of the command line
+struct VoxelizeOptions {
+	VoxelizeOptions();
+
+	Backend backend;
+	VoxelizeMode mode;
+	bool double_thick;
+	// ray mode: test one voxel per brick the surface does not pass through
+	bool bricks;
+	// surface and flood modes: 6 or 26 separating shell
+	int separating;
+	// flood mode: radius of the dilation closing holes in the surface, 0 for none
+	int close;
+	// ray mode: rays per voxel in sampled directions, 0 or less for the +X ray only
+	int samples;
+	// seed of the sample directions, the same seed gives the same grid
+	unsigned int seed;
+};
+
+class Voxelizer {
+public:
+	typedef std::vector<CompFab::Triangle> TriangleList;
+
+	Voxelizer() {}
+
+	// reads a mesh file, normalized to the unit cube, or its .vmesh cache. False if
+	// it has no triangles
+	bool load(const char *filename, bool use_cache = true);
+	// copies the triangles and builds the BVH over them
+	void setMesh(TriangleSpan triangles);
+
+	const TriangleList &triangles() const { return m_triangles; }
+	const BVH &bvh() const { return m_bvh; }
+	const CompFab::Vec3 &bbMin() const { return m_bbMin; }
+	const CompFab::Vec3 &bbMax() const { return m_bbMax; }
+
+	// corner and voxel size of the dim^3 grid around the mesh, with half a voxel
+	// of margin on every side
+	void placeGrid(unsigned int dim, CompFab::Vec3 &lowerLeft, double &spacing) const;
+	// an empty grid placed like that, the caller deletes it
+	CompFab::VoxelGrid *newGrid(unsigned int dim) const;
+
+	// fills grid, which may be a slab of layers firstZ.. of a grid placed by
+	// placeGrid, with the selected engine
+	void voxelize(const VoxelizeOptions &options, CompFab::VoxelGrid &grid) const;
+
+	// voxelizes the dim^3 grid in slabs taking at most max_memory bytes and streams
+	// them to a binvox or raw file, see SlabVoxelizer. filled counts its voxels
+	bool voxelizeToFile(const VoxelizeOptions &options, unsigned int dim, size_t max_memory,
+		const char *filename, bool raw, size_t &filled) const;
+
+	// voxelizes a brick map, placed by placeGrid, in slabs of at most max_memory bytes
+	void voxelizeBricks(const VoxelizeOptions &options, BrickMap &bricks, size_t max_memory) const;
+
+private:
+	TriangleList m_triangles;
+	BVH m_bvh;
+	CompFab::Vec3 m_bbMin, m_bbMax;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef voxelizer_VoxelizerCache_h
+#define voxelizer_VoxelizerCache_h
+
+// Loaded meshes with their BVH, keyed by a hash of the mesh contents, so jobs on
+// a mesh seen before skip the parse and the build. Holds at most a fixed number
+// of meshes and drops the least recently used first; a dropped voxelizer lives
+// on until the jobs using it are done. Jobs asking for a mesh that is being
+// loaded wait for that load instead of loading it again.
+
+#include "includes/Voxelizer.h"
+#include "includes/hash.h"
+
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <stdint.h>
+
+class VoxelizerCache {
+public:
+	typedef std::shared_ptr<const Voxelizer> Entry;
+
+	explicit VoxelizerCache(size_t capacity) : m_capacity(capacity < 1 ? 1 : capacity), m_hits(0), m_misses(0) {}
+
+	// the voxelizer of key, made by load on a miss. A load returning NULL (an
+	// unreadable mesh) is not kept. hit tells whether it was in the cache
+	Entry get(uint64_t key, const std::function<Entry()> &load, bool &hit);
+
+	// meshes held, and gets answered from the cache and by a load so far
+	void counts(size_t &size, size_t &hits, size_t &misses);
+
+private:
+	typedef std::list<std::pair<uint64_t, Entry> > Order;
+
+	size_t m_capacity;
+	size_t m_hits, m_misses;
+	// most recently used first
+	Order m_order;
+	std::unordered_map<uint64_t, Order::iterator> m_index;
+	std::set<uint64_t> m_loading;
+	std::mutex m_mutex;
+	std::condition_variable m_loaded;
+};
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef voxelizer_args_h
+#define voxelizer_args_h
+
 #include <iostream>
 #include <string>
 #include <sstream>
@@ -20,3 +23,5 @@ struct Args {
 		}
 	}
 };
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef voxelizer_batch_h
+#define voxelizer_batch_h
+
+// Voxelizes every job of a manifest in one process. A manifest has a job per
+// line, blank lines and lines starting with # are skipped:
+//
+//   <input path> <output path> [resolution] [samples]
+//
+// Resolution and samples default to -r and -s, all other settings come from the
+// command line. The jobs run through three stages connected by bounded queues:
+// a thread loads the meshes, the calling thread voxelizes them on the thread
+// pool, and another thread writes the grids. Loading the next mesh and writing
+// the last grid so overlap the current voxelization. Meshes and grids are
+// recycled between jobs.
+
+#include "includes/pipeline.h"
+
+#include <string>
+
+// jobs the load stage may run ahead of the voxelization, and finished grids
+// that may wait for the writer
+#define BATCH_QUEUE_DEPTH 2
+// MiB of returned grids kept for the next jobs
+#define BATCH_POOL_MEMORY 1024
+
+// runs all jobs of the manifest and prints a line per job and the throughput of
+// the batch. False if the manifest could not be read or a job failed
+bool runBatch(VoxelizerArgs *args, const std::string &manifest);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef voxelizer_bits_h
+#define voxelizer_bits_h
+
+// Bit manipulation on the 64 bit words of the packed voxel grid.
+
+#include "includes/CompFab.h"
+
+// transposes a 64x64 bit matrix in place: afterwards bit i of a[b] is what bit b
+// of a[i] was. Swaps ever smaller off diagonal blocks, see Hacker's Delight 7-3.
+inline void transpose64(CompFab::Word a[64])
+{
+	CompFab::Word m = 0x00000000FFFFFFFFull;
+	for (unsigned int j = 32; j != 0; j >>= 1, m ^= m << j) {
+		for (unsigned int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+			CompFab::Word t = ((a[k] >> j) ^ a[k | j]) & m;
+			a[k] ^= t << j;
+			a[k | j] ^= t;
+		}
+	}
+}
+
+// bits [begin, end) of word w of a bit row, begin < end
+inline CompFab::Word range_mask(unsigned int w, unsigned int begin, unsigned int end)
+{
+	unsigned int first = w * CompFab::VOXELS_PER_WORD;
+	unsigned int lo = begin > first ? begin - first : 0;
+	unsigned int hi = end - first >= CompFab::VOXELS_PER_WORD ? CompFab::VOXELS_PER_WORD : end - first;
+	CompFab::Word upto = hi == CompFab::VOXELS_PER_WORD ? ~CompFab::Word(0) : (CompFab::Word(1) << hi) - 1;
+	return upto & (~CompFab::Word(0) << lo);
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef voxelizer_bricks_h
+#define voxelizer_bricks_h
+
+// Coarse classification of a voxel grid into bricks of BRICK_SIZE^3 voxels. The
+// voxels of a brick no triangle touches can be joined without crossing the
+// surface, so they are all inside or all outside and one parity test decides them.
+
+#include "includes/CompFab.h"
+
+#include <vector>
+
+#define BRICK_SIZE 8
+
+struct SurfaceBricks {
+	SurfaceBricks() : m_bricksX(0), m_bricksY(0), m_bricksZ(0) {}
+
+	// marks the bricks of grid, which may be a slab of a larger grid, that the
+	// triangles touch
+	void build(const CompFab::VoxelGrid &grid, const std::vector<CompFab::Triangle> &triangles);
+
+	size_t index(unsigned int bx, unsigned int by, unsigned int bz) const
+	{
+		return ((size_t) bz*m_bricksY + by)*m_bricksX + bx;
+	}
+
+	bool surface(unsigned int bx, unsigned int by, unsigned int bz) const { return m_surface[index(bx, by, bz)] != 0; }
+
+	// number of bricks touched by a triangle
+	size_t count() const;
+
+	unsigned int m_bricksX, m_bricksY, m_bricksZ;
+	// 1 for every brick touched by a triangle, x fastest
+	std::vector<unsigned char> m_surface;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef voxelizer_daemon_h
+#define voxelizer_daemon_h
+
+// voxelizerd: serves voxelization jobs on a Unix domain socket, so a service
+// sending many jobs pays for the process start once and for a mesh parse and BVH
+// build once per mesh. Meshes are kept in a VoxelizerCache keyed by the hash of
+// their contents, the jobs of all connections run on a fixed number of job
+// workers that share the thread pool.
+//
+// A client sends a line per request and reads a line back. Requests are a word
+// followed by key=value fields:
+//
+//   voxelize mesh=<path> output=<path>|shm [resolution=N] [mode=M] [samples=N]
+//            [seed=N] [format=binvox|raw|obj|svo] [double=0|1] [bricks=0|1]
+//            [separating=6|26] [close=N]
+//   voxelize triangles=<count> output=... [...]
+//       followed by count*9 native float32 vertex coordinates
+//   stats
+//   shutdown
+//
+// Fields left out take the value of the command line, a resolution is at most
+// DAEMON_MAX_RESOLUTION. The answer is "ok" and
+// key=value fields, or "error <message>":
+//
+//   ok file=<output>.<format> filled=N ms=T cached=0|1 stored=0|1
+//   ok shm=<name> bytes=N dim=X,Y,Z translate=X,Y,Z scale=S filled=N ms=T cached=0|1 stored=0|1
+//
+// An shm result is a POSIX shared memory object holding the words of the grid
+// in the layout of the raw format, which the client maps and then unlinks.
+// cached tells whether the mesh was loaded already, stored whether the grid came
+// from the --result-cache.
+
+#include "includes/pipeline.h"
+
+// jobs voxelized at once, each on the shared thread pool
+#define DAEMON_JOBS 2
+// jobs waiting for a worker before the connections sending more block
+#define DAEMON_QUEUE_DEPTH 16
+// MiB of returned grids kept for the next jobs
+#define DAEMON_POOL_MEMORY 1024
+// largest resolution of a job, its grid takes DAEMON_POOL_MEMORY MiB
+#define DAEMON_MAX_RESOLUTION 2048
+
+// serves args->daemon until a shutdown request, SIGINT or SIGTERM. False if the
+// socket could not be opened
+bool runDaemon(VoxelizerArgs *args);
+
+#endif
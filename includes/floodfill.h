@@ -0,0 +1,21 @@
+#ifndef voxelizer_floodfill_h
+#define voxelizer_floodfill_h
+
+// Solidification of a voxelized surface without rays: the voxels a 6-connected
+// path from outside the grid reaches without crossing the surface are outside,
+// all others inside. Works on whole words of the packed grid, filling along the
+// rows with bit operations and sweeping the rows along y and z until nothing changes.
+
+#include "includes/CompFab.h"
+
+// grows the occupied voxels of the grid by radius voxels along every axis, the
+// occupied set becomes its union with the cubes of side 2*radius+1 around them
+void dilate(CompFab::VoxelGrid *grid, int radius);
+
+// replaces the surface in the grid, a complete grid and not a slab, by the solid
+// it encloses. With a close radius the surface is dilated by it before the fill
+// so holes up to about 2*radius voxels wide do not leak, and the exterior is
+// dilated back by it afterwards.
+void solidify(CompFab::VoxelGrid *grid, int close_radius);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef voxelizer_hash_h
+#define voxelizer_hash_h
+
+#include <cstddef>
+#include <stdint.h>
+
+// 64-bit FNV-1a of a block of bytes, chained through hash for several blocks
+inline uint64_t content_hash(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+	const unsigned char *bytes = (const unsigned char *) data;
+	for (size_t i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	return hash;
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef voxelizer_morton_h
+#define voxelizer_morton_h
+
+// Morton (Z-order) codes of 3D coordinates of up to 21 bits: bit b of x, y and z
+// goes to bit 3b, 3b+1 and 3b+2 of the code. MortonMagic spreads the bits with
+// shifts and masks and runs anywhere. MortonBmi2 does it with one pdep or pext, its
+// callers have to be compiled for BMI2 (see morton_bmi2_supported) to inline it.
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MORTON_X86 1
+#include <immintrin.h>
+#else
+#define MORTON_X86 0
+#endif
+
+#define MORTON_X_BITS 0x9249249249249249ull
+
+struct MortonMagic {
+	static const char *name() { return "magic"; }
+
+	static inline uint64_t spread(uint32_t x)
+	{
+		uint64_t v = x & 0x1FFFFF;
+		v = (v | v << 32) & 0x001F00000000FFFFull;
+		v = (v | v << 16) & 0x001F0000FF0000FFull;
+		v = (v | v << 8) & 0x100F00F00F00F00Full;
+		v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+		v = (v | v << 2) & 0x1249249249249249ull;
+		return v;
+	}
+
+	static inline uint32_t compact(uint64_t v)
+	{
+		v &= 0x1249249249249249ull;
+		v = (v | v >> 2) & 0x10C30C30C30C30C3ull;
+		v = (v | v >> 4) & 0x100F00F00F00F00Full;
+		v = (v | v >> 8) & 0x001F0000FF0000FFull;
+		v = (v | v >> 16) & 0x001F00000000FFFFull;
+		v = (v | v >> 32) & 0x1FFFFF;
+		return (uint32_t) v;
+	}
+};
+
+#if MORTON_X86
+struct MortonBmi2 {
+	static const char *name() { return "bmi2"; }
+
+	__attribute__((target("bmi2")))
+	static inline uint64_t spread(uint32_t x) { return _pdep_u64(x, MORTON_X_BITS); }
+
+	__attribute__((target("bmi2")))
+	static inline uint32_t compact(uint64_t v) { return (uint32_t) _pext_u64(v, MORTON_X_BITS); }
+};
+#else
+struct MortonBmi2 : MortonMagic {};
+#endif
+
+template <class Morton>
+inline uint64_t morton_encode(uint32_t x, uint32_t y, uint32_t z)
+{
+	return Morton::spread(x) | Morton::spread(y) << 1 | Morton::spread(z) << 2;
+}
+
+template <class Morton>
+inline void morton_decode(uint64_t code, uint32_t &x, uint32_t &y, uint32_t &z)
+{
+	x = Morton::compact(code);
+	y = Morton::compact(code >> 1);
+	z = Morton::compact(code >> 2);
+}
+
+// whether the cpu runs pdep and pext
+inline bool morton_bmi2_supported()
+{
+#if MORTON_X86
+	return __builtin_cpu_supports("bmi2");
+#else
+	return false;
+#endif
+}
+
+#endif
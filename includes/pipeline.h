@@ -0,0 +1,77 @@
+#ifndef voxelizer_pipeline_h
+#define voxelizer_pipeline_h
+
+// The command line side of a voxelizer run, shared by the command line tool and
+// the benchmarks: the arguments, and voxelizing to and saving in the output
+// formats with a Voxelizer (see Voxelizer.h) that holds the mesh.
+
+#include "includes/args.h"
+#include "includes/CompFab.h"
+#include "includes/BrickMap.h"
+#include "includes/ResultCache.h"
+#include "includes/Voxelizer.h"
+
+#include <string>
+#include <vector>
+
+enum FileFormat { obj, binvox, raw, svo };
+
+// MiB of the slabs a sparse grid is voxelized in without --max-memory
+#define SPARSE_SLAB_MEMORY 64
+
+#if USE_CUDA
+#define DEFAULT_BACKEND "cuda"
+#else
+#define DEFAULT_BACKEND "cpu"
+#endif
+
+struct VoxelizerArgs : Args, VoxelizeOptions {
+	// path to files
+	std::string input, output;
+	FileFormat format;
+	// read and write the binary .vmesh cache next to the input
+	bool mesh_cache;
+	// voxelization settings
+	int size;
+	// worker threads for the cpu backend, 0 for all cores
+	int threads;
+	// MiB the grid may take at once, 0 keeps the whole grid in memory
+	int max_memory;
+	// keep the grid in a sparse brick map, voxelized in slabs
+	bool sparse;
+	// manifest of a --batch run, empty for a single mesh
+	std::string batch;
+	// socket of a --daemon run, and the meshes it keeps loaded
+	std::string daemon;
+	int cached_meshes;
+	// directory of the on-disk result cache, empty without one, and its MiB
+	std::string result_cache;
+	int result_cache_size;
+	// trace-event file of the timed phases, empty without one
+	std::string trace;
+};
+
+// voxelizes the grid slab by slab within the --max-memory budget, streaming every
+// slab to the output file
+bool voxelizeSlabs(VoxelizerArgs *args, const Voxelizer &voxelizer, size_t &filled);
+
+// voxelizes the grid slab by slab into a sparse brick map, the slabs taking
+// --max-memory or SPARSE_SLAB_MEMORY MiB
+void voxelizeBricks(VoxelizerArgs *args, const Voxelizer &voxelizer, BrickMap &bricks);
+
+// writes a grid to the output path in the selected format
+bool save(VoxelizerArgs *args, const CompFab::VoxelGrid &grid);
+// the same to another output path and format, the extension of the format appended
+bool save(VoxelizerArgs *args, const std::string &output, FileFormat format, const CompFab::VoxelGrid &grid);
+// prints the hits, misses and evictions of the result cache at -v
+void reportResultCache(VoxelizerArgs *args, const ResultCache &cache);
+// prints the time of every phase and the counters at -v, and writes the --trace
+// file. False when the trace cannot be written
+bool reportProfile(VoxelizerArgs *args);
+// extension of the files of a format, without the dot
+const char *formatExtension(FileFormat format);
+
+// writes a brick map to the output path, binvox or raw
+bool saveBricks(VoxelizerArgs *args, const BrickMap &bricks);
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef voxelizer_raycast_h
+#define voxelizer_raycast_h
+
+// Ray casting primitives shared by the CUDA kernels and the CPU backend, so both
+// engines make the exact same inside/outside decisions.
+
+#include "includes/CompFab.h"
+
+#include <math.h>
+
+#ifdef __CUDACC__
+#define HOST_DEVICE __host__ __device__
+#else
+#define HOST_DEVICE
+#endif
+
+#define EPSILONF 0.000001
+#define E_PI 3.1415926535897932384626433832795028841971693993751058209749445923078164062
+
+struct vec3f { float x, y, z; };
+
+HOST_DEVICE inline vec3f make_vec3f(float x, float y, float z)
+{
+	vec3f v = {x, y, z};
+	return v;
+}
+
+HOST_DEVICE inline vec3f make_vec3f(const CompFab::Vec3 &v)
+{
+	return make_vec3f(v.m_x, v.m_y, v.m_z);
+}
+
+HOST_DEVICE inline vec3f operator-(const vec3f &a, const vec3f &b)
+{
+	return make_vec3f(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+HOST_DEVICE inline vec3f cross(const vec3f &a, const vec3f &b)
+{
+	return make_vec3f(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+}
+
+HOST_DEVICE inline float dot(const vec3f &a, const vec3f &b)
+{
+	return a.x*b.x + a.y*b.y + a.z*b.z;
+}
+
+HOST_DEVICE inline bool inside(unsigned int numIntersections, bool double_thick) {
+	// if (double_thick && numIntersections % 2 == 0) return (numIntersections / 2) % 2 == 1;
+	if (double_thick) return (numIntersections / 2) % 2 == 1;
+	return numIntersections % 2 == 1;
+}
+
+// adapted from: https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm
+// on a hit stores the distance along the ray in t
+HOST_DEVICE inline bool intersects(const CompFab::Triangle &triangle, vec3f dir, vec3f pos, float &t) {
+	vec3f V1 = make_vec3f(triangle.m_v1.m_x, triangle.m_v1.m_y, triangle.m_v1.m_z);
+	vec3f V2 = make_vec3f(triangle.m_v2.m_x, triangle.m_v2.m_y, triangle.m_v2.m_z);
+	vec3f V3 = make_vec3f(triangle.m_v3.m_x, triangle.m_v3.m_y, triangle.m_v3.m_z);
+
+	//Find vectors for two edges sharing V1
+	vec3f e1 = V2 - V1;
+	vec3f e2 = V3 - V1;
+
+	// //Begin calculating determinant - also used to calculate u parameter
+	vec3f P = cross(dir, e2);
+
+	//if determinant is near zero, ray lies in plane of triangle
+	float det = dot(e1, P);
+
+	//NOT CULLING
+	if(det > -EPSILONF && det < EPSILONF) return false;
+	float inv_det = 1.f / det;
+
+	// calculate distance from V1 to ray origin
+	vec3f T = pos - V1;
+	//Calculate u parameter and test bound
+	float u = dot(T, P) * inv_det;
+	//The intersection lies outside of the triangle
+	if(u < 0.f || u > 1.f) return false;
+
+	//Prepare to test v parameter
+	vec3f Q = cross(T, e1);
+	//Calculate V parameter and test bound
+	float v = dot(dir, Q) * inv_det;
+	//The intersection lies outside of the triangle
+	if(v < 0.f || u + v  > 1.f) return false;
+
+	t = dot(e2, Q) * inv_det;
+
+	if(t > EPSILONF) { // ray intersection
+		return true;
+	}
+
+	// No hit, no win
+	return false;
+}
+
+HOST_DEVICE inline bool intersects(const CompFab::Triangle &triangle, vec3f dir, vec3f pos) {
+	float t;
+	return intersects(triangle, dir, pos, t);
+}
+
+// maps two uniform random numbers in [0, 1] to a direction on the unit sphere.
+// Converts from polar to euclidean to get an even distribution
+HOST_DEVICE inline vec3f sample_direction(float r1, float r2)
+{
+	float theta = r1 * 2.f * E_PI;
+	float z = r2 * 2.f - 1.f;
+	float r = sqrtf(1.f - z*z);
+	return make_vec3f(r * cosf(theta), r * sinf(theta), z);
+}
+
+// integer hash with good avalanche (lowbias32), the counter based generator below
+HOST_DEVICE inline uint32_t hash_u32(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+// uniform float in [0, 1) for a key and counter, without any state to share
+HOST_DEVICE inline float random_unit(uint32_t key, uint32_t counter)
+{
+	return (hash_u32(key ^ hash_u32(counter + 0x9e3779b9U)) >> 8) * (1.f / 16777216.f);
+}
+
+// key of the sample directions of the voxel (x, y, z) of the whole grid
+HOST_DEVICE inline uint32_t voxel_key(uint32_t seed, unsigned int x, unsigned int y, unsigned int z)
+{
+	return hash_u32(seed ^ hash_u32(x ^ hash_u32(y ^ hash_u32(z))));
+}
+
+// direction of sample j of a voxel. The samples follow the R2 low discrepancy
+// sequence, so every prefix of them covers the sphere evenly, shifted by a random
+// offset per voxel so neighbouring voxels do not share their blind spots.
+HOST_DEVICE inline vec3f stratified_direction(uint32_t key, int j)
+{
+	float r1 = random_unit(key, 0) + j * 0.7548776662f;
+	float r2 = random_unit(key, 1) + j * 0.5698402910f;
+	return sample_direction(r1 - floorf(r1), r2 - floorf(r2));
+}
+
+// whether votes inside out of cast rays already settle the majority of samples
+// rays, either way
+HOST_DEVICE inline bool vote_decided(int votes, int cast, int samples)
+{
+	return votes > samples / 2 || cast - votes >= samples - samples / 2;
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef voxelizer_tribox_h
+#define voxelizer_tribox_h
+
+// Triangle/box overlap with the separating axis theorem, after Akenine-Möller,
+// "Fast 3D Triangle-Box Overlap Testing". The triangle and the axis aligned box
+// are disjoint if and only if one of 13 axes separates them: the 3 box normals,
+// the triangle normal, and the 9 cross products of box and triangle edges.
+// The voxels a triangle overlaps this way form a 26-separating surface. The thin
+// test below, after Schwarz and Seidel, "Fast Parallel Surface and Solid
+// Voxelization on GPUs", gives the 6-separating one.
+
+#include "includes/raycast.h"
+
+// projects the triangle (relative to the box center) and the box onto an axis.
+// Returns true if the projections are disjoint
+HOST_DEVICE inline bool separated(vec3f axis, vec3f v0, vec3f v1, vec3f v2, vec3f half)
+{
+	float p0 = dot(axis, v0), p1 = dot(axis, v1), p2 = dot(axis, v2);
+	float r = half.x*fabsf(axis.x) + half.y*fabsf(axis.y) + half.z*fabsf(axis.z);
+	return fminf(p0, fminf(p1, p2)) > r || fmaxf(p0, fmaxf(p1, p2)) < -r;
+}
+
+// does the triangle (a, b, c) touch the box center +- half
+HOST_DEVICE inline bool triangle_box_overlap(vec3f center, vec3f half, vec3f a, vec3f b, vec3f c)
+{
+	vec3f v0 = a - center, v1 = b - center, v2 = c - center;
+
+	// box normals: the bounding box of the triangle against the box
+	if (fminf(v0.x, fminf(v1.x, v2.x)) > half.x || fmaxf(v0.x, fmaxf(v1.x, v2.x)) < -half.x) return false;
+	if (fminf(v0.y, fminf(v1.y, v2.y)) > half.y || fmaxf(v0.y, fmaxf(v1.y, v2.y)) < -half.y) return false;
+	if (fminf(v0.z, fminf(v1.z, v2.z)) > half.z || fmaxf(v0.z, fmaxf(v1.z, v2.z)) < -half.z) return false;
+
+	vec3f e0 = v1 - v0, e1 = v2 - v1, e2 = v0 - v2;
+
+	// triangle normal
+	if (separated(cross(e0, e1), v0, v1, v2, half)) return false;
+
+	// cross products of the box axes with the triangle edges
+	vec3f edges[3] = {e0, e1, e2};
+	for (int i = 0; i < 3; ++i) {
+		vec3f e = edges[i];
+		if (separated(make_vec3f(0.f, -e.z, e.y), v0, v1, v2, half)) return false;
+		if (separated(make_vec3f(e.z, 0.f, -e.x), v0, v1, v2, half)) return false;
+		if (separated(make_vec3f(-e.y, e.x, 0.f), v0, v1, v2, half)) return false;
+	}
+	return true;
+}
+
+// does the triangle's projection along one axis, with coordinates (i, j) of the
+// triangle relative to the box center and n_k the normal's component along the
+// axis, overlap the diamond of radius h around the center
+HOST_DEVICE inline bool projection_overlaps_diamond(float n_k, float ai, float aj, float bi, float bj, float ci, float cj, float h)
+{
+	// edge normals point inside, a triangle seen edge on passes
+	float orient = n_k > 0.f ? 1.f : n_k < 0.f ? -1.f : 0.f;
+	float vi[3] = {ai, bi, ci}, vj[3] = {aj, bj, cj};
+	for (int m = 0; m < 3; ++m) {
+		int next = m == 2 ? 0 : m + 1;
+		float ni = -(vj[next] - vj[m]) * orient, nj = (vi[next] - vi[m]) * orient;
+		// edge function at the center plus the diamond's support along the normal
+		if (-(ni*vi[m] + nj*vj[m]) + h*fmaxf(fabsf(ni), fabsf(nj)) < 0.f) return false;
+	}
+	return true;
+}
+
+// does the triangle (a, b, c) touch the cube center +- h closely enough for a
+// 6-separating voxelization: its bounding box overlaps the cube, its plane passes
+// within h*|n|_inf of the center, and its projections along x, y and z overlap the
+// diamonds inscribed in the cube's
+HOST_DEVICE inline bool triangle_cube_overlap_thin(vec3f center, float h, vec3f a, vec3f b, vec3f c)
+{
+	vec3f v0 = a - center, v1 = b - center, v2 = c - center;
+	if (fminf(v0.x, fminf(v1.x, v2.x)) > h || fmaxf(v0.x, fmaxf(v1.x, v2.x)) < -h) return false;
+	if (fminf(v0.y, fminf(v1.y, v2.y)) > h || fmaxf(v0.y, fmaxf(v1.y, v2.y)) < -h) return false;
+	if (fminf(v0.z, fminf(v1.z, v2.z)) > h || fmaxf(v0.z, fmaxf(v1.z, v2.z)) < -h) return false;
+
+	vec3f n = cross(v1 - v0, v2 - v1);
+
+	if (fabsf(dot(n, v0)) > h*fmaxf(fabsf(n.x), fmaxf(fabsf(n.y), fabsf(n.z)))) return false;
+	return projection_overlaps_diamond(n.x, v0.y, v0.z, v1.y, v1.z, v2.y, v2.z, h)
+		&& projection_overlaps_diamond(n.y, v0.z, v0.x, v1.z, v1.x, v2.z, v2.x, h)
+		&& projection_overlaps_diamond(n.z, v0.x, v0.y, v1.x, v1.y, v2.x, v2.y, h);
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef voxelizer_voxelize_cpu_h
+#define voxelizer_voxelize_cpu_h
+
+#include "includes/CompFab.h"
+#include "includes/BVH.h"
+
+#include <vector>
+
+// voxelize the given mesh with the given resolution and dimensions on the CPU.
+// Same contract as kernel_wrapper in main.cu. When a BVH over the triangles is
+// given the parity rays walk it instead of testing every triangle. With bricks
+// only the bricks of voxels the surface passes through test every voxel, the
+// others one voxel each. The sample directions of a voxel depend only on seed and
+// its position in the whole grid, so runs with the same seed give the same grid.
+void cpu_kernel_wrapper(int samples, int w, int h, int d, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, bool double_thick, const BVH *bvh = NULL, bool bricks = false, unsigned int seed = 0);
+
+// voxelizes with the fixed +X direction like cpu_kernel_wrapper without samples,
+// but intersects every (y, z) row of voxels with the mesh only once. Voxels whose
+// center lies within float rounding of a crossing may come out different
+void cpu_scanline_wrapper(int w, int h, int d, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, bool double_thick, const BVH *bvh = NULL);
+
+// voxelizes with the fixed +X direction like cpu_kernel_wrapper without samples,
+// but triangle-major: tiles of the triangles overlapping a block of rows are swept
+// over all rays of the block while they are in cache
+void cpu_tiled_wrapper(int w, int h, int d, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, bool double_thick);
+
+// voxelizes with the fixed +X direction like cpu_kernel_wrapper without samples,
+// but every triangle XOR-toggles the voxels in front of it in each row it covers,
+// so the work grows with the triangles and the rows they cover
+void cpu_parity_wrapper(int w, int h, int d, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, bool double_thick);
+
+// marks the voxels the surface passes through: with separating 26 every voxel whose
+// cube a triangle overlaps, with 6 the thinner shell no 6-connected path can cross
+void cpu_surface_wrapper(int w, int h, int d, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, int separating);
+
+#endif
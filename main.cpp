@@ -1,9 +1,14 @@
-#include "includes/args.h"
-#include "includes/CompFab.h"
-#include "includes/Mesh.h"
+#include "includes/pipeline.h"
+#include "includes/batch.h"
+#include "includes/daemon.h"
+#include "includes/ResultCache.h"
+#include "includes/Profiler.h"
+#include "includes/SlabVoxelizer.h"
 #include "includes/utils.h"
+#include "includes/ThreadPool.h"
 
 #include <tclap/CmdLine.h>
+#include <chrono>
 #include <iostream>
 #include <string>
 #include <sstream>
@@ -11,19 +16,6 @@
 // #include <cstdlib>
 #include <cstdlib>
 
-enum FileFormat { obj, binvox };
-
-struct VoxelizerArgs : Args {
-	// path to files
-	std::string input, output;
-	FileFormat format;
-	bool double_thick;
-	// voxelization settings
-	int size;
-	// width, height, depth;
-	int samples;
-};
-
 // construct the command line arguments
 VoxelizerArgs * parseArgs(int argc, char *argv[]) {
 	VoxelizerArgs * args = new VoxelizerArgs();
@@ -31,34 +23,80 @@ VoxelizerArgs * parseArgs(int argc, char *argv[]) {
 	// Define the command line object
 	TCLAP::CmdLine cmd("A simple voxelization utility.", ' ', "0.0");
 
-	TCLAP::UnlabeledValueArg<std::string> input( "input", "path to .obj mesh", true, "", "string");
-	TCLAP::UnlabeledValueArg<std::string> output("output","path to save voxel grid", true, "", "string");
+	// the input and output path, optional for a --batch
+	TCLAP::UnlabeledMultiArg<std::string> paths( "paths", "path to .obj mesh and path to save voxel grid", false, "input output");
 
-	TCLAP::ValueArg<std::string> format("f", "format","voxel grid save format - obj|binvox", false, "binvox", "string");
+	TCLAP::ValueArg<std::string> format("f", "format","voxel grid save format - obj|binvox|raw|svo", false, "binvox", "string");
 	TCLAP::ValueArg<int> size(  "r","resolution", "voxelization resolution",  false, 32, "int");
 	TCLAP::ValueArg<int> samples( "s","samples", "number of sample rays per vertex",  false, -1, "int");
+	TCLAP::ValueArg<unsigned int> seed( "","seed", "seed of the sample ray directions, the same seed gives the same grid",  false, 0, "int");
+	TCLAP::ValueArg<std::string> backend("b", "backend","voxelization engine - cpu|cuda", false, DEFAULT_BACKEND, "string");
+	TCLAP::ValueArg<std::string> mode("m", "mode","voxelization algorithm - ray|scanline|tiled|parity|surface|flood. scanline may differ from ray at crossings lying on a voxel center", false, "ray", "string");
+	TCLAP::ValueArg<int> threads( "t","threads", "number of threads used by the cpu backend, 0 for all cores",  false, 0, "int");
+	TCLAP::ValueArg<int> max_memory( "","max-memory", "voxelize slabs of z layers and stream them to the output so the grid takes at most this many MiB. At least one z layer, and for binvox 16 bytes per voxel of a yz face (64 MiB at 2048^3)",  false, 0, "int");
 
 	TCLAP::MultiSwitchArg verbosity( "v", "verbose", "Verbosity level. Multiple flags for more verbosity.");
+	TCLAP::SwitchArg no_mesh_cache( "", "no-mesh-cache", "Always parse the input mesh, neither read nor write its .vmesh cache.", false);
 	TCLAP::SwitchArg double_thick( "d", "double", "Flag for processing double-thick meshes. Uses (num_intersections/2)%2 for occupancy checking.", false);
+	TCLAP::ValueArg<int> separating( "","separating", "surface and flood modes: 26 marks every voxel a triangle touches, 6 a thinner shell that still blocks 6-connected paths",  false, 26, "6|26");
+	TCLAP::ValueArg<int> close( "","close", "flood mode: dilate the surface by this many voxels before the fill to close holes, and the exterior back after it",  false, 0, "voxels");
+	TCLAP::SwitchArg sparse( "", "sparse", "Keep the grid in a sparse map of 8^3 bricks, storing only tags for all empty and all full ones. Voxelizes slabs of --max-memory MiB (default " + std::to_string(SPARSE_SLAB_MEMORY) + ").", false);
+	TCLAP::ValueArg<std::string> batch( "","batch", "voxelize every 'input output [resolution] [samples]' line of this file in one process, instead of the input and output paths",  false, "", "manifest");
+	TCLAP::ValueArg<std::string> daemon( "","daemon", "serve voxelization jobs on this Unix domain socket until a shutdown request, SIGINT or SIGTERM, instead of the input and output paths",  false, "", "socket");
+	TCLAP::ValueArg<int> cached_meshes( "","cached-meshes", "daemon: meshes kept loaded with their BVH, the least recently used dropped first",  false, 16, "int");
+	TCLAP::ValueArg<std::string> result_cache( "","result-cache", "keep the voxelized grids in this directory and read a grid back when the same mesh is voxelized again with the same settings",  false, "", "directory");
+	TCLAP::ValueArg<int> result_cache_size( "","result-cache-size", "MiB the result cache may take, the grids used longest ago are removed first",  false, 1024, "int");
+	TCLAP::ValueArg<std::string> trace( "","trace", "write every timed phase of the run to this JSON file for chrome://tracing or Perfetto",  false, "", "file");
+	TCLAP::SwitchArg bricks( "", "bricks", "Ray mode: cast rays for every voxel only in the 8^3 bricks the surface passes through, one voxel decides each other brick.", false);
 
 
 	// Add args to command line object and parse
-	cmd.add(input); cmd.add(output);  // order matters for positional args
+	cmd.add(paths);
 	cmd.add(size); cmd.add(format); 
 	// cmd.add(width); cmd.add(height); cmd.add(depth); 
-	cmd.add(verbosity); cmd.add(samples); cmd.add(double_thick);
+	cmd.add(verbosity); cmd.add(samples); cmd.add(seed); cmd.add(double_thick);
+	cmd.add(backend); cmd.add(threads); cmd.add(mode); cmd.add(no_mesh_cache);
+	cmd.add(max_memory); cmd.add(bricks); cmd.add(separating); cmd.add(close); cmd.add(sparse);
+	cmd.add(batch); cmd.add(daemon); cmd.add(cached_meshes);
+	cmd.add(result_cache); cmd.add(result_cache_size); cmd.add(trace);
 	cmd.parse( argc, argv );
+	bool serving = !batch.getValue().empty() || !daemon.getValue().empty();
+	if (serving == (paths.getValue().size() == 2) || (!batch.getValue().empty() && !daemon.getValue().empty())) {
+		// the error and usage of a failed parse, which exit through an exception
+		try {
+			TCLAP::CmdLineParseException missing(!serving ? "Expected the input and output path" : !paths.getValue().empty() ? "A --batch or --daemon takes its paths from the manifest or the jobs" : "Expected either --batch or --daemon");
+			TCLAP::StdOutput().failure(cmd, missing);
+		} catch (TCLAP::ExitException &e) {
+			exit(e.getExitStatus());
+		}
+	}
 
 	// store in wrapper struct
-	args->input  = input.getValue();
-	args->output = output.getValue();
+	if (paths.getValue().size() == 2) {
+		args->input  = paths.getValue()[0];
+		args->output = paths.getValue()[1];
+	}
 	args->size   = size.getValue();
 	// args->width  = width.getValue();
 	// args->height = height.getValue();
 	// args->depth  = depth.getValue();
 	args->samples  = samples.getValue();
+	args->seed  = seed.getValue();
 	args->verbosity  = verbosity.getValue();
 	args->double_thick  = double_thick.getValue();
+	args->threads  = threads.getValue();
+	args->mesh_cache  = !no_mesh_cache.getValue();
+	args->max_memory  = max_memory.getValue();
+	args->sparse  = sparse.getValue();
+	args->bricks  = bricks.getValue();
+	args->separating  = separating.getValue();
+	args->close  = close.getValue();
+	args->batch  = batch.getValue();
+	args->daemon  = daemon.getValue();
+	args->cached_meshes  = cached_meshes.getValue();
+	args->result_cache  = result_cache.getValue();
+	args->result_cache_size  = result_cache_size.getValue();
+	args->trace  = trace.getValue();
 
 	args->debug(1) << "input:     " << args->input  << std::endl;
 	args->debug(1) << "output:    " << args->output << std::endl;
@@ -70,9 +108,94 @@ VoxelizerArgs * parseArgs(int argc, char *argv[]) {
 	} else if (fl == 'o' || fl == 'O') {
 		args->format = obj;
 		args->debug(1) << "save format: obj" << std::endl;
+	} else if (fl == 'r' || fl == 'R') {
+		args->format = raw;
+		args->debug(1) << "save format: raw" << std::endl;
+	} else if (fl == 's' || fl == 'S') {
+		args->format = svo;
+		args->debug(1) << "save format: svo" << std::endl;
+	} else {
+		args->debug(0) << "Unknown file format specified, use one of: (o) obj, (b) binvox, (r) raw, (s) svo" << std::endl;
+	}
+
+	if (backend.getValue() == "cuda") {
+		args->backend = cuda;
+#if !USE_CUDA
+		args->debug(0) << "This build has no CUDA support, falling back to the cpu backend." << std::endl;
+		args->backend = cpu;
+#endif
+	} else if (backend.getValue() == "cpu") {
+		args->backend = cpu;
 	} else {
-		args->debug(0) << "Unknown file format specified, use one of: (o) obj, (b) binvox" << std::endl;
+		args->debug(0) << "Unknown backend specified, use one of: cpu, cuda. Using " << DEFAULT_BACKEND << "." << std::endl;
+		args->backend = (std::string(DEFAULT_BACKEND) == "cuda") ? cuda : cpu;
 	}
+	args->debug(1) << "backend:   " << (args->backend == cuda ? "cuda" : "cpu") << std::endl;
+
+	if (mode.getValue() == "surface" || mode.getValue() == "flood") {
+		args->mode = mode.getValue() == "flood" ? flood : surface;
+		if (args->separating != 6 && args->separating != 26) {
+			args->debug(0) << "The " << mode.getValue() << " mode is either 6 or 26 separating. Using 26." << std::endl;
+			args->separating = 26;
+		}
+		if (args->samples > 0) {
+			args->debug(0) << "The " << mode.getValue() << " mode casts no rays, ignoring " << args->samples << " samples." << std::endl;
+			args->samples = -1;
+		}
+		if (args->backend == cuda) {
+			args->debug(0) << "The " << mode.getValue() << " mode runs on the cpu backend." << std::endl;
+			args->backend = cpu;
+		}
+	} else if (mode.getValue() == "scanline" || mode.getValue() == "tiled" || mode.getValue() == "parity") {
+		args->mode = mode.getValue() == "tiled" ? tiled : mode.getValue() == "parity" ? parity : scanline;
+		if (args->samples > 0) {
+			args->debug(0) << "The " << mode.getValue() << " mode only casts +X rays, using the ray mode for " << args->samples << " samples." << std::endl;
+			args->mode = ray;
+		} else if (args->backend == cuda) {
+			args->debug(0) << "The " << mode.getValue() << " mode runs on the cpu backend." << std::endl;
+			args->backend = cpu;
+		}
+	} else if (mode.getValue() == "ray") {
+		args->mode = ray;
+	} else {
+		args->debug(0) << "Unknown mode specified, use one of: ray, scanline, tiled, parity, surface, flood. Using ray." << std::endl;
+		args->mode = ray;
+	}
+	args->debug(1) << "mode:      " << modeName(args->mode) << std::endl;
+	if (args->mode == surface || args->mode == flood) args->debug(1) << "separating: " << args->separating << std::endl;
+	if (args->close < 0 || (args->close > 0 && args->mode != flood)) {
+		args->debug(0) << "--close takes a radius in voxels for the flood mode, ignoring it." << std::endl;
+		args->close = 0;
+	}
+	if (args->close > 0) args->debug(1) << "close:     " << args->close << " voxels" << std::endl;
+
+	if (args->sparse && (args->format == obj || args->format == svo)) {
+		args->debug(0) << "The " << (args->format == obj ? "obj" : "svo") << " output needs the whole grid in memory, ignoring --sparse." << std::endl;
+		args->sparse = false;
+	}
+	if (args->sparse && args->mode == flood) {
+		args->debug(0) << "The flood fill needs the whole grid in memory, ignoring --sparse." << std::endl;
+		args->sparse = false;
+	}
+	if (args->max_memory > 0 && (args->format == obj || args->format == svo)) {
+		args->debug(0) << "The " << (args->format == obj ? "obj" : "svo") << " output needs the whole grid in memory, ignoring --max-memory." << std::endl;
+		args->max_memory = 0;
+	}
+	if (args->max_memory > 0 && args->mode == flood) {
+		args->debug(0) << "The flood fill needs the whole grid in memory, ignoring --max-memory." << std::endl;
+		args->max_memory = 0;
+	}
+	if (args->max_memory > 0 && !args->sparse) {
+		size_t floor = SlabVoxelizer::min_memory(args->size, args->size, args->size, args->format == binvox);
+		int floor_mib = (int) ((floor + (1 << 20) - 1) >> 20);
+		if ((size_t) args->max_memory << 20 < floor) {
+			args->debug(0) << "The " << (args->format == binvox ? "binvox" : "raw") << " output of a " << args->size << "^3 grid takes at least "
+				<< floor_mib << " MiB, exceeding --max-memory " << args->max_memory << "." << std::endl;
+			args->max_memory = floor_mib;
+		}
+	}
+	if (args->max_memory > 0) args->debug(1) << "max memory: " << args->max_memory << " MiB" << std::endl;
+	if (args->sparse) args->debug(1) << "Keeping the grid in a sparse brick map." << std::endl;
 
 
 	// args->debug(1) << "format:    " << args->format   << std::endl;
@@ -83,133 +206,127 @@ VoxelizerArgs * parseArgs(int argc, char *argv[]) {
 	args->debug(1) << "samples:   " << args->samples << std::endl;
 	args->debug(1) << "verbosity: " << args->verbosity << std::endl;
 	if (args->double_thick) args->debug(1) << "Processing mesh as double-thick." << std::endl;
-
-	return args;
-}
-
-typedef std::vector<CompFab::Triangle> TriangleList;
-
-TriangleList g_triangleList;
-CompFab::VoxelGrid *g_voxelGrid;
-
-bool loadMesh(const char *filename, unsigned int dim)
-{
-	g_triangleList.clear();
-	
-	Mesh *tempMesh = new Mesh(filename, true);
-	
-	CompFab::Vec3 v1, v2, v3;
-
-	//copy triangles to global list
-	for(unsigned int tri =0; tri<tempMesh->t.size(); ++tri)
-	{
-		v1 = tempMesh->v[tempMesh->t[tri][0]];
-		v2 = tempMesh->v[tempMesh->t[tri][1]];
-		v3 = tempMesh->v[tempMesh->t[tri][2]];
-		g_triangleList.push_back(CompFab::Triangle(v1,v2,v3));
-	}
-
-	//Create Voxel Grid
-	CompFab::Vec3 bbMax, bbMin;
-	BBox(*tempMesh, bbMin, bbMax);
-	
-	//Build Voxel Grid
-	double bbX = bbMax[0] - bbMin[0];
-	double bbY = bbMax[1] - bbMin[1];
-	double bbZ = bbMax[2] - bbMin[2];
-	double spacing;
-	
-	if(bbX > bbY && bbX > bbZ)
-	{
-		spacing = bbX/(double)(dim-2);
-	} else if(bbY > bbX && bbY > bbZ) {
-		spacing = bbY/(double)(dim-2);
-	} else {
-		spacing = bbZ/(double)(dim-2);
+	if (args->bricks && args->mode != ray) {
+		args->debug(0) << "--bricks only applies to the ray mode, ignoring it." << std::endl;
+		args->bricks = false;
 	}
-	
-	CompFab::Vec3 hspacing(0.5*spacing, 0.5*spacing, 0.5*spacing);
-
-	g_voxelGrid = new CompFab::VoxelGrid(bbMin-hspacing, dim, dim, dim, spacing);
-
-	delete tempMesh;
-	return true;
-}
-
-
-
-void saveVoxelsToObj(const char * outfile)
-{
-	Mesh box;
-	Mesh mout;
-	int nx = g_voxelGrid->m_dimX;
-	int ny = g_voxelGrid->m_dimY;
-	int nz = g_voxelGrid->m_dimZ;
-	double spacing = g_voxelGrid->m_spacing;
-	
-	CompFab::Vec3 hspacing(0.5*spacing, 0.5*spacing, 0.5*spacing);
-	
-	for (int ii = 0; ii < nx; ii++) {
-		for (int jj = 0; jj < ny; jj++) {
-			for (int kk = 0; kk < nz; kk++) {
-				if(!g_voxelGrid->isInside(ii,jj,kk)){
-					continue;
-				}
-				CompFab::Vec3 coord(0.5f + ((double)ii)*spacing, 0.5f + ((double)jj)*spacing, 0.5f+((double)kk)*spacing);
-				CompFab::Vec3 box0 = coord - hspacing;
-				CompFab::Vec3 box1 = coord + hspacing;
-				makeCube(box, box0, box1);
-				mout.append(box);
-			}
-		}
+	if (args->bricks) args->debug(1) << "Skipping the voxels of bricks away from the surface." << std::endl;
+	if ((!args->batch.empty() || !args->daemon.empty()) && (args->max_memory > 0 || args->sparse)) {
+		args->debug(0) << "A " << (args->batch.empty() ? "daemon" : "batch") << " keeps each grid in memory, ignoring --max-memory and --sparse." << std::endl;
+		args->max_memory = 0;
+		args->sparse = false;
 	}
+	if (!args->result_cache.empty() && (args->max_memory > 0 || args->sparse)) {
+		args->debug(0) << "The result cache holds whole grids, not using it with --" << (args->sparse ? "sparse" : "max-memory") << "." << std::endl;
+		args->result_cache.clear();
+	}
+	if (!args->result_cache.empty()) args->debug(1) << "result cache: " << args->result_cache << ", " << args->result_cache_size << " MiB" << std::endl;
 
-	mout.save_obj(outfile);
-}
-
-bool save(VoxelizerArgs *args) {
-	switch (args->format) {
-		case obj:
-			saveVoxelsToObj((args->output + ".obj").c_str());
-			break;
-		case binvox:
-			g_voxelGrid->save_binvox((args->output + ".binvox").c_str());
-			break;
-		default:
-			args->debug(0) << "Failed to save - no file type specified." << std::endl;
-			return false;
-	}
-	return true;
+	return args;
 }
 
-extern void kernel_wrapper(int samples, int w, int h, int d, CompFab::VoxelGrid *g_voxelGrid, std::vector<CompFab::Triangle> triangles, bool double_thick);
-
 int main(int argc, char *argv[])
 {
 	VoxelizerArgs *args = parseArgs(argc, argv);
+	Profiler::global().setTracing(!args->trace.empty());
+	// before anything runs on the pool, loading the mesh already does
+	ThreadPool::set_global_threads(args->threads);
+	if (!args->batch.empty()) {
+		bool ok = runBatch(args, args->batch);
+		return reportProfile(args) && ok ? 0 : 1;
+	}
+	if (!args->daemon.empty()) {
+		bool ok = runDaemon(args);
+		return reportProfile(args) && ok ? 0 : 1;
+	}
+	bool out_of_core = args->max_memory > 0 && !args->sparse;
 
 	args->debug(0) << "\nLoading Mesh" << std::endl;
-	loadMesh(args->input.c_str(), args->size);
+	Voxelizer voxelizer;
+	if (!voxelizer.load(args->input.c_str(), args->mesh_cache)) {
+		args->debug(0) << "No triangles in " << args->input << ", exiting." << std::endl;
+		return 1;
+	}
+	args->debug(0) << "Num Triangles: " << voxelizer.triangles().size() << std::endl;
+	CompFab::Vec3 lowerLeft;
+	double spacing;
+	voxelizer.placeGrid(args->size, lowerLeft, spacing);
+	CompFab::VoxelGrid *grid = NULL;
+	BrickMap *bricks = NULL;
+	{
+		ScopedTimer timer("allocate grid");
+		if (args->sparse) bricks = new BrickMap(lowerLeft, args->size, args->size, args->size, spacing);
+		else if (!out_of_core) grid = new CompFab::VoxelGrid(lowerLeft, args->size, args->size, args->size, spacing);
+	}
 
-	clock_t start = clock();
-	args->debug(0) << "Voxelizing in the GPU, this might take a while." << std::endl;
-	if (args->samples > -1) args->debug(0) << "Randomly choosing " << args->samples << " directions." << std::endl;
-	kernel_wrapper(args->samples, args->size, args->size, args->size, g_voxelGrid, g_triangleList, args->double_thick);
+#if USE_CUDA
+	if (args->backend == cuda) {
+		args->debug(0) << "Voxelizing in the GPU, this might take a while." << std::endl;
+	} else
+#endif
+	{
+		args->debug(0) << "Voxelizing in the CPU with " << ThreadPool::global().size() << " threads, this might take a while." << std::endl;
+		args->debug(1) << "ray/triangle kernel: " << simd_level_name(simd_level()) << std::endl;
+	}
+	if (args->samples > -1) args->debug(0) << "Choosing " << args->samples << " directions per voxel with seed " << args->seed << "." << std::endl;
+	if (out_of_core) args->debug(0) << "Streaming slabs of the grid to the output." << std::endl;
+
+	// wall time, clock() would add up the time of every thread
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t filled = 0;
+	bool saved = true;
+	if (bricks) {
+		voxelizeBricks(args, voxelizer, *bricks);
+		filled = bricks->count();
+	} else if (out_of_core) {
+		saved = voxelizeSlabs(args, voxelizer, filled);
+	} else {
+		ResultCache *cache = args->result_cache.empty() ? NULL : new ResultCache(args->result_cache, (size_t) args->result_cache_size << 20);
+		uint64_t key = cache ? ResultCache::key(voxelizer, *args, args->size) : 0;
+		if (cache && cache->load(key, *grid)) {
+			args->debug(0) << "Read the grid from the result cache." << std::endl;
+		} else {
+			voxelizer.voxelize(*args, *grid);
+			if (cache) cache->store(key, *grid);
+		}
+		filled = grid->count();
+		if (cache) {
+			reportResultCache(args, *cache);
+			delete cache;
+		}
+	}
 
 	// Summary: teapot.obj (9000 triangles) @ 512x512x512, 3 samples in: 15 seconds
 	args->debug(0) << "Summary: "
 		<< utils::split(args->input, '/').back() 
-		<< " (" << g_triangleList.size() << " triangles)"
-		<< " @ " << g_voxelGrid->m_dimX << "x" << g_voxelGrid->m_dimY << "x" << g_voxelGrid->m_dimZ;
+		<< " (" << voxelizer.triangles().size() << " triangles)"
+		<< " @ " << args->size << "x" << args->size << "x" << args->size;
 	if (args->samples > 0) 
 		args->debug(0) << ", " << args->samples << " samples" ;
 	else args->debug(0) << ", 1 sample" ;
-	args->debug(0) << " in: " << float( clock() - start ) /  CLOCKS_PER_SEC << " seconds" << std::endl;
+	args->debug(0) << " in: " << std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count() << " seconds" << std::endl;
+	args->debug(1) << "filled:    " << filled << " of " << (size_t) args->size*args->size*args->size << " voxels" << std::endl;
+	if (bricks) {
+		size_t bricks_total = (size_t) bricks->m_bricksX*bricks->m_bricksY*bricks->m_bricksZ;
+		args->debug(0) << "Brick map: " << bricks->memory() / (1024.0*1024.0) << " MiB, "
+			<< bricks->mixed_bricks() << " mixed and " << bricks->full_bricks() << " full of " << bricks_total
+			<< " bricks, the dense grid takes " << bricks->dense_memory() / (1024.0*1024.0) << " MiB" << std::endl;
+	}
 
-	args->debug(0) << "Saving Results." << std::endl;
-	if (!save(args)) {
+	if (bricks) {
+		args->debug(0) << "Saving Results." << std::endl;
+		saved = saveBricks(args, *bricks);
+		delete bricks;
+	} else if (!out_of_core) {
+		args->debug(0) << "Saving Results." << std::endl;
+		saved = save(args, *grid);
+		delete grid;
+	}
+	if (!saved) {
 		args->debug(0) << "Failed to save! Exiting." << std::endl;
 	};
 
+	Profiler::count(COUNT_VOXELS_FILLED, filled);
+	reportProfile(args);
 	return 0;
-}
\ No newline at end of file
+}
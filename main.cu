@@ -1,7 +1,7 @@
 #include "includes/CompFab.h"
+#include "includes/bricks.h"
+#include "includes/raycast.h"
 #include "math.h"
-#include "curand.h"
-#include "curand_kernel.h"
 #include "includes/cuda_math.h"
 
 #include <iostream>
@@ -10,9 +10,12 @@
 #include "stdio.h"
 #include <vector>
 
-#define RANDOM_SEEDS 1000
-#define EPSILONF 0.000001
-#define E_PI 3.1415926535897932384626433832795028841971693993751058209749445923078164062
+// in Profiler.cpp, nvcc compiles this file without the C++11 of Profiler.h
+extern double profile_now();
+extern void profile_record(const char *phase, double start_us, double end_us);
+
+// brick_kernel leaves the state of bricks touching the surface at this
+#define BRICK_SURFACE 2
 
 // check cuda calls for errors
 #define gpuErrchk(ans) { gpuAssert((ans), __FILE__, __LINE__); }
@@ -25,105 +28,130 @@ inline void gpuAssert(cudaError_t code, const char *file, int line, bool abort=t
    }
 }
 
-// generates a random float between 0 and 1
-__device__ float generate( curandState* globalState , int ind) 
+// parity of the +X ray from pos
+__device__ bool ray_inside(const CompFab::Triangle *triangles, const int numTriangles, vec3f pos, bool double_thick)
 {
-    curandState localState = globalState[ind];
-    float RANDOM = curand_uniform( &localState );
-    globalState[ind] = localState; 
-    return RANDOM;
+	// pick an arbitrary sampling direction
+	vec3f dir = make_vec3f(1.0, 0.0, 0.0);
+
+	// check if the voxel is inside of the mesh. 
+	// if it is inside, then there should be an odd number of 
+	// intersections with the surrounding mesh
+	unsigned int intersections = 0;
+	for (int i = 0; i < numTriangles; ++i)
+		if (intersects(triangles[i], dir, pos))
+			intersections += 1;
+	return inside(intersections, double_thick);
 }
-// set up random seed buffer
-__global__ void setup_kernel ( curandState * state, unsigned long seed )
+
+// casts rays from pos along the sample directions of key until the remaining ones
+// cannot change the majority, and picks the most common belief. Same directions
+// and decisions as sampled_inside of the CPU backend
+__device__ bool sampled_inside(const CompFab::Triangle *triangles, const int numTriangles, vec3f pos,
+	const int samples, uint32_t key, bool double_thick)
 {
-    int id = threadIdx.x;
-    curand_init ( seed, id, 0, &state[id] );
-} 
+	int votes = 0;
+	for (int j = 0; j < samples; ++j)
+	{
+		vec3f dir = stratified_direction(key, j);
 
+		unsigned int intersections = 0;
+		for (int i = 0; i < numTriangles; ++i)
+			if (intersects(triangles[i], dir, pos)) 
+				intersections += 1;
+		if (inside(intersections, double_thick)) votes += 1;
+		if (vote_decided(votes, j + 1, samples)) break;
+	}
+	return votes > samples / 2;
+}
 
-__device__ bool inside(unsigned int numIntersections, bool double_thick) {
-	// if (double_thick && numIntersections % 2 == 0) return (numIntersections / 2) % 2 == 1;
-	if (double_thick) return (numIntersections / 2) % 2 == 1;
-	return numIntersections % 2 == 1;
+// Decides the bricks no triangle touches by their first voxel. One thread per brick,
+// state holds BRICK_SURFACE for the others, and 1 or 0 for inside or outside after.
+__global__ void brick_kernel(
+	unsigned char* state, const CompFab::Triangle* triangles, const int numTriangles,
+	const float spacing, const float3 bottom_left,
+	const int bricksX, const int bricksY, const int bricksZ, const int firstZ,
+	const int samples, uint32_t seed, bool double_thick)
+{
+	unsigned int bx = blockDim.x * blockIdx.x + threadIdx.x;
+	unsigned int by = blockDim.y * blockIdx.y + threadIdx.y;
+	unsigned int bz = blockDim.z * blockIdx.z + threadIdx.z;
+	if (bx >= bricksX || by >= bricksY || bz >= bricksZ) return;
+
+	unsigned int index = (bz*bricksY + by)*bricksX + bx;
+	if (state[index] == BRICK_SURFACE) return;
+
+	unsigned int xIndex = bx*BRICK_SIZE, yIndex = by*BRICK_SIZE, zIndex = bz*BRICK_SIZE;
+	vec3f pos = make_vec3f(bottom_left.x + spacing*xIndex,bottom_left.y + spacing*yIndex,bottom_left.z + spacing*(firstZ + zIndex));
+	bool in = samples > 0
+		? sampled_inside(triangles, numTriangles, pos, samples, voxel_key(seed, xIndex, yIndex, firstZ + zIndex), double_thick)
+		: ray_inside(triangles, numTriangles, pos, double_thick);
+	state[index] = in ? 1 : 0;
 }
 
-// adapted from: https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm
-__device__ bool intersects(CompFab::Triangle &triangle, float3 dir, float3 pos) {
-	float3 V1 = {triangle.m_v1.m_x, triangle.m_v1.m_y, triangle.m_v1.m_z};
-	float3 V2 = {triangle.m_v2.m_x, triangle.m_v2.m_y, triangle.m_v2.m_z};
-	float3 V3 = {triangle.m_v3.m_x, triangle.m_v3.m_y, triangle.m_v3.m_z};
-
-	//Find vectors for two edges sharing V1
-	float3 e1 = V2 - V1;
-	float3 e2 = V3 - V1;
-	
-	// //Begin calculating determinant - also used to calculate u parameter
-	float3 P = cross(dir, e2);
-
-	//if determinant is near zero, ray lies in plane of triangle
-	float det = dot(e1, P);
-	
-	//NOT CULLING
-	if(det > -EPSILONF && det < EPSILONF) return false;
-	float inv_det = 1.f / det;
-
-	// calculate distance from V1 to ray origin
-	float3 T = pos - V1;
-	//Calculate u parameter and test bound
-	float u = dot(T, P) * inv_det;
-	//The intersection lies outside of the triangle
-	if(u < 0.f || u > 1.f) return false;
-
-	//Prepare to test v parameter
-	float3 Q = cross(T, e1);
-	//Calculate V parameter and test bound
-	float v = dot(dir, Q) * inv_det;
-	//The intersection lies outside of the triangle
-	if(v < 0.f || u + v  > 1.f) return false;
-
-	float t = dot(e2, Q) * inv_det;
-
-	if(t > EPSILONF) { // ray intersection
-		return true;
-	}
+// the state brick_kernel found for the brick of a voxel, BRICK_SURFACE without bricks
+__device__ unsigned char brick_state(const unsigned char* state, const int bricksX, const int bricksY,
+	unsigned int xIndex, unsigned int yIndex, unsigned int zIndex)
+{
+	if (!state) return BRICK_SURFACE;
+	return state[((zIndex/BRICK_SIZE)*bricksY + yIndex/BRICK_SIZE)*bricksX + xIndex/BRICK_SIZE];
+}
+
+// threads of a block along x, one per voxel of a word. The two warps of a word
+// pack their halves of it with a ballot, so no thread tests more than one voxel
+#define WORD_THREADS 64
+// rows of voxels per block
+#define BLOCK_ROWS 4
+
+// the decisions of the 32 threads of a warp, lane i in bit i. Every thread of the
+// warp must call it, also the ones past the end of the grid
+__device__ unsigned int warp_bits(bool in)
+{
+#if CUDART_VERSION >= 9000
+	return __ballot_sync(0xffffffff, in);
+#else
+	return __ballot(in);
+#endif
+}
 
-	// No hit, no win
-	return false;
+// stores the half of the word of a row a warp decided, the low 32 voxels first
+__device__ void store_half(CompFab::Word* R, unsigned int index_out, unsigned int half, unsigned int bits)
+{
+	reinterpret_cast<unsigned int*>(R)[2*index_out + half] = bits;
 }
 
-// Decides whether or not each voxel is within the given mesh
+// Decides whether or not each voxel is within the given mesh.
+// Every thread decides one voxel, a block decides a word of BLOCK_ROWS rows
 __global__ void voxelize_kernel( 
-	bool* R, CompFab::Triangle* triangles, const int numTriangles, 
+	CompFab::Word* R, const CompFab::Triangle* triangles, const int numTriangles, 
 	const float spacing, const float3 bottom_left,
-	const int w, const int h, const int d, bool double_thick)
+	const int w, const int h, const int d, const int wordsPerRow, const int firstZ, bool double_thick,
+	const unsigned char* bricks, const int bricksX, const int bricksY)
 {
 	// find the position of the voxel
-	unsigned int xIndex = blockDim.x * blockIdx.x + threadIdx.x;
+	unsigned int xIndex = blockIdx.x * WORD_THREADS + threadIdx.x;
 	unsigned int yIndex = blockDim.y * blockIdx.y + threadIdx.y;
-	unsigned int zIndex = blockDim.z * blockIdx.z + threadIdx.z;
+	unsigned int zIndex = blockIdx.z;
+	bool row = (yIndex < h) && (zIndex < d);
 
-	// pick an arbitrary sampling direction
-	float3 dir = make_float3(1.0, 0.0, 0.0);
-
-	if ( (xIndex < w) && (yIndex < h) && (zIndex < d) )
+	bool in = false;
+	if (row && xIndex < w)
 	{
-		// find linearlized index in final boolean array
-		unsigned int index_out = zIndex*(w*h)+yIndex*h + xIndex;
-		
-		// find world space position of the voxel
-		float3 pos = make_float3(bottom_left.x + spacing*xIndex,bottom_left.y + spacing*yIndex,bottom_left.z + spacing*zIndex);
-
-		// check if the voxel is inside of the mesh. 
-		// if it is inside, then there should be an odd number of 
-		// intersections with the surrounding mesh
-		unsigned int intersections = 0;
-		for (int i = 0; i < numTriangles; ++i)
-			if (intersects(triangles[i], dir, pos))
-				intersections += 1;
-
-		// store answer
-		R[index_out] = inside(intersections, double_thick);
+		// voxels of bricks away from the surface share the state of the brick
+		unsigned char state = brick_state(bricks, bricksX, bricksY, xIndex, yIndex, zIndex);
+		if (state != BRICK_SURFACE) {
+			in = state;
+		} else {
+			// find world space position of the voxel
+			vec3f pos = make_vec3f(bottom_left.x + spacing*xIndex,bottom_left.y + spacing*yIndex,bottom_left.z + spacing*(firstZ + zIndex));
+			in = ray_inside(triangles, numTriangles, pos, double_thick);
+		}
 	}
+
+	// store answer
+	unsigned int bits = warp_bits(in);
+	if (row && threadIdx.x % 32 == 0)
+		store_half(R, (zIndex*h + yIndex)*wordsPerRow + blockIdx.x, threadIdx.x / 32, bits);
 }
 
 
@@ -131,100 +159,106 @@ __global__ void voxelize_kernel(
 // checks a variety of directions and picks most common belief
 __global__ void voxelize_kernel_open_mesh( 
 	// triangles of the mesh being voxelized
-	bool* R, CompFab::Triangle* triangles, const int numTriangles, 
+	CompFab::Word* R, const CompFab::Triangle* triangles, const int numTriangles, 
 	// information about how large the samples are and where they begin
 	const float spacing, const float3 bottom_left,
-	// number of voxels
-	const int w, const int h, const int d, 
+	// number of voxels, the grid being layers firstZ.. of the whole grid
+	const int w, const int h, const int d, const int wordsPerRow, const int firstZ,
 	// sampling information for multiple intersection rays
-	const int samples, curandState* globalState, bool double_thick
+	const int samples, uint32_t seed, bool double_thick,
+	// states of the bricks from brick_kernel, NULL to test every voxel
+	const unsigned char* bricks, const int bricksX, const int bricksY
 	)
 {
 	// find the position of the voxel
-	unsigned int xIndex = blockDim.x * blockIdx.x + threadIdx.x;
+	unsigned int xIndex = blockIdx.x * WORD_THREADS + threadIdx.x;
 	unsigned int yIndex = blockDim.y * blockIdx.y + threadIdx.y;
-	unsigned int zIndex = blockDim.z * blockIdx.z + threadIdx.z;
+	unsigned int zIndex = blockIdx.z;
+	bool row = (yIndex < h) && (zIndex < d);
 
-	if ( (xIndex < w) && (yIndex < h) && (zIndex < d) )
+	bool in = false;
+	if (row && xIndex < w)
 	{
-		// find linearlized index in final boolean array
-		unsigned int index_out = zIndex*(w*h)+yIndex*h + xIndex;
-		// find world space position of the voxel
-		float3 pos = make_float3(bottom_left.x + spacing*xIndex,bottom_left.y + spacing*yIndex,bottom_left.z + spacing*zIndex);
-		float3 dir;
-
-		// we will randomly sample 3D space by sending rays in randomized directions
-		int votes = 0;
-		float theta;
-		float z;
-
-		for (int j = 0; j < samples; ++j)
-		{
-			// compute the random direction. Convert from polar to euclidean to get an even distribution
-			theta = generate(globalState, index_out % RANDOM_SEEDS) * 2.f * E_PI;
-			z = generate(globalState, index_out % RANDOM_SEEDS) * 2.f - 1.f;
-
-			dir.x = sqrt(1-z*z) * cosf(theta);
-			dir.y = sqrt(1-z*z) * sinf(theta);
-			dir.z = sqrt(1-z*z) * cosf(theta);
-
-			// check if the voxel is inside of the mesh. 
-			// if it is inside, then there should be an odd number of 
-			// intersections with the surrounding mesh
-			unsigned int intersections = 0;
-			for (int i = 0; i < numTriangles; ++i)
-				if (intersects(triangles[i], dir, pos)) 
-					intersections += 1;
-			if (inside(intersections, double_thick)) votes += 1;
+		unsigned char state = brick_state(bricks, bricksX, bricksY, xIndex, yIndex, zIndex);
+		if (state != BRICK_SURFACE) {
+			in = state;
+		} else {
+			// find world space position of the voxel
+			vec3f pos = make_vec3f(bottom_left.x + spacing*xIndex,bottom_left.y + spacing*yIndex,bottom_left.z + spacing*(firstZ + zIndex));
+			// we will sample 3D space by sending rays in a variety of directions
+			in = sampled_inside(triangles, numTriangles, pos, samples, voxel_key(seed, xIndex, yIndex, firstZ + zIndex), double_thick);
 		}
-		// choose the most popular answer from all of the randomized samples
-		R[index_out] = votes > (samples / 2.f);
 	}
+
+	unsigned int bits = warp_bits(in);
+	if (row && threadIdx.x % 32 == 0)
+		store_half(R, (zIndex*h + yIndex)*wordsPerRow + blockIdx.x, threadIdx.x / 32, bits);
 }
 
 // voxelize the given mesh with the given resolution and dimensions
-void kernel_wrapper(int samples, int w, int h, int d, CompFab::VoxelGrid *g_voxelGrid, std::vector<CompFab::Triangle> triangles, bool double_thick)
+void kernel_wrapper(int samples, int w, int h, int d, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, bool double_thick, bool bricks, unsigned int seed)
 {
-	int blocksInX = (w+8-1)/8;
-	int blocksInY = (h+8-1)/8;
-	int blocksInZ = (d+8-1)/8;
+	// one thread per voxel, a block per word of BLOCK_ROWS rows
+	int wordsPerRow = grid->m_wordsPerRow;
+	int blocksInX = wordsPerRow;
+	int blocksInY = (h+BLOCK_ROWS-1)/BLOCK_ROWS;
+	int blocksInZ = d;
 
 	dim3 Dg(blocksInX, blocksInY, blocksInZ);
-	dim3 Db(8, 8, 8);
+	dim3 Db(WORD_THREADS, BLOCK_ROWS, 1);
 
-	curandState* devStates;
-	if (samples > 0) {
-		// set up random numbers
-		dim3 tpb(RANDOM_SEEDS,1,1);
-	    cudaMalloc ( &devStates, RANDOM_SEEDS*sizeof( curandState ) );
-	    // setup seeds
-	    setup_kernel <<< 1, tpb >>> ( devStates, time(NULL) );
-	}
-	
-	// set up boolean array on the GPU
-	bool *gpu_inside_array;
-	gpuErrchk( cudaMalloc( (void **)&gpu_inside_array, sizeof(bool) * w * h * d ) );
-	gpuErrchk( cudaMemcpy( gpu_inside_array, g_voxelGrid->m_insideArray, sizeof(bool) * w * h * d, cudaMemcpyHostToDevice ) );
+	// set up the bit-packed occupancy array on the GPU. The kernels store every
+	// word, so there is nothing to upload
+	double upload = profile_now();
+	size_t grid_bytes = sizeof(CompFab::Word) * grid->m_numWords;
+	CompFab::Word *gpu_inside_array;
+	gpuErrchk( cudaMalloc( (void **)&gpu_inside_array, grid_bytes ) );
 
 	// set up triangle array on the GPU
-	CompFab::Triangle* triangle_array = &triangles[0];
+	const CompFab::Triangle *triangle_array = &triangles[0];
 	CompFab::Triangle* gpu_triangle_array;
 	gpuErrchk( cudaMalloc( (void **)&gpu_triangle_array, sizeof(CompFab::Triangle) * triangles.size() ) );
 	gpuErrchk( cudaMemcpy( gpu_triangle_array, triangle_array, sizeof(CompFab::Triangle) * triangles.size(), cudaMemcpyHostToDevice ) );
-
-	float3 lower_left = make_float3(g_voxelGrid->m_lowerLeft.m_x, g_voxelGrid->m_lowerLeft.m_y, g_voxelGrid->m_lowerLeft.m_z);
+	profile_record("gpu upload", upload, profile_now());
+
+	float3 lower_left = make_float3(grid->m_lowerLeft.m_x, grid->m_lowerLeft.m_y, grid->m_lowerLeft.m_z);
+
+	// classify the bricks on the host, then decide the ones away from the surface
+	// with one voxel each before the voxels of the others
+	double kernels = profile_now();
+	SurfaceBricks surface;
+	unsigned char *gpu_bricks = NULL;
+	if (bricks) {
+		surface.build(*grid, triangles);
+		std::vector<unsigned char> state(surface.m_surface.size());
+		for (size_t i = 0; i < state.size(); ++i) state[i] = surface.m_surface[i] ? BRICK_SURFACE : 0;
+
+		gpuErrchk( cudaMalloc( (void **)&gpu_bricks, state.size() ) );
+		gpuErrchk( cudaMemcpy( gpu_bricks, &state[0], state.size(), cudaMemcpyHostToDevice ) );
+
+		dim3 brick_blocks((surface.m_bricksX+8-1)/8, (surface.m_bricksY+8-1)/8, (surface.m_bricksZ+8-1)/8);
+		brick_kernel<<<brick_blocks, dim3(8, 8, 8)>>>(gpu_bricks, gpu_triangle_array, triangles.size(), (float) grid->m_spacing, lower_left,
+			surface.m_bricksX, surface.m_bricksY, surface.m_bricksZ, grid->m_firstZ, samples, seed, double_thick);
+		gpuErrchk( cudaPeekAtLastError() );
+	}
 		
 	if (samples > 0) {
-		voxelize_kernel_open_mesh<<<Dg, Db>>>(gpu_inside_array, gpu_triangle_array, triangles.size(), (float) g_voxelGrid->m_spacing, lower_left, w, h, d, samples, devStates, double_thick);
+		voxelize_kernel_open_mesh<<<Dg, Db>>>(gpu_inside_array, gpu_triangle_array, triangles.size(), (float) grid->m_spacing, lower_left, w, h, d, wordsPerRow, grid->m_firstZ, samples, seed, double_thick,
+			gpu_bricks, surface.m_bricksX, surface.m_bricksY);
 	} else {
-		voxelize_kernel<<<Dg, Db>>>(gpu_inside_array, gpu_triangle_array, triangles.size(), (float) g_voxelGrid->m_spacing, lower_left, w, h, d, double_thick);
+		voxelize_kernel<<<Dg, Db>>>(gpu_inside_array, gpu_triangle_array, triangles.size(), (float) grid->m_spacing, lower_left, w, h, d, wordsPerRow, grid->m_firstZ, double_thick,
+			gpu_bricks, surface.m_bricksX, surface.m_bricksY);
 	}
 
 	gpuErrchk( cudaPeekAtLastError() );
 	gpuErrchk( cudaDeviceSynchronize() );
+	profile_record("gpu kernels", kernels, profile_now());
 
-	gpuErrchk( cudaMemcpy( g_voxelGrid->m_insideArray, gpu_inside_array, sizeof(bool) * w * h * d, cudaMemcpyDeviceToHost ) );
+	double download = profile_now();
+	gpuErrchk( cudaMemcpy( grid->m_insideArray, gpu_inside_array, grid_bytes, cudaMemcpyDeviceToHost ) );
+	profile_record("gpu download", download, profile_now());
 
 	gpuErrchk( cudaFree(gpu_inside_array) );
 	gpuErrchk( cudaFree(gpu_triangle_array) );
+	if (gpu_bricks) gpuErrchk( cudaFree(gpu_bricks) );
 }
@@ -0,0 +1,111 @@
+#include "includes/pipeline.h"
+#include "includes/ObjWriter.h"
+#include "includes/Profiler.h"
+#include "includes/RawWriter.h"
+#include "includes/SlabVoxelizer.h"
+#include "includes/SparseVoxelOctree.h"
+
+#include <iostream>
+
+bool voxelizeSlabs(VoxelizerArgs *args, const Voxelizer &voxelizer, size_t &filled)
+{
+	size_t budget = (size_t) args->max_memory << 20;
+	CompFab::Vec3 lowerLeft;
+	double spacing;
+	voxelizer.placeGrid(args->size, lowerLeft, spacing);
+	args->debug(1) << "slabs of:  " << SlabVoxelizer(lowerLeft, args->size, args->size, args->size, spacing, budget).depth() << " layers" << std::endl;
+
+	if (args->format == raw)
+		return voxelizer.voxelizeToFile(*args, args->size, budget, (args->output + ".raw").c_str(), true, filled);
+	return voxelizer.voxelizeToFile(*args, args->size, budget, (args->output + ".binvox").c_str(), false, filled);
+}
+
+void voxelizeBricks(VoxelizerArgs *args, const Voxelizer &voxelizer, BrickMap &bricks)
+{
+	int budget = args->max_memory > 0 ? args->max_memory : SPARSE_SLAB_MEMORY;
+	voxelizer.voxelizeBricks(*args, bricks, (size_t) budget << 20);
+}
+
+bool save(VoxelizerArgs *args, const std::string &output, FileFormat format, const CompFab::VoxelGrid &grid)
+{
+	switch (format) {
+		case obj: {
+			ScopedTimer timer("save obj");
+			if (!save_voxels_obj(grid, (output + ".obj").c_str())) return false;
+			break;
+		}
+		case binvox: {
+			ScopedTimer timer("save binvox");
+			if (!grid.save_binvox((output + ".binvox").c_str())) return false;
+			break;
+		}
+		case raw: {
+			ScopedTimer timer("save raw");
+			RawWriter out;
+			if (!out.open((output + ".raw").c_str())) return false;
+			out.write_header(grid.m_dimX, grid.m_dimY, grid.m_dimZ, grid.m_lowerLeft, grid.m_spacing);
+			out.write(grid.m_insideArray, grid.m_numWords);
+			if (!out.close()) return false;
+			break;
+		}
+		case svo: {
+			ScopedTimer timer("save svo");
+			SparseVoxelOctree tree;
+			tree.build(grid);
+			if (!tree.save((output + ".svo").c_str())) return false;
+			break;
+		}
+		default:
+			args->debug(0) << "Failed to save - no file type specified." << std::endl;
+			return false;
+	}
+	return true;
+}
+
+bool save(VoxelizerArgs *args, const CompFab::VoxelGrid &grid)
+{
+	return save(args, args->output, args->format, grid);
+}
+
+void reportResultCache(VoxelizerArgs *args, const ResultCache &cache)
+{
+	size_t hits, misses, evictions, entries, bytes;
+	cache.totals(hits, misses, evictions);
+	cache.usage(entries, bytes);
+	args->debug(1) << "result cache: " << cache.hits() << " hits, " << cache.misses() << " misses, " << cache.evictions() << " evicted"
+		<< " (all runs: " << hits << " hits, " << misses << " misses, " << evictions << " evicted)" << std::endl;
+	args->debug(1) << "result cache: " << entries << " grids, " << bytes / (1024.0*1024.0) << " of " << cache.maxBytes() / (1024*1024)
+		<< " MiB in " << cache.directory() << std::endl;
+}
+
+bool reportProfile(VoxelizerArgs *args)
+{
+	Profiler &profiler = Profiler::global();
+	if (args->verbosity >= 1) {
+		args->debug(1) << "\nProfile:" << std::endl;
+		profiler.printTable(args->debug(1), profiler.now());
+	}
+	if (args->trace.empty()) return true;
+	if (!profiler.writeTrace(args->trace.c_str())) {
+		args->debug(0) << "Failed to write the trace " << args->trace << std::endl;
+		return false;
+	}
+	args->debug(1) << "trace:     " << args->trace << std::endl;
+	return true;
+}
+
+const char *formatExtension(FileFormat format)
+{
+	static const char *extensions[] = { "obj", "binvox", "raw", "svo" };
+	return extensions[format];
+}
+
+bool saveBricks(VoxelizerArgs *args, const BrickMap &bricks)
+{
+	ScopedTimer timer("save bricks");
+	if (args->format == raw) return bricks.save_raw((args->output + ".raw").c_str());
+	if (args->format == binvox) return bricks.save_binvox((args->output + ".binvox").c_str());
+	args->debug(0) << "Failed to save - a sparse grid is saved as binvox or raw." << std::endl;
+	return false;
+}
+
@@ -0,0 +1,577 @@
+#include "includes/voxelize_cpu.h"
+#include "includes/bits.h"
+#include "includes/bricks.h"
+#include "includes/Profiler.h"
+#include "includes/raycast.h"
+#include "includes/ThreadPool.h"
+#include "includes/tribox.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// number of z-slab tiles handed to each thread, more tiles balance better
+// around the mesh where rays are more expensive
+#define TILES_PER_THREAD 4
+// y and z rows of voxels sharing a ray block of the tiled engine
+#define TILED_BLOCK_ROWS 4
+// triangles swept over a ray block at a time, 18 KiB of SoA arrays that stay in L1
+#define TILED_TILE_TRIANGLES 512
+// triangle extents are padded like the BVH boxes before binning them into blocks
+#define TILED_PADDING 1e-5f
+// voxels around the end of a toggled run that the parity fill tests one by one,
+// covering rounding that makes the ray distance not quite monotone along the row
+#define PARITY_WINDOW 2
+
+// the mesh as seen by the slab loops, either a flat triangle list or a BVH over it
+struct MeshView {
+	const CompFab::Triangle *triangles;
+	int numTriangles;
+	const BVH *bvh;
+	// the triangle list in the layout of the SIMD kernels when there is no BVH
+	TriangleSoA soa;
+
+	// counts the crossings of a ray with the mesh
+	unsigned int count_intersections(vec3f dir, vec3f pos) const
+	{
+		PROFILE_COUNT(COUNT_RAYS, 1);
+		unsigned int count;
+		if (bvh) count = bvh->count_intersections(dir, pos);
+		else {
+			PROFILE_COUNT(COUNT_TRIANGLE_TESTS, soa.m_count);
+			count = count_crossings(soa, 0, soa.m_count, dir, pos);
+		}
+		PROFILE_COUNT(COUNT_HITS, count);
+		return count;
+	}
+
+	// appends the distance of every crossing of a ray with the mesh
+	void collect_crossings(vec3f dir, vec3f pos, std::vector<float> &crossings) const
+	{
+		float t;
+		PROFILE_COUNT(COUNT_RAYS, 1);
+		if (bvh) {
+			CollectCrossings collect = {&bvh->m_triangles[0], dir, pos, &crossings};
+			bvh->traverse(dir, pos, collect);
+			return;
+		}
+
+		PROFILE_COUNT(COUNT_TRIANGLE_TESTS, numTriangles);
+		for (int i = 0; i < numTriangles; ++i)
+			if (intersects(triangles[i], dir, pos, t)) {
+				PROFILE_COUNT(COUNT_HITS, 1);
+				crossings.push_back(t);
+			}
+	}
+
+private:
+	struct CollectCrossings {
+		const CompFab::Triangle *m_triangles;
+		vec3f m_dir, m_pos;
+		std::vector<float> *m_crossings;
+
+		void operator()(unsigned int i)
+		{
+			float t;
+			PROFILE_COUNT(COUNT_TRIANGLE_TESTS, 1);
+			if (intersects(m_triangles[i], m_dir, m_pos, t)) {
+				PROFILE_COUNT(COUNT_HITS, 1);
+				m_crossings->push_back(t);
+			}
+		}
+	};
+};
+
+// Decides whether or not each voxel of the slab [z0, z1) is within the given mesh
+static void voxelize_slab(
+	CompFab::VoxelGrid *grid, const MeshView &mesh,
+	const float spacing, const vec3f bottom_left,
+	const int w, const int h, const int z0, const int z1, bool double_thick)
+{
+	// pick an arbitrary sampling direction
+	vec3f dir = make_vec3f(1.0, 0.0, 0.0);
+
+	for (int zIndex = z0; zIndex < z1; ++zIndex)
+		for (int yIndex = 0; yIndex < h; ++yIndex)
+		{
+			CompFab::Word *row = grid->row(yIndex, zIndex);
+			for (unsigned int word = 0; word < grid->m_wordsPerRow; ++word)
+			{
+				// fill a whole word of the row before storing it
+				CompFab::Word bits = 0;
+				int x_end = std::min(w, (int) (word + 1) * CompFab::VOXELS_PER_WORD);
+				for (int xIndex = word * CompFab::VOXELS_PER_WORD; xIndex < x_end; ++xIndex)
+				{
+					// find world space position of the voxel
+					vec3f pos = make_vec3f(bottom_left.x + spacing*xIndex,bottom_left.y + spacing*yIndex,bottom_left.z + spacing*(grid->m_firstZ + zIndex));
+
+					// check if the voxel is inside of the mesh.
+					// if it is inside, then there should be an odd number of
+					// intersections with the surrounding mesh
+					unsigned int intersections = mesh.count_intersections(dir, pos);
+					if (inside(intersections, double_thick))
+						bits |= CompFab::Word(1) << (xIndex % CompFab::VOXELS_PER_WORD);
+				}
+				row[word] = bits;
+			}
+		}
+}
+
+// casts rays from pos along the sample directions of key until the remaining ones
+// cannot change the majority, and picks the most common belief
+static bool sampled_inside(const MeshView &mesh, vec3f pos, const int samples, uint32_t key, bool double_thick)
+{
+	int votes = 0;
+	for (int j = 0; j < samples; ++j)
+	{
+		if (inside(mesh.count_intersections(stratified_direction(key, j), pos), double_thick)) votes += 1;
+		if (vote_decided(votes, j + 1, samples)) break;
+	}
+	return votes > samples / 2;
+}
+
+// Decides whether or not each voxel of the slab [z0, z1) is within the given partially
+// un-closed mesh. checks a variety of directions and picks most common belief
+static void voxelize_slab_open_mesh(
+	CompFab::VoxelGrid *grid, const MeshView &mesh,
+	const float spacing, const vec3f bottom_left,
+	const int w, const int h, const int z0, const int z1,
+	const int samples, uint32_t seed, bool double_thick)
+{
+	for (int zIndex = z0; zIndex < z1; ++zIndex)
+		for (int yIndex = 0; yIndex < h; ++yIndex)
+		{
+			CompFab::Word *row = grid->row(yIndex, zIndex);
+			for (unsigned int word = 0; word < grid->m_wordsPerRow; ++word)
+			{
+				CompFab::Word bits = 0;
+				int x_end = std::min(w, (int) (word + 1) * CompFab::VOXELS_PER_WORD);
+				for (int xIndex = word * CompFab::VOXELS_PER_WORD; xIndex < x_end; ++xIndex)
+				{
+					vec3f pos = make_vec3f(bottom_left.x + spacing*xIndex,bottom_left.y + spacing*yIndex,bottom_left.z + spacing*(grid->m_firstZ + zIndex));
+					if (sampled_inside(mesh, pos, samples, voxel_key(seed, xIndex, yIndex, grid->m_firstZ + zIndex), double_thick))
+						bits |= CompFab::Word(1) << (xIndex % CompFab::VOXELS_PER_WORD);
+				}
+				row[word] = bits;
+			}
+		}
+}
+
+// Coarse-to-fine version of voxelize_slab and voxelize_slab_open_mesh for the z layer
+// bz of bricks. A brick no triangle touches takes the state of its first voxel for
+// all of its voxels, only the bricks on the surface test every voxel.
+static void voxelize_brick_layer(
+	CompFab::VoxelGrid *grid, const MeshView &mesh, const SurfaceBricks &bricks,
+	const float spacing, const vec3f bottom_left,
+	const int w, const int h, const int d, const int bz,
+	const int samples, uint32_t seed, bool double_thick)
+{
+	const int z0 = bz * BRICK_SIZE, z1 = std::min(d, z0 + BRICK_SIZE);
+
+	// the same decision voxelize_slab or voxelize_slab_open_mesh makes for a voxel
+	auto voxel_inside = [&](int xIndex, int yIndex, int zIndex) {
+		vec3f pos = make_vec3f(bottom_left.x + spacing*xIndex,bottom_left.y + spacing*yIndex,bottom_left.z + spacing*(grid->m_firstZ + zIndex));
+		if (samples <= 0)
+			return inside(mesh.count_intersections(make_vec3f(1.0, 0.0, 0.0), pos), double_thick);
+
+		return sampled_inside(mesh, pos, samples, voxel_key(seed, xIndex, yIndex, grid->m_firstZ + zIndex), double_thick);
+	};
+
+	for (int zIndex = z0; zIndex < z1; ++zIndex)
+		for (int yIndex = 0; yIndex < h; ++yIndex)
+			std::fill(grid->row(yIndex, zIndex), grid->row(yIndex, zIndex) + grid->m_wordsPerRow, 0);
+
+	// a brick never straddles a word of a row
+	for (unsigned int by = 0; by < bricks.m_bricksY; ++by)
+		for (unsigned int bx = 0; bx < bricks.m_bricksX; ++bx)
+		{
+			int x0 = bx * BRICK_SIZE, x1 = std::min(w, x0 + BRICK_SIZE);
+			int y0 = by * BRICK_SIZE, y1 = std::min(h, y0 + BRICK_SIZE);
+			unsigned int word = x0 / CompFab::VOXELS_PER_WORD;
+
+			if (!bricks.surface(bx, by, bz)) {
+				if (!voxel_inside(x0, y0, z0)) continue;
+				CompFab::Word mask = range_mask(word, x0, x1);
+				for (int zIndex = z0; zIndex < z1; ++zIndex)
+					for (int yIndex = y0; yIndex < y1; ++yIndex)
+						grid->row(yIndex, zIndex)[word] |= mask;
+				continue;
+			}
+
+			for (int zIndex = z0; zIndex < z1; ++zIndex)
+				for (int yIndex = y0; yIndex < y1; ++yIndex)
+				{
+					CompFab::Word bits = 0;
+					for (int xIndex = x0; xIndex < x1; ++xIndex)
+						if (voxel_inside(xIndex, yIndex, zIndex))
+							bits |= CompFab::Word(1) << (xIndex % CompFab::VOXELS_PER_WORD);
+					grid->row(yIndex, zIndex)[word] |= bits;
+				}
+		}
+}
+
+// Decides whether or not each voxel of the slab [z0, z1) is within the given mesh,
+// casting one +X ray per (y, z) row. The voxels of a row all lie on the ray from its
+// first voxel, so the sorted crossing distances split the row into intervals
+// of constant parity.
+static void scanline_slab(
+	CompFab::VoxelGrid *grid, const MeshView &mesh,
+	const float spacing, const vec3f bottom_left,
+	const int w, const int h, const int z0, const int z1, bool double_thick)
+{
+	vec3f dir = make_vec3f(1.0, 0.0, 0.0);
+	std::vector<float> crossings;
+
+	for (int zIndex = z0; zIndex < z1; ++zIndex)
+		for (int yIndex = 0; yIndex < h; ++yIndex)
+		{
+			vec3f origin = make_vec3f(bottom_left.x, bottom_left.y + spacing*yIndex, bottom_left.z + spacing*(grid->m_firstZ + zIndex));
+
+			crossings.clear();
+			mesh.collect_crossings(dir, origin, crossings);
+			std::sort(crossings.begin(), crossings.end());
+
+			// walk the row and the crossings together. A voxel counts the crossings
+			// that are more than EPSILONF in front of it, like its own ray does up to
+			// rounding: the distances are measured from the start of the row, so a
+			// crossing within float rounding of EPSILONF in front of a voxel center may
+			// count differently (2 voxels of the bunny at 300^3 differ from the ray mode)
+			CompFab::Word *row = grid->row(yIndex, zIndex);
+			size_t behind = 0;
+			for (unsigned int word = 0; word < grid->m_wordsPerRow; ++word)
+			{
+				CompFab::Word bits = 0;
+				int x_end = std::min(w, (int) (word + 1) * CompFab::VOXELS_PER_WORD);
+				for (int xIndex = word * CompFab::VOXELS_PER_WORD; xIndex < x_end; ++xIndex)
+				{
+					float offset = spacing*xIndex;
+					while (behind < crossings.size() && crossings[behind] <= offset + EPSILONF)
+						behind++;
+					if (inside(crossings.size() - behind, double_thick))
+						bits |= CompFab::Word(1) << (xIndex % CompFab::VOXELS_PER_WORD);
+				}
+				row[word] = bits;
+			}
+		}
+}
+
+// splits [0, d) into slabs and runs fn(z0, z1) for each of them on the thread pool
+template <typename SlabFn>
+static void for_each_slab(int d, const SlabFn &fn)
+{
+	ThreadPool &pool = ThreadPool::global();
+
+	int tiles = std::min(d, (int) pool.size() * TILES_PER_THREAD);
+	if (tiles < 1) return;
+	int slab = (d + tiles - 1) / tiles;
+	tiles = (d + slab - 1) / slab;
+
+	pool.parallel_for(0, tiles, [&](size_t tile) {
+		int z0 = tile * slab;
+		fn(tile, z0, std::min(d, z0 + slab));
+	});
+}
+
+static void make_mesh_view(MeshView &mesh, const std::vector<CompFab::Triangle> &triangles, const BVH *bvh)
+{
+	mesh.triangles = triangles.empty() ? NULL : &triangles[0];
+	mesh.numTriangles = triangles.size();
+	mesh.bvh = (bvh && !bvh->empty()) ? bvh : NULL;
+	if (!mesh.bvh) mesh.soa.build(triangles);
+}
+
+// Mirrors kernel_wrapper in main.cu: the grid is split into slabs along z which
+// are distributed over the global thread pool.
+void cpu_kernel_wrapper(int samples, int w, int h, int d, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, bool double_thick, const BVH *bvh, bool bricks, unsigned int seed)
+{
+	MeshView mesh;
+	make_mesh_view(mesh, triangles, bvh);
+	const float spacing = grid->m_spacing;
+	const vec3f lower_left = make_vec3f(grid->m_lowerLeft);
+
+	if (bricks) {
+		SurfaceBricks surface;
+		surface.build(*grid, triangles);
+		// layers of bricks are the tiles
+		ThreadPool::global().parallel_for(0, surface.m_bricksZ, [&](size_t bz) {
+			voxelize_brick_layer(grid, mesh, surface, spacing, lower_left, w, h, d, bz, samples, seed, double_thick);
+		});
+		return;
+	}
+
+	for_each_slab(d, [&](size_t tile, int z0, int z1) {
+		if (samples > 0) {
+			// the directions depend on the seed and the voxel only, not on the tiles
+			voxelize_slab_open_mesh(grid, mesh, spacing, lower_left, w, h, z0, z1, samples, seed, double_thick);
+		} else {
+			voxelize_slab(grid, mesh, spacing, lower_left, w, h, z0, z1, double_thick);
+		}
+	});
+}
+
+void cpu_scanline_wrapper(int w, int h, int d, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, bool double_thick, const BVH *bvh)
+{
+	MeshView mesh;
+	make_mesh_view(mesh, triangles, bvh);
+	const float spacing = grid->m_spacing;
+	const vec3f lower_left = make_vec3f(grid->m_lowerLeft);
+
+	for_each_slab(d, [&](size_t tile, int z0, int z1) {
+		scanline_slab(grid, mesh, spacing, lower_left, w, h, z0, z1, double_thick);
+	});
+}
+
+// the rows [first, last] whose coordinate origin + spacing*row lies within the
+// padded extent [lo, hi], clamped to [0, n). Empty when first > last.
+static void overlapped_rows(float lo, float hi, float origin, float spacing, int n, int &first, int &last)
+{
+	float pad = TILED_PADDING * (1.f + std::max(fabsf(lo), fabsf(hi)));
+	first = std::max(0, (int) floorf((lo - pad - origin) / spacing));
+	last = std::min(n - 1, (int) ceilf((hi + pad - origin) / spacing));
+}
+
+// Triangle-major counterpart of voxelize_slab. The +X rays of a block of rows can
+// only cross triangles overlapping the block in y and z, so those are binned per
+// block and copied into one SoA. Every tile of it is then swept over all rays of
+// the block, loading each triangle once per block instead of once per ray.
+void cpu_tiled_wrapper(int w, int h, int d, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, bool double_thick)
+{
+	const float spacing = grid->m_spacing;
+	const vec3f lower_left = make_vec3f(grid->m_lowerLeft);
+	const vec3f dir = make_vec3f(1.0, 0.0, 0.0);
+	// z of the grid's first layer, it may be a slab of a larger grid
+	const float first_z = lower_left.z + spacing*grid->m_firstZ;
+	const int blocks_y = (h + TILED_BLOCK_ROWS - 1) / TILED_BLOCK_ROWS;
+	const int blocks_z = (d + TILED_BLOCK_ROWS - 1) / TILED_BLOCK_ROWS;
+	if (blocks_y <= 0 || blocks_z <= 0) return;
+
+	TriangleSoA soa;
+	soa.build(triangles);
+
+	// counting sort of the triangles into the blocks they overlap
+	std::vector<int> block_range(4 * triangles.size());
+	std::vector<unsigned int> offsets(blocks_y * blocks_z + 1, 0);
+	for (size_t i = 0; i < triangles.size(); ++i) {
+		const CompFab::Triangle &t = triangles[i];
+		int *range = &block_range[4 * i];
+		int y0, y1, z0, z1;
+		overlapped_rows(std::min(t.m_v1.m_y, std::min(t.m_v2.m_y, t.m_v3.m_y)), std::max(t.m_v1.m_y, std::max(t.m_v2.m_y, t.m_v3.m_y)),
+			lower_left.y, spacing, h, y0, y1);
+		overlapped_rows(std::min(t.m_v1.m_z, std::min(t.m_v2.m_z, t.m_v3.m_z)), std::max(t.m_v1.m_z, std::max(t.m_v2.m_z, t.m_v3.m_z)),
+			first_z, spacing, d, z0, z1);
+		if (y0 > y1 || z0 > z1) {
+			range[0] = range[2] = 0;
+			range[1] = range[3] = -1;
+			continue;
+		}
+		range[0] = y0 / TILED_BLOCK_ROWS; range[1] = y1 / TILED_BLOCK_ROWS;
+		range[2] = z0 / TILED_BLOCK_ROWS; range[3] = z1 / TILED_BLOCK_ROWS;
+		for (int bz = range[2]; bz <= range[3]; ++bz)
+			for (int by = range[0]; by <= range[1]; ++by)
+				offsets[bz * blocks_y + by + 1]++;
+	}
+	for (size_t b = 1; b < offsets.size(); ++b) offsets[b] += offsets[b - 1];
+
+	std::vector<unsigned int> binned(offsets.back());
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < triangles.size(); ++i) {
+		const int *range = &block_range[4 * i];
+		for (int bz = range[2]; bz <= range[3]; ++bz)
+			for (int by = range[0]; by <= range[1]; ++by)
+				binned[fill[bz * blocks_y + by]++] = i;
+	}
+
+	ThreadPool::global().parallel_for(0, blocks_y * blocks_z, [&](size_t block) {
+		int y0 = (block % blocks_y) * TILED_BLOCK_ROWS, y1 = std::min(h, y0 + TILED_BLOCK_ROWS);
+		int z0 = (block / blocks_y) * TILED_BLOCK_ROWS, z1 = std::min(d, z0 + TILED_BLOCK_ROWS);
+		int rows_y = y1 - y0;
+
+		TriangleSoA local;
+		local.build(soa, &binned[offsets[block]], offsets[block + 1] - offsets[block]);
+		std::vector<unsigned int> crossings((size_t) w * rows_y * (z1 - z0), 0);
+
+		for (size_t t0 = 0; t0 < local.m_count; t0 += TILED_TILE_TRIANGLES) {
+			size_t t1 = std::min(local.m_count, t0 + TILED_TILE_TRIANGLES);
+			unsigned int *count = &crossings[0];
+			for (int zIndex = z0; zIndex < z1; ++zIndex)
+				for (int yIndex = y0; yIndex < y1; ++yIndex)
+					for (int xIndex = 0; xIndex < w; ++xIndex) {
+						// the same positions as voxelize_slab
+						vec3f pos = make_vec3f(lower_left.x + spacing*xIndex, lower_left.y + spacing*yIndex, lower_left.z + spacing*(grid->m_firstZ + zIndex));
+						*count++ += count_crossings(local, t0, t1, dir, pos);
+					}
+		}
+		// a ray per voxel, each tested against all triangles of the block
+		PROFILE_COUNT(COUNT_RAYS, crossings.size());
+		PROFILE_COUNT(COUNT_TRIANGLE_TESTS, crossings.size() * local.m_count);
+
+		const unsigned int *count = &crossings[0];
+		for (int zIndex = z0; zIndex < z1; ++zIndex)
+			for (int yIndex = y0; yIndex < y1; ++yIndex) {
+				CompFab::Word *row = grid->row(yIndex, zIndex);
+				for (unsigned int word = 0; word < grid->m_wordsPerRow; ++word) {
+					CompFab::Word bits = 0;
+					int x_end = std::min(w, (int) (word + 1) * CompFab::VOXELS_PER_WORD);
+					for (int xIndex = word * CompFab::VOXELS_PER_WORD; xIndex < x_end; ++xIndex) {
+						PROFILE_COUNT(COUNT_HITS, *count);
+						if (inside(*count++, double_thick))
+							bits |= CompFab::Word(1) << (xIndex % CompFab::VOXELS_PER_WORD);
+					}
+					row[word] = bits;
+				}
+			}
+	});
+}
+
+// flips the voxels [0, end) of a row. With a carry plane the row and the carry are
+// a two bit counter per voxel that the flip increments
+static inline void toggle_prefix(CompFab::Word *row, CompFab::Word *carry, int end)
+{
+	int full = end / CompFab::VOXELS_PER_WORD;
+	for (int word = 0; word < full; ++word) {
+		if (carry) carry[word] ^= row[word];
+		row[word] = ~row[word];
+	}
+	if (end % CompFab::VOXELS_PER_WORD) {
+		CompFab::Word mask = range_mask(full, 0, end);
+		if (carry) carry[full] ^= row[full] & mask;
+		row[full] ^= mask;
+	}
+}
+
+static inline void toggle_voxel(CompFab::Word *row, CompFab::Word *carry, int xIndex)
+{
+	CompFab::Word bit = CompFab::Word(1) << (xIndex % CompFab::VOXELS_PER_WORD);
+	int word = xIndex / CompFab::VOXELS_PER_WORD;
+	if (carry) carry[word] ^= row[word] & bit;
+	row[word] ^= bit;
+}
+
+// Triangle-major parity fill. Every triangle toggles, in each row its projection onto
+// the yz plane covers, the voxels whose +X ray crosses it: a run from the start of
+// the row up to the crossing, whole-word XORs and one masked XOR. The parity of the
+// toggles then is the parity of the crossings, the same grid voxelize_slab fills.
+// For a +X ray the determinant, u and v do not depend on x, so whether a row is
+// covered and where the run ends are decided by the scalar ray test itself.
+void cpu_parity_wrapper(int w, int h, int d, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, bool double_thick)
+{
+	const float spacing = grid->m_spacing;
+	const vec3f lower_left = make_vec3f(grid->m_lowerLeft);
+	const vec3f dir = make_vec3f(1.0, 0.0, 0.0);
+	const float first_z = lower_left.z + spacing*grid->m_firstZ;
+	const unsigned int words = grid->m_wordsPerRow;
+
+	TriangleSoA soa;
+	soa.build(triangles);
+	// bit-identical to the SIMD kernels, and cheapest for a single triangle
+	const CrossingKernel crosses = crossing_kernel(SIMD_SCALAR);
+
+	for_each_slab(d, [&](size_t tile, int z0, int z1) {
+		for (int zIndex = z0; zIndex < z1; ++zIndex)
+			for (int yIndex = 0; yIndex < h; ++yIndex)
+				std::fill(grid->row(yIndex, zIndex), grid->row(yIndex, zIndex) + words, 0);
+		// the second bit of the crossing counters of double_thick
+		std::vector<CompFab::Word> carries(double_thick ? (size_t) (z1 - z0) * h * words : 0, 0);
+
+		for (size_t i = 0; i < triangles.size(); ++i) {
+			const CompFab::Triangle &t = triangles[i];
+			int y0, y1, tz0, tz1;
+			overlapped_rows(std::min(t.m_v1.m_y, std::min(t.m_v2.m_y, t.m_v3.m_y)), std::max(t.m_v1.m_y, std::max(t.m_v2.m_y, t.m_v3.m_y)),
+				lower_left.y, spacing, h, y0, y1);
+			overlapped_rows(std::min(t.m_v1.m_z, std::min(t.m_v2.m_z, t.m_v3.m_z)), std::max(t.m_v1.m_z, std::max(t.m_v2.m_z, t.m_v3.m_z)),
+				first_z, spacing, d, tz0, tz1);
+			tz0 = std::max(tz0, z0);
+			tz1 = std::min(tz1, z1 - 1);
+
+			for (int zIndex = tz0; zIndex <= tz1; ++zIndex)
+				for (int yIndex = y0; yIndex <= y1; ++yIndex) {
+					// does the ray of voxel xIndex of the row cross the triangle. Counted
+					// as a ray of its own, the fill casts no ray at the whole mesh
+					auto hit = [&](int xIndex) {
+						vec3f pos = make_vec3f(lower_left.x + spacing*xIndex, lower_left.y + spacing*yIndex, lower_left.z + spacing*(grid->m_firstZ + zIndex));
+						bool crossed = crosses(soa, i, i + 1, dir, pos) != 0;
+						PROFILE_COUNT(COUNT_RAYS, 1);
+						PROFILE_COUNT(COUNT_TRIANGLE_TESTS, 1);
+						PROFILE_COUNT(COUNT_HITS, crossed);
+						return crossed;
+					};
+					// a ray from before the row crosses the triangle if the row is covered
+					if (!hit(-1)) continue;
+
+					// the first voxel whose ray misses, the crossing lies before it
+					int lo = 0, hi = w;
+					while (lo < hi) {
+						int mid = (lo + hi) / 2;
+						if (hit(mid)) lo = mid + 1;
+						else hi = mid;
+					}
+
+					CompFab::Word *row = grid->row(yIndex, zIndex);
+					CompFab::Word *carry = double_thick ? &carries[((size_t) (zIndex - z0) * h + yIndex) * words] : NULL;
+					int run = std::max(0, lo - PARITY_WINDOW);
+					toggle_prefix(row, carry, run);
+					for (int xIndex = run; xIndex < std::min(w, lo + PARITY_WINDOW); ++xIndex)
+						if (hit(xIndex)) toggle_voxel(row, carry, xIndex);
+				}
+		}
+
+		// double_thick voxels are inside when the second bit of the count is set
+		if (double_thick)
+			for (int zIndex = z0; zIndex < z1; ++zIndex)
+				for (int yIndex = 0; yIndex < h; ++yIndex)
+					std::copy(&carries[((size_t) (zIndex - z0) * h + yIndex) * words],
+						&carries[((size_t) (zIndex - z0) * h + yIndex + 1) * words], grid->row(yIndex, zIndex));
+	});
+}
+
+// Surface voxelization: marks the voxels whose cube a triangle overlaps for a
+// 26-separating shell, or whose inscribed diamonds it overlaps for a 6-separating
+// one. A triangle only tests the voxels around its bounding box, and the slabs
+// run in parallel, so the cost grows with the surface area.
+void cpu_surface_wrapper(int w, int h, int d, CompFab::VoxelGrid *grid, const std::vector<CompFab::Triangle> &triangles, int separating)
+{
+	const float spacing = grid->m_spacing;
+	const vec3f lower_left = make_vec3f(grid->m_lowerLeft);
+	const float origin[3] = {lower_left.x, lower_left.y, lower_left.z + spacing*grid->m_firstZ};
+	const int dims[3] = {w, h, d};
+	const float half = 0.5f * spacing;
+
+	// voxels whose cubes the bounding box of each triangle overlaps, the cube of
+	// voxel i spanning origin + spacing*i +- half
+	std::vector<int> ranges(6 * triangles.size());
+	for (size_t i = 0; i < triangles.size(); ++i) {
+		const CompFab::Triangle &t = triangles[i];
+		for (int axis = 0; axis < 3; ++axis) {
+			float lo = std::min(t.m_v1[axis], std::min(t.m_v2[axis], t.m_v3[axis]));
+			float hi = std::max(t.m_v1[axis], std::max(t.m_v2[axis], t.m_v3[axis]));
+			overlapped_rows(lo - half, hi + half, origin[axis], spacing, dims[axis], ranges[6*i + 2*axis], ranges[6*i + 2*axis + 1]);
+		}
+	}
+
+	for_each_slab(d, [&](size_t tile, int z0, int z1) {
+		for (int zIndex = z0; zIndex < z1; ++zIndex)
+			for (int yIndex = 0; yIndex < h; ++yIndex)
+				std::fill(grid->row(yIndex, zIndex), grid->row(yIndex, zIndex) + grid->m_wordsPerRow, 0);
+
+		for (size_t i = 0; i < triangles.size(); ++i) {
+			const int *range = &ranges[6 * i];
+			int tz0 = std::max(range[4], z0), tz1 = std::min(range[5], z1 - 1);
+			if (range[0] > range[1] || range[2] > range[3] || tz0 > tz1) continue;
+
+			const CompFab::Triangle &t = triangles[i];
+			vec3f a = make_vec3f(t.m_v1), b = make_vec3f(t.m_v2), c = make_vec3f(t.m_v3);
+			for (int zIndex = tz0; zIndex <= tz1; ++zIndex)
+				for (int yIndex = range[2]; yIndex <= range[3]; ++yIndex) {
+					CompFab::Word *row = grid->row(yIndex, zIndex);
+					for (int xIndex = range[0]; xIndex <= range[1]; ++xIndex) {
+						vec3f center = make_vec3f(lower_left.x + spacing*xIndex, lower_left.y + spacing*yIndex, lower_left.z + spacing*(grid->m_firstZ + zIndex));
+						bool overlaps = separating == 6
+							? triangle_cube_overlap_thin(center, half, a, b, c)
+							: triangle_box_overlap(center, make_vec3f(half, half, half), a, b, c);
+						if (overlaps)
+							row[xIndex / CompFab::VOXELS_PER_WORD] |= CompFab::Word(1) << (xIndex % CompFab::VOXELS_PER_WORD);
+					}
+				}
+		}
+	});
+}